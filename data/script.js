@@ -1,6 +1,8 @@
 // Конфигурация
 const API_ENDPOINT = '/api/data';
-const UPDATE_INTERVAL = 5000; // 5 секунд
+const EVENTS_ENDPOINT = '/api/events'; // Живые обновления (SSE)
+const UPDATE_INTERVAL = 5000; // 5 секунд (опрос, если SSE недоступен)
+const CHART_UPDATE_INTERVAL = 5000;
 
 // Элементы DOM
 const elements = {
@@ -15,6 +17,13 @@ const elements = {
 
 // Состояние
 let updateInterval = null;
+let chartInterval = null;
+let uptimeInterval = null;
+let eventSource = null;
+let liveTopology = null; // Поколение состава термометров из SSE
+let liveStatus = { mqtt: null, telegram: null };
+let uptimeBase = null; // {seconds, at} - uptime досчитывается локально между кадрами
+let dataGeneration = null; // Поколение последнего ответа /api/data (для ?since=)
 let temperatureChart = null;
 let currentChartPeriod = '24h';
 let sensors = [];
@@ -34,7 +43,9 @@ function formatTime(date) {
 // Функция получения данных с сервера
 async function fetchData() {
     try {
-        const response = await fetch(API_ENDPOINT);
+        // Повторный опрос - только изменения с прошлого ответа
+        const url = dataGeneration !== null ? `${API_ENDPOINT}?since=${dataGeneration}` : API_ENDPOINT;
+        const response = await fetch(url);
         if (response.status === 401) {
             // Не авторизован - редирект на логин
             window.location.href = '/login.html';
@@ -44,6 +55,13 @@ async function fetchData() {
             throw new Error(`HTTP error! status: ${response.status}`);
         }
         const data = await response.json();
+        // Полный ответ на ?since= - сменился состав термометров или устройство перезагрузилось
+        if (dataGeneration !== null && !data.delta) {
+            loadSensors();
+        }
+        if (data.generation !== undefined) {
+            dataGeneration = data.generation;
+        }
         updateUI(data);
         elements.lastUpdate.textContent = formatTime(new Date());
     } catch (error) {
@@ -53,30 +71,39 @@ async function fetchData() {
 }
 
 // Функция обновления интерфейса
+// В ответе на ?since= (data.delta) есть только изменившиеся поля
 function updateUI(data) {
     // Wi-Fi статус в шапке
-    updateWiFiHeader(data.wifi_status, data.wifi_rssi);
+    if (data.wifi_status !== undefined) {
+        updateWiFiHeader(data.wifi_status, data.wifi_rssi);
+    }
     
     // IP адрес в шапке
-    if (elements.ipAddressHeader) {
+    if (elements.ipAddressHeader && data.ip !== undefined) {
         elements.ipAddressHeader.textContent = data.ip || '--';
     }
 
     // Uptime
+    if (data.uptime !== undefined) {
+        uptimeBase = { seconds: data.uptime, at: Date.now() };
+    }
     if (elements.uptimeHeaderValue) {
         elements.uptimeHeaderValue.textContent = data.uptime_formatted || '--';
     }
 
-    if (elements.wifiStatusText) {
+    if (elements.wifiStatusText && data.wifi_status !== undefined) {
         elements.wifiStatusText.textContent = data.wifi_status === 'connected' ? 'Подключен' : 'Отключен';
     }
 
+    if (data.mqtt) liveStatus.mqtt = data.mqtt;
+    if (data.telegram) liveStatus.telegram = data.telegram;
+
     if (elements.mqttStatus) {
-        elements.mqttStatus.textContent = formatMqttStatus(data.mqtt);
+        elements.mqttStatus.textContent = formatMqttStatus(liveStatus.mqtt);
     }
 
     // Обновляем статусы MQTT и Telegram в тулбаре
-    updateServiceStatusDots(data.mqtt, data.telegram);
+    updateServiceStatusDots(liveStatus.mqtt, liveStatus.telegram);
     
     // Обновляем данные термометров (используем адрес как ключ)
     if (data.sensors && Array.isArray(data.sensors)) {
@@ -91,6 +118,136 @@ function updateUI(data) {
     }
 }
 
+function formatUptime(seconds) {
+    const h = Math.floor(seconds / 3600);
+    const m = Math.floor((seconds % 3600) / 60);
+    const s = seconds % 60;
+    return `${h}h ${m}m ${s}s`;
+}
+
+function renderUptime() {
+    if (!uptimeBase || !elements.uptimeHeaderValue) return;
+    const seconds = uptimeBase.seconds + Math.floor((Date.now() - uptimeBase.at) / 1000);
+    elements.uptimeHeaderValue.textContent = formatUptime(seconds);
+}
+
+// Применение кадра SSE: в дельте только изменившиеся поля, full - полное состояние
+function applyLiveFrame(frame) {
+    if (frame.topology !== undefined) {
+        // Изменился состав или настройки термометров - перечитываем список
+        if (liveTopology !== null && frame.topology !== liveTopology) {
+            loadSensors();
+        }
+        liveTopology = frame.topology;
+    }
+
+    if (frame.uptime !== undefined) {
+        uptimeBase = { seconds: frame.uptime, at: Date.now() };
+        renderUptime();
+    }
+
+    if (frame.wifi_status !== undefined) {
+        updateWiFiHeader(frame.wifi_status, frame.wifi_rssi);
+        if (elements.ipAddressHeader) {
+            elements.ipAddressHeader.textContent = frame.ip || '--';
+        }
+    }
+
+    if (frame.mqtt || frame.telegram) {
+        if (frame.mqtt) liveStatus.mqtt = frame.mqtt;
+        if (frame.telegram) liveStatus.telegram = frame.telegram;
+        updateServiceStatusDots(liveStatus.mqtt, liveStatus.telegram);
+    }
+
+    if (frame.sensors && Array.isArray(frame.sensors)) {
+        frame.sensors.forEach(sensor => {
+            const previous = sensorsData[sensor.address] || {};
+            sensorsData[sensor.address] = {
+                currentTemp: sensor.currentTemp,
+                stabilizationState: previous.stabilizationState || 'tracking'
+            };
+        });
+        renderSensorCells();
+    }
+
+    elements.lastUpdate.textContent = formatTime(new Date());
+}
+
+function startPolling() {
+    if (!updateInterval) {
+        updateInterval = setInterval(fetchData, UPDATE_INTERVAL);
+    }
+}
+
+function stopPolling() {
+    if (updateInterval) {
+        clearInterval(updateInterval);
+        updateInterval = null;
+    }
+}
+
+// Подписка на SSE. Пока соединение не установлено (или браузер переподключается) - опрос /api/data
+function startLiveUpdates() {
+    if (typeof EventSource === 'undefined') {
+        startPolling();
+        return;
+    }
+    if (eventSource) return;
+
+    eventSource = new EventSource(EVENTS_ENDPOINT);
+    eventSource.addEventListener('data', (event) => {
+        try {
+            applyLiveFrame(JSON.parse(event.data));
+        } catch (e) {
+            console.warn('Invalid live frame:', e);
+        }
+    });
+    eventSource.onopen = () => {
+        stopPolling();
+    };
+    eventSource.onerror = () => {
+        startPolling();
+        if (eventSource && eventSource.readyState === EventSource.CLOSED) {
+            // Браузер не будет переподключаться сам - пробуем позже
+            eventSource = null;
+            setTimeout(() => {
+                if (!document.hidden) startLiveUpdates();
+            }, UPDATE_INTERVAL * 6);
+        }
+    };
+    startPolling();
+}
+
+function stopLiveUpdates() {
+    if (eventSource) {
+        eventSource.close();
+        eventSource = null;
+    }
+    stopPolling();
+}
+
+function startBackgroundUpdates() {
+    startLiveUpdates();
+    if (!uptimeInterval) {
+        uptimeInterval = setInterval(renderUptime, 1000);
+    }
+    if (!chartInterval && typeof Chart !== 'undefined') {
+        chartInterval = setInterval(() => loadChart(currentChartPeriod), CHART_UPDATE_INTERVAL);
+    }
+}
+
+function stopBackgroundUpdates() {
+    stopLiveUpdates();
+    if (uptimeInterval) {
+        clearInterval(uptimeInterval);
+        uptimeInterval = null;
+    }
+    if (chartInterval) {
+        clearInterval(chartInterval);
+        chartInterval = null;
+    }
+}
+
 function formatMqttStatus(mqtt) {
     if (!mqtt) return '--';
     if (mqtt.status === 'not_configured') return 'Не настроен';
@@ -953,34 +1110,19 @@ async function init() {
         if (chartUnavailable) chartUnavailable.style.display = 'block';
     }
 
-    // Установка интервала обновления
-    updateInterval = setInterval(() => {
-        fetchData();
-        if (typeof Chart !== 'undefined') {
-            loadChart(currentChartPeriod);
-        }
-    }, UPDATE_INTERVAL);
-    
+    // Живые обновления (SSE) с опросом в качестве запасного варианта
+    startBackgroundUpdates();
+
     // Обработка видимости страницы (остановка обновлений при скрытии вкладки)
     document.addEventListener('visibilitychange', () => {
         if (document.hidden) {
-            if (updateInterval) {
-                clearInterval(updateInterval);
-                updateInterval = null;
-            }
+            stopBackgroundUpdates();
         } else {
-            if (!updateInterval) {
-                fetchData();
-                if (typeof Chart !== 'undefined') {
-                    loadChart(currentChartPeriod);
-                }
-                updateInterval = setInterval(() => {
-                    fetchData();
-                    if (typeof Chart !== 'undefined') {
-                        loadChart(currentChartPeriod);
-                    }
-                }, UPDATE_INTERVAL);
+            fetchData();
+            if (typeof Chart !== 'undefined') {
+                loadChart(currentChartPeriod);
             }
+            startBackgroundUpdates();
         }
     });
 }
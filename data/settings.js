@@ -392,27 +392,33 @@ async function saveSettings(section) {
                 };
             });
             
-            // Отправляем через специальный API для датчиков
-            const sensorsResponse = await fetch('/api/sensors', {
+            // Термометры и остальные разделы - одним пакетом: одна проверка и одна запись в NVS
+            // Термометры без адреса (не найденные на шине) не сохраняются
+            const batch = { sensors: sensorsToSave.filter(s => s.address) };
+            if (Object.keys(settings).length > 0) {
+                batch.settings = settings;
+            }
+            const batchResponse = await fetch('/api/sensors/batch', {
                 method: 'POST',
                 headers: {
                     'Content-Type': 'application/json'
                 },
-                body: JSON.stringify({ sensors: sensorsToSave })
+                body: JSON.stringify(batch)
             });
             
-            if (!sensorsResponse.ok) {
-                throw new Error('Ошибка сохранения настроек термометров');
+            if (!batchResponse.ok) {
+                const result = await batchResponse.json().catch(() => ({}));
+                const failed = (result.items || []).find(item => item.status === 'error');
+                const reason = failed ? `${failed.address}: ${failed.error}` : (result.message || '');
+                throw new Error('Ошибка сохранения настроек термометров' + (reason ? ' (' + reason + ')' : ''));
             }
             
             // Перезагружаем список термометров после сохранения
             await loadSensors();
             renderSensors(); // Обновляем отображение в настройках
             showMessage('Настройки термометров сохранены', 'success');
-        }
-        
-        // Сохраняем остальные настройки, если они есть
-        if (Object.keys(settings).length > 0) {
+        } else if (Object.keys(settings).length > 0) {
+            // Сохраняем остальные настройки
             const response = await fetch('/api/settings', {
                 method: 'POST',
                 headers: {
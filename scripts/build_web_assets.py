@@ -0,0 +1,129 @@
+"""
+Сборка веб-интерфейса в образ прошивки: gzip + ETag по содержимому.
+
+Исходники лежат в data/, результат - src/web_assets_data.h (генерируется, в git не хранится):
+  - массив const uint8_t на каждый файл (gzip -9, без метки времени - сборка воспроизводима);
+  - таблица embeddedAssets: url, ETag, MIME, указатель и длина - для static_assets.cpp.
+Массивы лежат в разделе app и читаются из flash через кеш (memory-mapped), без SPIFFS.
+Заголовок перезаписывается только при изменении содержимого, чтобы не пересобирать лишнее.
+
+В HTML ссылки на локальные ресурсы получают суффикс ?v=<хеш>, поэтому JS/CSS можно
+отдавать с Cache-Control: immutable - после обновления прошивки изменится сама ссылка.
+
+SPIFFS остается только для данных (история); каталог образа - data_fs/ (data_dir в platformio.ini).
+
+Запускается PlatformIO перед сборкой (extra_scripts = pre:...) или вручную:
+  python scripts/build_web_assets.py
+"""
+import gzip
+import hashlib
+import os
+import re
+
+MIME_TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".ico": "image/x-icon",
+    ".png": "image/png",
+    ".svg": "image/svg+xml",
+}
+
+HEADER_NAME = "web_assets_data.h"
+BYTES_PER_LINE = 24
+
+
+def project_dir():
+    try:
+        Import("env")  # noqa: F821 - определено в SCons
+        return env.subst("$PROJECT_DIR")  # noqa: F821
+    except NameError:
+        return os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+def content_hash(data):
+    return hashlib.sha1(data).hexdigest()[:16]
+
+
+def rewrite_html(text, versions):
+    # src="script.js" / href="/style.css" -> ...?v=<хеш>
+    def repl(match):
+        attr, slash, name = match.group(1), match.group(2), match.group(3)
+        if name not in versions:
+            return match.group(0)
+        return '%s="%s%s?v=%s"' % (attr, slash, name, versions[name][:8])
+
+    return re.sub(r'(src|href)="(/?)([\w.\-]+)"', repl, text)
+
+
+def c_array(symbol, data):
+    lines = ["static const uint8_t %s[] PROGMEM = {" % symbol]
+    for i in range(0, len(data), BYTES_PER_LINE):
+        lines.append("  " + ",".join("0x%02x" % b for b in data[i:i + BYTES_PER_LINE]) + ",")
+    lines.append("};")
+    return "\n".join(lines)
+
+
+def build(root):
+    src_dir = os.path.join(root, "data")
+    header_path = os.path.join(root, "src", HEADER_NAME)
+    os.makedirs(os.path.join(root, "data_fs"), exist_ok=True)
+
+    names = sorted(n for n in os.listdir(src_dir)
+                   if os.path.isfile(os.path.join(src_dir, n)) and os.path.splitext(n)[1] in MIME_TYPES)
+
+    contents = {}
+    for name in names:
+        with open(os.path.join(src_dir, name), "rb") as f:
+            contents[name] = f.read()
+
+    # Сначала ресурсы (их хеши нужны для ссылок), затем HTML с переписанными ссылками
+    versions = {n: content_hash(c) for n, c in contents.items() if not n.endswith(".html")}
+    for name in names:
+        if name.endswith(".html"):
+            contents[name] = rewrite_html(contents[name].decode("utf-8"), versions).encode("utf-8")
+
+    arrays = []
+    entries = []
+    total_src = total_gz = 0
+    for index, name in enumerate(names):
+        data = contents[name]
+        packed = gzip.compress(data, compresslevel=9, mtime=0)
+        symbol = "webAsset%d" % index
+        mime = MIME_TYPES[os.path.splitext(name)[1]]
+        arrays.append("// %s: %d -> %d bytes\n%s" % (name, len(data), len(packed), c_array(symbol, packed)))
+        entries.append('  { "/%s", "\\"%s\\"", "%s", %s, sizeof(%s) },'
+                       % (name, content_hash(data), mime, symbol, symbol))
+        total_src += len(data)
+        total_gz += len(packed)
+
+    header = "\n".join([
+        "// Сгенерировано scripts/build_web_assets.py из data/ - не редактировать",
+        "#ifndef WEB_ASSETS_DATA_H",
+        "#define WEB_ASSETS_DATA_H",
+        "",
+        "#include <Arduino.h>",
+        "",
+        "\n\n".join(arrays),
+        "",
+        "static const EmbeddedAsset embeddedAssets[] = {",
+        "\n".join(entries),
+        "};",
+        "",
+        "#endif",
+        "",
+    ])
+
+    old = None
+    if os.path.exists(header_path):
+        with open(header_path, "r", encoding="utf-8") as f:
+            old = f.read()
+    if old != header:
+        with open(header_path, "w", encoding="utf-8", newline="\n") as f:
+            f.write(header)
+
+    print("Web assets: %d files, %d -> %d bytes gzip (embedded)" % (len(names), total_src, total_gz))
+
+
+build(project_dir())
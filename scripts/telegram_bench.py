@@ -0,0 +1,230 @@
+"""
+Замер очереди Telegram под штормом оповещений на стенде (scripts/telegram_standin.py).
+
+Запускает стенд в этом же процессе, просит устройство поставить в очередь --count оповещений
+(POST /api/telegram/bench, есть только в прошивке env:esp32dev_standin) и ждет, пока все
+"bench-NNN" дойдут до стенда. Во время шторма раз в --sample-sec читает /metrics устройства.
+
+Результат:
+  - скорость разбора очереди: сообщений и оповещений в секунду между первой и последней доставкой;
+  - задержка оповещения от запроса шторма до приема стендом (p50/p95/max);
+  - память: наименьший свободный heap и наибольший блок за время шторма, глубина очереди,
+    вытесненные и не принятые сообщения, записи outbox;
+  - исходы запросов на стенде (принято, 429, 502, оборвано).
+
+Параметры отказов - те же, что у стенда:
+  python scripts/telegram_bench.py --device 192.168.1.50 --count 50 --critical --rate-limit 1 --drop-rate 0.05
+
+Проверка outbox при обрыве Wi-Fi: --offline-sec N - оповещения отправляются во время имитации
+обрыва длиной N секунд. Все они должны попасть в outbox (thermo_telegram_outbox_stored_total),
+ни одно не должно дойти до стенда до конца обрыва, после - все должны быть доставлены.
+При нарушении скрипт завершается с кодом 1:
+  python scripts/telegram_bench.py --device 192.168.1.50 --count 5 --critical --offline-sec 20
+"""
+import argparse
+import json
+import re
+import sys
+import threading
+import time
+import urllib.request
+
+import telegram_standin
+
+BENCH_NAME = re.compile(r"bench-(\d{3})")
+SAMPLED_METRICS = (
+    "thermo_heap_free_bytes",
+    "thermo_heap_min_free_bytes",
+    "thermo_heap_largest_free_block_bytes",
+    "thermo_telegram_queue_depth",
+    "thermo_telegram_queue_evicted_total",
+    "thermo_telegram_queue_rejected_total",
+    "thermo_telegram_outbox_pending",
+    "thermo_telegram_outbox_stored_total",
+)
+
+
+def read_metrics(device):
+    """Значения метрик без меток из /metrics устройства."""
+    with urllib.request.urlopen("http://%s/metrics" % device, timeout=5) as response:
+        text = response.read().decode("utf-8", "replace")
+    values = {}
+    for line in text.splitlines():
+        parts = line.split()
+        if len(parts) == 2 and parts[0] in SAMPLED_METRICS:
+            values[parts[0]] = float(parts[1])
+    return values
+
+
+class MetricsSampler(threading.Thread):
+    def __init__(self, device, interval):
+        super().__init__(daemon=True)
+        self.device = device
+        self.interval = interval
+        self.samples = []
+        self.errors = 0
+        self.stopped = threading.Event()
+
+    def run(self):
+        while not self.stopped.is_set():
+            try:
+                self.samples.append(read_metrics(self.device))
+            except OSError:
+                self.errors += 1   # Устройство занято отправкой - пропускаем отсчет
+            self.stopped.wait(self.interval)
+
+    def extreme(self, name, pick):
+        values = [s[name] for s in self.samples if name in s]
+        return pick(values) if values else None
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    if not ordered:
+        return None
+    return ordered[min(len(ordered) - 1, int(round(fraction * (len(ordered) - 1))))]
+
+
+def delivered_alerts(messages, started):
+    """bench-NNN -> время первого приема; сообщения - в порядке приема."""
+    delivered = {}
+    for message in messages:
+        for number in BENCH_NAME.findall(message["text"]):
+            delivered.setdefault(int(number), message["time"] - started)
+    return delivered
+
+
+def start_storm(device, count, critical, offline_sec=0):
+    url = "http://%s/api/telegram/bench?count=%d&critical=%d&offline_ms=%d" % (
+        device, count, 1 if critical else 0, int(offline_sec * 1000))
+    request = urllib.request.Request(url, data=b"", method="POST")
+    with urllib.request.urlopen(request, timeout=10) as response:
+        return json.loads(response.read().decode("utf-8"))["queued"]
+
+
+def run(options):
+    server, state = telegram_standin.make_server(options)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+
+    before = read_metrics(options.device)
+    sampler = MetricsSampler(options.device, options.sample_sec)
+    state.reset()
+    started = time.time()
+    queued = start_storm(options.device, options.count, options.critical, options.offline_sec)
+    sampler.start()
+
+    offline = None
+    if options.offline_sec > 0:
+        # Во время обрыва оповещения должны лежать в outbox, а не уходить на стенд
+        time.sleep(min(1.0, options.offline_sec / 2))
+        during = read_metrics(options.device)
+        stored = during.get("thermo_telegram_outbox_stored_total", 0) - before.get("thermo_telegram_outbox_stored_total", 0)
+        time.sleep(max(0.0, started + options.offline_sec - time.time()))
+        offline = {
+            "outbox_stored": stored,
+            "delivered_during_outage": len(delivered_alerts(state.snapshot()["messages"], started)),
+        }
+
+    deadline = started + options.timeout
+    while time.time() < deadline:
+        if len(delivered_alerts(state.snapshot()["messages"], started)) >= queued:
+            break
+        time.sleep(0.2)
+    time.sleep(options.sample_sec)   # Последний отсчет после доставки
+    sampler.stopped.set()
+    sampler.join()
+    server.shutdown()
+    server.server_close()
+
+    snapshot = state.snapshot()
+    bench_messages = [m for m in snapshot["messages"] if BENCH_NAME.search(m["text"])]
+    delivered = delivered_alerts(snapshot["messages"], started)
+    latencies = list(delivered.values())
+    drain_sec = (bench_messages[-1]["time"] - bench_messages[0]["time"]) if len(bench_messages) > 1 else None
+
+    def delta(name):
+        after = sampler.extreme(name, max)
+        return None if after is None or name not in before else after - before[name]
+
+    if offline is not None:
+        offline["passed"] = (offline["outbox_stored"] == queued and offline["delivered_during_outage"] == 0
+                             and len(delivered) == queued)
+
+    return {
+        "queued": queued,
+        "offline": offline,
+        "delivered": len(delivered),
+        "messages": len(bench_messages),
+        "messages_per_sec": len(bench_messages) / drain_sec if drain_sec else None,
+        "alerts_per_sec": len(delivered) / drain_sec if drain_sec else None,
+        "latency_sec": {
+            "p50": percentile(latencies, 0.5),
+            "p95": percentile(latencies, 0.95),
+            "max": max(latencies) if latencies else None,
+        },
+        "heap_free_before": before.get("thermo_heap_free_bytes"),
+        "heap_free_min": sampler.extreme("thermo_heap_free_bytes", min),
+        "heap_largest_block_min": sampler.extreme("thermo_heap_largest_free_block_bytes", min),
+        "queue_depth_max": sampler.extreme("thermo_telegram_queue_depth", max),
+        "queue_evicted": delta("thermo_telegram_queue_evicted_total"),
+        "queue_rejected": delta("thermo_telegram_queue_rejected_total"),
+        "outbox_stored": delta("thermo_telegram_outbox_stored_total"),
+        "outbox_pending_max": sampler.extreme("thermo_telegram_outbox_pending", max),
+        "metrics_samples": len(sampler.samples),
+        "metrics_errors": sampler.errors,
+        "standin": {"connections": snapshot["connections"], "outcomes": snapshot["outcomes"]},
+    }
+
+
+def print_report(result):
+    def value(number, fmt="%.2f"):
+        return "-" if number is None else fmt % number
+
+    latency = result["latency_sec"]
+    print("Delivered alerts:     %d/%d in %d messages" % (result["delivered"], result["queued"], result["messages"]))
+    print("Drain rate:           %s msg/s, %s alerts/s" % (value(result["messages_per_sec"]), value(result["alerts_per_sec"])))
+    print("Alert latency, s:     p50 %s  p95 %s  max %s" % (value(latency["p50"]), value(latency["p95"]), value(latency["max"])))
+    print("Heap free, bytes:     before %s  min %s  largest block min %s" % (
+        value(result["heap_free_before"], "%d"), value(result["heap_free_min"], "%d"),
+        value(result["heap_largest_block_min"], "%d")))
+    print("Queue:                max depth %s  evicted %s  rejected %s" % (
+        value(result["queue_depth_max"], "%d"), value(result["queue_evicted"], "%d"),
+        value(result["queue_rejected"], "%d")))
+    print("Outbox:               stored %s  max pending %s" % (
+        value(result["outbox_stored"], "%d"), value(result["outbox_pending_max"], "%d")))
+    print("Stand-in:             %d connections, %s" % (
+        result["standin"]["connections"], json.dumps(result["standin"]["outcomes"], sort_keys=True)))
+    print("Metrics samples:      %d (%d failed)" % (result["metrics_samples"], result["metrics_errors"]))
+    offline = result["offline"]
+    if offline is not None:
+        print("Offline check:        %s (outbox stored %d/%d, delivered during outage %d)" % (
+            "passed" if offline["passed"] else "FAILED", offline["outbox_stored"], result["queued"],
+            offline["delivered_during_outage"]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Замер очереди Telegram на стенде")
+    parser.add_argument("--device", required=True, help="Адрес устройства (IP или имя)")
+    parser.add_argument("--count", type=int, default=20, help="Оповещений в шторме (прошивка ограничивает 100)")
+    parser.add_argument("--critical", action="store_true", help="Мимо сводки: каждое оповещение отдельным сообщением")
+    parser.add_argument("--timeout", type=float, default=600.0, help="Ожидание доставки, с")
+    parser.add_argument("--sample-sec", type=float, default=1.0, help="Период чтения /metrics, с")
+    parser.add_argument("--offline-sec", type=float, default=0.0,
+                        help="Имитация обрыва Wi-Fi, с (прошивка ограничивает 120): проверка outbox")
+    parser.add_argument("--json", action="store_true", help="Результат одной строкой JSON")
+    telegram_standin.add_arguments(parser)
+    options = parser.parse_args()
+    if options.cert and not options.key:
+        parser.error("--cert требует --key")
+
+    result = run(options)
+    if options.json:
+        print(json.dumps(result, sort_keys=True))
+    else:
+        print_report(result)
+    if result["offline"] is not None and not result["offline"]["passed"]:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,318 @@
+"""
+Стенд API Telegram для проверки очереди отправки без api.telegram.org.
+
+Отвечает на запросы прошивки (sendMessage, getUpdates, остальные методы - "ok")
+по HTTPS на одном порту; прошивка собирается с env:esp32dev_standin (platformio.ini),
+где TELEGRAM_API_HOST/TELEGRAM_API_PORT указывают на этот компьютер.
+
+Отказы задаются параметрами запуска:
+  --latency-ms / --jitter-ms  задержка каждого ответа;
+  --rate-limit N              не больше N sendMessage в секунду, сверх - 429 с retry_after;
+  --error-rate P              доля ответов 502 (0..1);
+  --drop-rate P               доля запросов, после которых соединение закрывается без ответа.
+
+Служебные адреса (без TLS-клиента удобно через curl -k):
+  GET  /_standin/stats    принятые сообщения и счетчики исходов (JSON);
+  POST /_standin/reset    очистка статистики;
+  POST /_standin/updates  входящее сообщение для getUpdates, тело {"chat_id": ..., "text": ...}.
+
+Сертификат: --cert/--key; без них самоподписанный создается через openssl во временном
+каталоге (прошивка вызывает setInsecure и сертификат не проверяет).
+
+  python scripts/telegram_standin.py --port 8443 --latency-ms 300 --rate-limit 1 --drop-rate 0.05
+"""
+import argparse
+import json
+import os
+import random
+import socket
+import ssl
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlsplit
+
+LONG_POLL_MAX_SEC = 30   # Дольше не держим getUpdates, даже если прошивка просит
+CONTROL_PREFIX = "/_standin/"
+
+
+class StandinState:
+    """Статистика и входящие сообщения; общие для всех потоков сервера."""
+
+    def __init__(self, options):
+        self.options = options
+        self.lock = threading.Condition()
+        self.random = random.Random(options.seed)
+        self.reset()
+
+    def reset(self):
+        with self.lock:
+            self.started = time.time()
+            self.messages = []        # Принятые sendMessage: время, чат, текст
+            self.outcomes = {}        # Исход -> число запросов
+            self.connections = 0
+            self.updates = []         # Ожидают выдачи в getUpdates
+            self.next_update_id = 1
+            self.send_times = []      # Моменты принятых sendMessage за последнюю секунду
+
+    def count(self, outcome):
+        with self.lock:
+            self.outcomes[outcome] = self.outcomes.get(outcome, 0) + 1
+
+    def chance(self, probability):
+        with self.lock:
+            return self.random.random() < probability
+
+    def delay(self):
+        options = self.options
+        with self.lock:
+            jitter = self.random.uniform(-options.jitter_ms, options.jitter_ms)
+        seconds = max(0.0, options.latency_ms + jitter) / 1000.0
+        if seconds > 0:
+            time.sleep(seconds)
+
+    def rate_limited(self):
+        """Скользящее окно в 1 с; True - запрос сверх --rate-limit."""
+        if self.options.rate_limit <= 0:
+            return False
+        now = time.time()
+        with self.lock:
+            self.send_times = [t for t in self.send_times if now - t < 1.0]
+            if len(self.send_times) >= self.options.rate_limit:
+                return True
+            self.send_times.append(now)
+            return False
+
+    def accept_message(self, chat_id, text):
+        with self.lock:
+            self.messages.append({"time": time.time(), "chat_id": chat_id, "text": text})
+
+    def add_update(self, chat_id, text):
+        with self.lock:
+            self.updates.append({
+                "update_id": self.next_update_id,
+                "message": {
+                    "message_id": self.next_update_id,
+                    "date": int(time.time()),
+                    "chat": {"id": chat_id, "type": "private"},
+                    "from": {"id": chat_id, "first_name": "standin"},
+                    "text": text,
+                },
+            })
+            self.next_update_id += 1
+            self.lock.notify_all()
+
+    def take_updates(self, offset, timeout):
+        deadline = time.time() + timeout
+        with self.lock:
+            while True:
+                # offset подтверждает все предыдущие - как в настоящем API
+                self.updates = [u for u in self.updates if u["update_id"] >= offset]
+                if self.updates or time.time() >= deadline:
+                    return list(self.updates)
+                self.lock.wait(deadline - time.time())
+
+    def snapshot(self):
+        with self.lock:
+            return {
+                "uptime_sec": round(time.time() - self.started, 3),
+                "connections": self.connections,
+                "outcomes": dict(self.outcomes),
+                "messages": list(self.messages),
+            }
+
+
+class StandinHandler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"   # keep-alive: прошивка держит соединение открытым
+    server_version = "TelegramStandin/1.0"
+    state = None                    # Задается в make_server
+
+    def setup(self):
+        super().setup()
+        with self.state.lock:
+            self.state.connections += 1
+
+    def log_message(self, fmt, *args):
+        if self.state.options.verbose:
+            sys.stderr.write("[standin] %s - %s\n" % (self.address_string(), fmt % args))
+
+    def do_GET(self):
+        self.dispatch(b"")
+
+    def do_POST(self):
+        length = int(self.headers.get("Content-Length") or 0)
+        self.dispatch(self.rfile.read(length) if length > 0 else b"")
+
+    def dispatch(self, body):
+        url = urlsplit(self.path)
+        if url.path.startswith(CONTROL_PREFIX):
+            self.control(url.path[len(CONTROL_PREFIX):], body)
+            return
+
+        # /bot<token>/<method>
+        parts = url.path.strip("/").split("/")
+        if len(parts) != 2 or not parts[0].startswith("bot"):
+            self.reply(404, {"ok": False, "error_code": 404, "description": "Not Found"})
+            return
+        method = parts[1]
+        params = {k: v[-1] for k, v in parse_qs(url.query).items()}
+        if body:
+            try:
+                params.update(json.loads(body.decode("utf-8")))
+            except ValueError:
+                self.reply(400, {"ok": False, "error_code": 400, "description": "Bad Request: invalid JSON"})
+                return
+
+        if method == "getUpdates":
+            self.get_updates(params)
+            return
+
+        state = self.state
+        state.delay()
+        if state.chance(state.options.drop_rate):
+            state.count("dropped")
+            self.drop()
+            return
+        if state.chance(state.options.error_rate):
+            state.count("error")
+            self.reply(502, {"ok": False, "error_code": 502, "description": "Bad Gateway"})
+            return
+
+        if method == "sendMessage":
+            if state.rate_limited():
+                state.count("rate_limited")
+                retry_after = state.options.retry_after
+                self.reply(429, {
+                    "ok": False,
+                    "error_code": 429,
+                    "description": "Too Many Requests: retry after %d" % retry_after,
+                    "parameters": {"retry_after": retry_after},
+                })
+                return
+            text = str(params.get("text", ""))
+            state.accept_message(params.get("chat_id"), text)
+            state.count("sent")
+            self.reply(200, {"ok": True, "result": {
+                "message_id": len(state.messages),
+                "date": int(time.time()),
+                "chat": {"id": params.get("chat_id")},
+                "text": text,
+            }})
+            return
+
+        state.count("other")
+        self.reply(200, {"ok": True, "result": True})
+
+    def get_updates(self, params):
+        state = self.state
+        timeout = min(float(params.get("timeout", 0) or 0), LONG_POLL_MAX_SEC)
+        offset = int(params.get("offset", 0) or 0)
+        updates = state.take_updates(offset, timeout)
+        if state.chance(state.options.drop_rate):
+            state.count("poll_dropped")
+            self.drop()
+            return
+        state.count("poll")
+        self.reply(200, {"ok": True, "result": updates})
+
+    def control(self, command, body):
+        state = self.state
+        if command == "stats":
+            self.reply(200, state.snapshot())
+        elif command == "reset" and self.command == "POST":
+            state.reset()
+            self.reply(200, {"ok": True})
+        elif command == "updates" and self.command == "POST":
+            try:
+                update = json.loads(body.decode("utf-8"))
+            except ValueError:
+                self.reply(400, {"ok": False, "description": "invalid JSON"})
+                return
+            state.add_update(update.get("chat_id", 0), str(update.get("text", "")))
+            self.reply(200, {"ok": True})
+        else:
+            self.reply(404, {"ok": False, "description": "unknown control command"})
+
+    def reply(self, status, payload):
+        # Заголовки и тело одной записью: библиотека читает ответ, пока в сокете есть данные,
+        # и может остановиться на границе отдельных TLS-записей
+        body = json.dumps(payload, ensure_ascii=False).encode("utf-8")
+        head = ("HTTP/1.1 %d %s\r\n"
+                "Content-Type: application/json\r\n"
+                "Content-Length: %d\r\n"
+                "Connection: keep-alive\r\n\r\n") % (status, self.responses.get(status, ("",))[0], len(body))
+        self.wfile.write(head.encode("ascii") + body)
+        self.log_request(status, len(body))
+
+    def drop(self):
+        self.close_connection = True
+        try:
+            self.connection.shutdown(socket.SHUT_RDWR)
+        except OSError:
+            pass
+
+
+def self_signed_certificate():
+    directory = tempfile.mkdtemp(prefix="tg_standin_")
+    cert = os.path.join(directory, "cert.pem")
+    key = os.path.join(directory, "key.pem")
+    subprocess.run(
+        ["openssl", "req", "-x509", "-newkey", "rsa:2048", "-nodes", "-days", "30",
+         "-subj", "/CN=api.telegram.org", "-keyout", key, "-out", cert],
+        check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    return cert, key
+
+
+def make_server(options):
+    """Сервер и его состояние; serve_forever вызывает вызывающий (в т.ч. в отдельном потоке)."""
+    state = StandinState(options)
+    handler = type("BoundStandinHandler", (StandinHandler,), {"state": state})
+    server = ThreadingHTTPServer((options.host, options.port), handler)
+    server.daemon_threads = True
+    if not options.no_tls:
+        cert, key = (options.cert, options.key) if options.cert else self_signed_certificate()
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(cert, key)
+        # Рукопожатие - в потоке обработчика, а не в accept(): зависший клиент не блокирует остальных
+        server.socket = context.wrap_socket(server.socket, server_side=True, do_handshake_on_connect=False)
+    return server, state
+
+
+def add_arguments(parser):
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=8443)
+    parser.add_argument("--cert", help="PEM-сертификат (по умолчанию самоподписанный)")
+    parser.add_argument("--key", help="PEM-ключ к --cert")
+    parser.add_argument("--no-tls", action="store_true", help="HTTP без TLS (только для curl)")
+    parser.add_argument("--latency-ms", type=float, default=0.0)
+    parser.add_argument("--jitter-ms", type=float, default=0.0)
+    parser.add_argument("--rate-limit", type=float, default=0.0, help="sendMessage в секунду, 0 - без ограничения")
+    parser.add_argument("--retry-after", type=int, default=1, help="retry_after в ответе 429, с")
+    parser.add_argument("--error-rate", type=float, default=0.0)
+    parser.add_argument("--drop-rate", type=float, default=0.0)
+    parser.add_argument("--seed", type=int, help="Зерно случайных отказов (воспроизводимость)")
+    parser.add_argument("--verbose", action="store_true")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Стенд API Telegram")
+    add_arguments(parser)
+    options = parser.parse_args()
+    if options.cert and not options.key:
+        parser.error("--cert требует --key")
+
+    server, _ = make_server(options)
+    print("Telegram stand-in on %s://%s:%d" % ("http" if options.no_tls else "https", options.host, options.port))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        server.server_close()
+
+
+if __name__ == "__main__":
+    main()
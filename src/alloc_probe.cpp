@@ -0,0 +1,134 @@
+#include "alloc_probe.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static volatile uint32_t sendPathAllocations = 0;
+
+#ifdef HEAP_ALLOC_PROBE
+
+// Задачи внутри участка. probedTaskCount - быстрая проверка: вне участков malloc не ищет задачу
+static TaskHandle_t volatile probedTasks[ALLOC_PROBE_MAX_TASKS] = {};
+static volatile int probedTaskCount = 0;
+static portMUX_TYPE probeMux = portMUX_INITIALIZER_UNLOCKED;
+
+// malloc может вызываться при отключенном кеше flash - обертки в IRAM
+static inline void IRAM_ATTR countIfProbed() {
+  if (probedTaskCount == 0) {
+    return;
+  }
+  TaskHandle_t current = xTaskGetCurrentTaskHandle();
+  for (int i = 0; i < ALLOC_PROBE_MAX_TASKS; i++) {
+    if (probedTasks[i] == current) {
+      sendPathAllocations++;
+      return;
+    }
+  }
+}
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* IRAM_ATTR __wrap_malloc(size_t size) {
+  countIfProbed();
+  return __real_malloc(size);
+}
+
+void* IRAM_ATTR __wrap_calloc(size_t count, size_t size) {
+  countIfProbed();
+  return __real_calloc(count, size);
+}
+
+void* IRAM_ATTR __wrap_realloc(void* ptr, size_t size) {
+  countIfProbed();
+  return __real_realloc(ptr, size);
+}
+}
+
+bool allocProbeBegin() {
+  TaskHandle_t current = xTaskGetCurrentTaskHandle();
+  int freeSlot = -1;
+  bool begun = false;
+  portENTER_CRITICAL(&probeMux);
+  for (int i = 0; i < ALLOC_PROBE_MAX_TASKS; i++) {
+    if (probedTasks[i] == current) {
+      freeSlot = -2; // Уже внутри участка
+      break;
+    }
+    if (probedTasks[i] == NULL && freeSlot == -1) {
+      freeSlot = i;
+    }
+  }
+  if (freeSlot >= 0) {
+    probedTasks[freeSlot] = current;
+    probedTaskCount++;
+    begun = true;
+  }
+  portEXIT_CRITICAL(&probeMux);
+  return begun;
+}
+
+static bool removeCurrentTask() {
+  TaskHandle_t current = xTaskGetCurrentTaskHandle();
+  bool removed = false;
+  portENTER_CRITICAL(&probeMux);
+  for (int i = 0; i < ALLOC_PROBE_MAX_TASKS; i++) {
+    if (probedTasks[i] == current) {
+      probedTasks[i] = NULL;
+      probedTaskCount--;
+      removed = true;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&probeMux);
+  return removed;
+}
+
+void allocProbeEnd(bool begun) {
+  if (begun) {
+    removeCurrentTask();
+  }
+}
+
+bool allocProbePause() {
+  return removeCurrentTask();
+}
+
+void allocProbeResume(bool paused) {
+  if (paused) {
+    allocProbeBegin();
+  }
+}
+
+bool isAllocProbeEnabled() {
+  return true;
+}
+
+#else
+
+bool allocProbeBegin() {
+  return false;
+}
+
+void allocProbeEnd(bool begun) {
+  (void)begun;
+}
+
+bool allocProbePause() {
+  return false;
+}
+
+void allocProbeResume(bool paused) {
+  (void)paused;
+}
+
+bool isAllocProbeEnabled() {
+  return false;
+}
+
+#endif
+
+uint32_t getSendPathAllocations() {
+  return sendPathAllocations;
+}
@@ -0,0 +1,23 @@
+#ifndef ALLOC_PROBE_H
+#define ALLOC_PROBE_H
+
+#include <Arduino.h>
+
+// Учет выделений heap на пути отправки: форматирование сообщений Telegram/MQTT и постановка
+// в очередь (до вызова библиотеки транспорта). Выделения задачи внутри участка считаются.
+// Работает при сборке с -DHEAP_ALLOC_PROBE и -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+// (platformio.ini); без флагов функции пустые, счетчик всегда 0
+#define ALLOC_PROBE_MAX_TASKS 4  // Задач, одновременно находящихся внутри участка
+
+// Начало участка для текущей задачи. false - участок уже открыт (вложенный вызов)
+bool allocProbeBegin();
+// Конец участка, если его открыл этот вызов (результат allocProbeBegin)
+void allocProbeEnd(bool begun);
+// Временный выход из участка (работа с файлами). Возвращает, была ли задача внутри участка
+bool allocProbePause();
+void allocProbeResume(bool paused);
+
+bool isAllocProbeEnabled();
+uint32_t getSendPathAllocations(); // Выделений внутри участков с момента загрузки
+
+#endif
@@ -1,6 +1,9 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+// --- Firmware ---
+#define FIRMWARE_VERSION  "1.1.0-dev"
+
 // --- GPIO Pin Definitions for ESP32 DevKit v1 ---
 #define TEMP_SENSOR_PIN   4       // DS18B20 Data Pin
 #define OLED_SDA_PIN      21      // OLED SDA Pin (стандартный I2C для ESP32)
@@ -27,6 +30,9 @@
 #define MQTT_TOPIC_CONFIG    "home/thermo/config"
 #define MQTT_TOPIC_ALARMS    "home/thermo/alarms"
 
+// --- Telegram alerts ---
+#define TELEGRAM_ALERT_WINDOW_MS 3000    // Оповещения за это время уходят одной сводкой (0 - без объединения)
+
 // --- Temperature Alarm Thresholds ---
 #define HIGH_TEMP_THRESHOLD   30.0
 #define LOW_TEMP_THRESHOLD    10.0
@@ -0,0 +1,530 @@
+#include "data_snapshot.h"
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <WiFi.h>
+#include <stdarg.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_system.h"
+#include "web_server.h"
+#include "sensors.h"
+#include "sensor_config.h"
+#include "settings_store.h"
+#include "operation_modes.h"
+#include "time_manager.h"
+#include "mqtt_client.h"
+#include "tg_bot.h"
+#include "request_governor.h"
+#include "net_health.h"
+
+extern float currentTemp;
+extern unsigned long deviceUptime;
+extern String deviceIP;
+extern int wifiRSSI;
+extern int displayScreen;
+extern unsigned long wifiConnectedSeconds;
+
+// Участок тела снимка и поколение, в котором он последний раз изменился
+struct SnapshotFragment {
+  uint16_t offset;
+  uint16_t length;
+  uint32_t changed;
+};
+
+// Буфер снимка. Тело: "generation":N,"key":value,...,"sensors":[{...},...],"telegram":{...
+// (без открывающей "{" и закрывающих "}}"). refs - число ответов, которые еще читают буфер
+struct DataSnapshotSlot {
+  char body[DATA_SNAPSHOT_MAX_SIZE];
+  size_t length;
+  uint8_t refs;
+  uint32_t generation;
+  uint32_t topologyGeneration;  // Поколение последнего изменения состава термометров
+  SnapshotFragment generationField;
+  uint8_t memberCount;
+  SnapshotFragment members[DATA_SNAPSHOT_MAX_MEMBERS];  // ,"key":value
+  uint8_t sensorCount;
+  SnapshotFragment sensors[MAX_SENSORS];                // {...}
+  char addresses[MAX_SENSORS][24];
+  SnapshotFragment telegram;                            // ,"telegram":{... (без "}")
+};
+
+// Входные данные снимка. Снимок пересобирается только при их изменении
+struct DataSnapshotInputs {
+  uint32_t settingsGeneration;
+  uint32_t readingsGeneration;
+  uint8_t wifiConnected;
+  uint8_t mqttConfigured;
+  uint8_t telegramConfigured;
+  uint8_t operationMode;
+  int rssi;
+  const char* mqttStatus;
+  const char* telegramStatus;
+  BreakerStatus mqttBreaker;
+  BreakerStatus telegramBreaker;
+  BreakerStatus dnsBreaker;
+  char ip[16];
+};
+
+static DataSnapshotSlot snapshotSlots[DATA_SNAPSHOT_SLOTS];
+// Тело общее для всех ответов (снимок), у каждого ответа - только голова и список участков
+static GovernedEndpoint dataEndpoint = GOVERNED_ENDPOINT("data", DATA_SNAPSHOT_MAX_IN_FLIGHT, 0);
+static int currentSlot = -1;
+static SemaphoreHandle_t snapshotMutex = NULL;
+static DataSnapshotInputs lastInputs;
+static unsigned long lastCheckMs = 0;
+// Начальное поколение случайное: since из прошлой загрузки почти наверняка не попадет в диапазон
+static uint32_t dataGeneration = 0;
+
+static const char SENSORS_OPEN[] = ",\"sensors\":[";
+static const char SENSORS_SEPARATOR[] = ",";
+static const char SENSORS_CLOSE[] = "]";
+
+static int acquireCurrentSlot() {
+  int slot = -1;
+  if (xSemaphoreTake(snapshotMutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+    slot = currentSlot;
+    if (slot >= 0) {
+      snapshotSlots[slot].refs++;
+    }
+    xSemaphoreGive(snapshotMutex);
+  }
+  return slot;
+}
+
+static void releaseSlot(int slot) {
+  xSemaphoreTake(snapshotMutex, portMAX_DELAY);
+  snapshotSlots[slot].refs--;
+  xSemaphoreGive(snapshotMutex);
+}
+
+// Ответ: изменчивая голова + участки тела снимка (без копирования) + хвост.
+// Буфер снимка удерживается до удаления ответа
+class DataSnapshotResponse : public AsyncAbstractResponse {
+ public:
+  DataSnapshotResponse(int slot, const char* head, size_t headLength, const char* tail, size_t tailLength)
+      : _slot(slot), _tailLength(tailLength), _partCount(0), _part(0), _partOffset(0) {
+    memcpy(_head, head, headLength);
+    memcpy(_tail, tail, tailLength);
+    addPart(_head, headLength);
+    _code = 200;
+    _contentType = "application/json";
+  }
+
+  ~DataSnapshotResponse() {
+    releaseSlot(_slot);
+    releaseResponse(dataEndpoint);
+  }
+
+  void addPart(const char* data, size_t length) {
+    if (_partCount < DATA_SNAPSHOT_MAX_PARTS - 1 && length > 0) {
+      _parts[_partCount].data = data;
+      _parts[_partCount].length = length;
+      _partCount++;
+    }
+  }
+
+  // Хвост - всегда последний участок
+  void finish() {
+    _parts[_partCount].data = _tail;
+    _parts[_partCount].length = _tailLength;
+    _partCount++;
+    _contentLength = 0;
+    for (uint8_t i = 0; i < _partCount; i++) {
+      _contentLength += _parts[i].length;
+    }
+  }
+
+  bool _sourceValid() const override {
+    return true;
+  }
+
+  size_t _fillBuffer(uint8_t* buf, size_t maxLen) override {
+    size_t written = 0;
+    while (written < maxLen && _part < _partCount) {
+      const ResponsePart& part = _parts[_part];
+      size_t count = part.length - _partOffset;
+      if (count > maxLen - written) {
+        count = maxLen - written;
+      }
+      memcpy(buf + written, part.data + _partOffset, count);
+      written += count;
+      _partOffset += count;
+      if (_partOffset >= part.length) {
+        _part++;
+        _partOffset = 0;
+      }
+    }
+    return written;
+  }
+
+ private:
+  struct ResponsePart {
+    const char* data;
+    size_t length;
+  };
+
+  int _slot;
+  char _head[DATA_SNAPSHOT_HEAD_SIZE];
+  char _tail[48];
+  size_t _tailLength;
+  ResponsePart _parts[DATA_SNAPSHOT_MAX_PARTS];
+  uint8_t _partCount;
+  uint8_t _part;
+  size_t _partOffset;
+};
+
+void initDataSnapshot() {
+  if (snapshotMutex == NULL) {
+    snapshotMutex = xSemaphoreCreateMutex();
+  }
+  memset(&lastInputs, 0, sizeof(lastInputs));
+  dataGeneration = (esp_random() & 0x3FFFFFFFUL) + 1;
+  // Первый снимок - сразу, чтобы /api/data отвечал до первого прохода loop()
+  lastCheckMs = millis() - DATA_SNAPSHOT_CHECK_INTERVAL;
+  updateDataSnapshot();
+}
+
+static void captureInputs(DataSnapshotInputs& inputs) {
+  memset(&inputs, 0, sizeof(inputs));
+  inputs.settingsGeneration = getSettingsGeneration();
+  inputs.readingsGeneration = getSensorReadingsGeneration();
+  inputs.wifiConnected = (WiFi.status() == WL_CONNECTED);
+  inputs.mqttConfigured = isMqttConfigured();
+  inputs.telegramConfigured = isTelegramConfigured();
+  inputs.operationMode = (uint8_t)getOperationMode();
+  inputs.rssi = wifiRSSI;
+  inputs.mqttStatus = getMqttStatus();
+  inputs.telegramStatus = getTelegramStatus();
+  getBreakerStatus(getMqttBreaker(), inputs.mqttBreaker);
+  getBreakerStatus(getTelegramBreaker(), inputs.telegramBreaker);
+  getBreakerStatus(getDnsBreaker(), inputs.dnsBreaker);
+
+  // Приоритет у localIP, в режиме AP - softAPIP
+  String currentIP = deviceIP;
+  if (inputs.wifiConnected) {
+    IPAddress localIP = WiFi.localIP();
+    if ((uint32_t)localIP != 0) {
+      currentIP = localIP.toString();
+    }
+  } else if (WiFi.getMode() == WIFI_AP || WiFi.getMode() == WIFI_AP_STA) {
+    IPAddress apIP = WiFi.softAPIP();
+    if ((uint32_t)apIP != 0) {
+      currentIP = apIP.toString();
+    }
+  }
+  strlcpy(inputs.ip, currentIP.c_str(), sizeof(inputs.ip));
+}
+
+// Последовательная запись тела снимка в буфер слота
+struct SnapshotWriter {
+  DataSnapshotSlot& slot;
+  size_t position;
+  bool ok;
+
+  void appendf(const char* format, ...) {
+    if (!ok) return;
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(slot.body + position, sizeof(slot.body) - position, format, args);
+    va_end(args);
+    if (written < 0 || position + written >= sizeof(slot.body)) {
+      ok = false;
+      return;
+    }
+    position += written;
+  }
+
+  void appendJson(JsonVariantConst value) {
+    if (!ok) return;
+    size_t need = measureJson(value);
+    if (position + need >= sizeof(slot.body)) {
+      ok = false;
+      return;
+    }
+    serializeJson(value, slot.body + position, sizeof(slot.body) - position);
+    position += need;
+  }
+
+  void begin(SnapshotFragment& fragment) {
+    fragment.offset = position;
+  }
+
+  void end(SnapshotFragment& fragment) {
+    fragment.length = position - fragment.offset;
+  }
+};
+
+// Участок изменился, если его байты отличаются от того же участка предыдущего снимка
+static uint32_t fragmentChanged(const DataSnapshotSlot& slot, const SnapshotFragment& fragment,
+                                const DataSnapshotSlot* previous, const SnapshotFragment* previousFragment) {
+  if (previous == nullptr || previousFragment == nullptr ||
+      previousFragment->length != fragment.length ||
+      memcmp(previous->body + previousFragment->offset, slot.body + fragment.offset, fragment.length) != 0) {
+    return slot.generation;
+  }
+  return previousFragment->changed;
+}
+
+// Состояние автомата переподключения; оставшаяся пауза не выводится - она меняется каждую секунду
+static void fillBreakerJson(JsonObject obj, const BreakerStatus& status) {
+  obj["state"] = getBreakerStateName(status.state);
+  obj["failures"] = status.consecutiveFailures;
+  obj["backoff_ms"] = status.backoffMs;
+  obj["trips"] = status.trips;
+}
+
+// Сериализация редко меняющейся части. Объект telegram - последний: хвост ответа
+// дописывает в него изменчивое last_poll_age
+static bool renderSnapshot(const DataSnapshotInputs& inputs, DataSnapshotSlot& slot,
+                           const DataSnapshotSlot* previous, uint32_t generation) {
+  DynamicJsonDocument doc(8192);
+
+  doc["temperature"] = currentTemp;
+  doc["ip"] = inputs.ip;
+  doc["wifi_status"] = inputs.wifiConnected ? "connected" : "disconnected";
+  doc["wifi_rssi"] = inputs.rssi;
+
+  doc["mqtt"]["configured"] = (bool)inputs.mqttConfigured;
+  doc["mqtt"]["status"] = inputs.mqttStatus;
+  fillBreakerJson(doc["mqtt"].createNestedObject("circuit"), inputs.mqttBreaker);
+  fillBreakerJson(doc.createNestedObject("dns"), inputs.dnsBreaker);
+
+  const char* modeNames[] = {"local", "monitoring", "alert", "stabilization"};
+  doc["operation_mode"] = inputs.operationMode;
+  doc["operation_mode_name"] = modeNames[inputs.operationMode & 0x03];
+
+  // Состав шины - из кеша sensors.cpp; пересканирование выполняет main loop
+  int foundCount = getSensorCount();
+  if (foundCount > MAX_SENSORS) {
+    foundCount = MAX_SENSORS;
+  }
+  JsonArray sensorsArray = doc.createNestedArray("sensors");
+  for (int i = 0; i < foundCount; i++) {
+    fillSensorJson(sensorsArray.createNestedObject(), i);
+  }
+
+  doc["telegram"]["configured"] = (bool)inputs.telegramConfigured;
+  doc["telegram"]["status"] = inputs.telegramStatus;
+  fillBreakerJson(doc["telegram"].createNestedObject("circuit"), inputs.telegramBreaker);
+
+  if (doc.overflowed()) {
+    Serial.println(F("ERROR: /api/data snapshot document overflow"));
+    return false;
+  }
+
+  slot.generation = generation;
+  slot.memberCount = 0;
+  slot.sensorCount = 0;
+  SnapshotWriter writer = {slot, 0, true};
+
+  writer.begin(slot.generationField);
+  writer.appendf("\"generation\":%lu", (unsigned long)generation);
+  writer.end(slot.generationField);
+
+  for (JsonPairConst member : doc.as<JsonObjectConst>()) {
+    const char* key = member.key().c_str();
+    if (strcmp(key, "sensors") == 0) {
+      writer.appendf("%s", SENSORS_OPEN);
+      for (JsonVariantConst sensor : member.value().as<JsonArrayConst>()) {
+        if (slot.sensorCount > 0) {
+          writer.appendf("%s", SENSORS_SEPARATOR);
+        }
+        SnapshotFragment& fragment = slot.sensors[slot.sensorCount];
+        writer.begin(fragment);
+        writer.appendJson(sensor);
+        writer.end(fragment);
+        strlcpy(slot.addresses[slot.sensorCount], sensor["address"] | "", sizeof(slot.addresses[0]));
+        slot.sensorCount++;
+      }
+      writer.appendf("%s", SENSORS_CLOSE);
+    } else if (strcmp(key, "telegram") == 0) {
+      writer.begin(slot.telegram);
+      writer.appendf(",\"telegram\":");
+      writer.appendJson(member.value());
+      if (writer.ok) {
+        writer.position--; // Закрывающая "}" - в хвосте ответа
+      }
+      writer.end(slot.telegram);
+    } else if (slot.memberCount < DATA_SNAPSHOT_MAX_MEMBERS) {
+      SnapshotFragment& fragment = slot.members[slot.memberCount++];
+      writer.begin(fragment);
+      writer.appendf(",\"%s\":", key);
+      writer.appendJson(member.value());
+      writer.end(fragment);
+    }
+  }
+
+  if (!writer.ok) {
+    Serial.println(F("ERROR: /api/data snapshot too large"));
+    return false;
+  }
+  slot.length = writer.position;
+
+  // Поколения изменений: сравнение с предыдущим снимком по участкам
+  bool sameTopology = previous != nullptr && previous->sensorCount == slot.sensorCount &&
+                      previous->memberCount == slot.memberCount;
+  for (uint8_t i = 0; sameTopology && i < slot.sensorCount; i++) {
+    sameTopology = strcmp(previous->addresses[i], slot.addresses[i]) == 0;
+  }
+  slot.topologyGeneration = sameTopology ? previous->topologyGeneration : generation;
+
+  slot.generationField.changed = generation;
+  for (uint8_t i = 0; i < slot.memberCount; i++) {
+    slot.members[i].changed = fragmentChanged(slot, slot.members[i], sameTopology ? previous : nullptr,
+                                              sameTopology ? &previous->members[i] : nullptr);
+  }
+  for (uint8_t i = 0; i < slot.sensorCount; i++) {
+    slot.sensors[i].changed = fragmentChanged(slot, slot.sensors[i], sameTopology ? previous : nullptr,
+                                              sameTopology ? &previous->sensors[i] : nullptr);
+  }
+  slot.telegram.changed = fragmentChanged(slot, slot.telegram, previous, previous ? &previous->telegram : nullptr);
+  return true;
+}
+
+void updateDataSnapshot() {
+  unsigned long now = millis();
+  if (now - lastCheckMs < DATA_SNAPSHOT_CHECK_INTERVAL) {
+    return;
+  }
+  lastCheckMs = now;
+
+  DataSnapshotInputs inputs;
+  captureInputs(inputs);
+  if (currentSlot >= 0 && memcmp(&inputs, &lastInputs, sizeof(inputs)) == 0) {
+    return;
+  }
+
+  // Свободный буфер: не текущий и не читается отправляемыми ответами.
+  // Новые ответы берут только текущий буфер, поэтому свободный никто не займет
+  int freeSlot = -1;
+  xSemaphoreTake(snapshotMutex, portMAX_DELAY);
+  for (int i = 0; i < DATA_SNAPSHOT_SLOTS; i++) {
+    if (i != currentSlot && snapshotSlots[i].refs == 0) {
+      freeSlot = i;
+      break;
+    }
+  }
+  xSemaphoreGive(snapshotMutex);
+  if (freeSlot < 0) {
+    return; // Все буферы заняты медленными клиентами - повторим на следующей проверке
+  }
+
+  // Текущий снимок меняет только loop(), поэтому его можно читать без блокировки
+  const DataSnapshotSlot* previous = (currentSlot >= 0) ? &snapshotSlots[currentSlot] : nullptr;
+  if (!renderSnapshot(inputs, snapshotSlots[freeSlot], previous, dataGeneration + 1)) {
+    memcpy(&lastInputs, &inputs, sizeof(inputs)); // Повтор - при следующем изменении входных данных
+    return;
+  }
+  dataGeneration++;
+
+  xSemaphoreTake(snapshotMutex, portMAX_DELAY);
+  currentSlot = freeSlot;
+  xSemaphoreGive(snapshotMutex);
+  memcpy(&lastInputs, &inputs, sizeof(inputs));
+}
+
+static void formatDuration(char* out, size_t size, unsigned long totalSeconds) {
+  snprintf(out, size, "%luh %lum %lus", totalSeconds / 3600, (totalSeconds % 3600) / 60, totalSeconds % 60);
+}
+
+// Дельта: участки, изменившиеся после поколения since. Массив sensors и объект telegram есть всегда
+static void addDeltaParts(DataSnapshotResponse* response, const DataSnapshotSlot& slot, uint32_t since) {
+  response->addPart(slot.body + slot.generationField.offset, slot.generationField.length);
+  for (uint8_t i = 0; i < slot.memberCount; i++) {
+    if (slot.members[i].changed > since) {
+      response->addPart(slot.body + slot.members[i].offset, slot.members[i].length);
+    }
+  }
+  response->addPart(SENSORS_OPEN, sizeof(SENSORS_OPEN) - 1);
+  bool first = true;
+  for (uint8_t i = 0; i < slot.sensorCount; i++) {
+    if (slot.sensors[i].changed > since) {
+      if (!first) {
+        response->addPart(SENSORS_SEPARATOR, sizeof(SENSORS_SEPARATOR) - 1);
+      }
+      response->addPart(slot.body + slot.sensors[i].offset, slot.sensors[i].length);
+      first = false;
+    }
+  }
+  response->addPart(SENSORS_CLOSE, sizeof(SENSORS_CLOSE) - 1);
+  response->addPart(slot.body + slot.telegram.offset, slot.telegram.length);
+}
+
+void sendDataSnapshot(AsyncWebServerRequest *request) {
+  if (!admitResponse(request, dataEndpoint, sizeof(DataSnapshotResponse))) {
+    return;
+  }
+  int slot = acquireCurrentSlot();
+  if (slot < 0) {
+    releaseResponse(dataEndpoint);
+    AsyncWebServerResponse *response = request->beginResponse(503, "application/json",
+                                                              "{\"error\":\"Data not ready\"}");
+    response->addHeader("Retry-After", "1");
+    request->send(response);
+    return;
+  }
+  const DataSnapshotSlot& snapshot = snapshotSlots[slot];
+
+  // ?since=<generation>: дельта возможна, если since из текущей загрузки и состав термометров не менялся
+  bool delta = false;
+  unsigned long since = 0;
+  if (request->hasParam("since")) {
+    since = strtoul(request->getParam("since")->value().c_str(), nullptr, 10);
+    delta = since >= snapshot.topologyGeneration && since <= snapshot.generation;
+  }
+
+  // Изменчивые поля - в голове ответа
+  char uptimeStr[32];
+  formatDuration(uptimeStr, sizeof(uptimeStr), deviceUptime);
+  char wifiUptimeStr[32];
+  if (WiFi.status() == WL_CONNECTED && wifiConnectedSeconds > 0) {
+    formatDuration(wifiUptimeStr, sizeof(wifiUptimeStr), wifiConnectedSeconds);
+  } else {
+    strlcpy(wifiUptimeStr, "--", sizeof(wifiUptimeStr));
+  }
+  unsigned long unixTime = getUnixTime();
+
+  char head[DATA_SNAPSHOT_HEAD_SIZE];
+  int headLength = snprintf(head, sizeof(head),
+    "{\"uptime\":%lu,\"uptime_formatted\":\"%s\",\"wifi_connected_seconds\":%lu,"
+    "\"wifi_connected_formatted\":\"%s\",\"display_screen\":%d,\"current_time\":\"%s\","
+    "\"current_date\":\"%s\",\"unix_time\":%lu,\"time_synced\":%s,",
+    deviceUptime, uptimeStr, wifiConnectedSeconds, wifiUptimeStr, displayScreen,
+    getCurrentTime().c_str(), getCurrentDate().c_str(), unixTime, unixTime > 0 ? "true" : "false");
+
+  if (delta && headLength > 0 && headLength < (int)sizeof(head)) {
+    headLength += snprintf(head + headLength, sizeof(head) - headLength, "\"delta\":true,\"since\":%lu,", since);
+  }
+
+  // Состояние стабилизации меняется каждую секунду - тоже в голове
+  if (getOperationMode() == MODE_STABILIZATION && headLength > 0 && headLength < (int)sizeof(head)) {
+    StabilizationModeSettings stab = getStabilizationSettings();
+    headLength += snprintf(head + headLength, sizeof(head) - headLength,
+      "\"stabilization\":{\"is_stabilized\":%s,\"time\":%lu,\"tolerance\":%g,\"alert_threshold\":%g,\"duration\":%lu},",
+      isStabilized() ? "true" : "false", getStabilizationTime(), stab.tolerance, stab.alertThreshold, stab.duration);
+  }
+  if (headLength <= 0 || headLength >= (int)sizeof(head)) {
+    releaseSlot(slot);
+    releaseResponse(dataEndpoint);
+    request->send(500, "application/json", "{\"error\":\"Response too large\"}");
+    return;
+  }
+
+  char tail[48];
+  int tailLength;
+  unsigned long lastPollMs = getTelegramLastPollMs();
+  if (lastPollMs > 0) {
+    tailLength = snprintf(tail, sizeof(tail), ",\"last_poll_age\":%lu}}", (millis() - lastPollMs) / 1000);
+  } else {
+    tailLength = snprintf(tail, sizeof(tail), "}}");
+  }
+
+  DataSnapshotResponse* response = new DataSnapshotResponse(slot, head, headLength, tail, tailLength);
+  if (delta) {
+    addDeltaParts(response, snapshot, since);
+  } else {
+    response->addPart(snapshot.body, snapshot.length);
+  }
+  response->finish();
+  request->send(response);
+}
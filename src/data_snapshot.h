@@ -0,0 +1,24 @@
+#ifndef DATA_SNAPSHOT_H
+#define DATA_SNAPSHOT_H
+
+#include <ESPAsyncWebServer.h>
+
+// Предварительно сериализованный ответ /api/data.
+// Редко меняющаяся часть (термометры, статусы, режим) пересобирается в loop() только при смене
+// поколений входных данных; изменчивые поля (uptime, время) подставляются при отправке.
+// Для каждого поля и термометра хранится поколение изменения - по нему отдается ?since=<generation>
+#define DATA_SNAPSHOT_MAX_SIZE 5120
+#define DATA_SNAPSHOT_SLOTS 2            // Двойная буферизация: отправка не мешает пересборке
+#define DATA_SNAPSHOT_CHECK_INTERVAL 1000
+#define DATA_SNAPSHOT_HEAD_SIZE 512
+#define DATA_SNAPSHOT_MAX_MEMBERS 12     // Поля верхнего уровня, кроме sensors и telegram
+#define DATA_SNAPSHOT_MAX_PARTS 40       // Участков в одном ответе (голова, поля, термометры, хвост)
+#define DATA_SNAPSHOT_MAX_IN_FLIGHT 6    // Ответов /api/data одновременно в передаче, сверх - 503
+
+void initDataSnapshot();
+// Вызывать из loop(): пересобирает снимок, если изменились входные данные
+void updateDataSnapshot();
+// Ответ на GET /api/data (и /api/data?since=<generation>) из готового снимка
+void sendDataSnapshot(AsyncWebServerRequest *request);
+
+#endif
@@ -0,0 +1,364 @@
+#include "diagnostics.h"
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <ArduinoJson.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+#include "config.h"
+#include "http_stats.h"
+
+extern unsigned long deviceUptime;
+
+// Загрузка CPU по задачам доступна, только если SDK собран со статистикой времени выполнения
+#if configUSE_TRACE_FACILITY == 1 && configGENERATE_RUN_TIME_STATS == 1
+#define DIAG_TASK_CPU 1
+#ifdef configRUN_TIME_COUNTER_TYPE
+typedef configRUN_TIME_COUNTER_TYPE DiagRunTime;
+#else
+typedef uint32_t DiagRunTime;
+#endif
+#else
+#define DIAG_TASK_CPU 0
+#endif
+
+// Загрузка в десятых долях процента; -1 - нет данных
+#define DIAG_PERCENT_NONE -1
+
+// ========== Итерации loop() ==========
+
+struct SlowLoopEvent {
+  uint32_t atMs;          // millis() в конце итерации
+  uint32_t durationUs;
+  const char* phase;      // Самый долгий участок итерации
+  uint32_t phaseUs;
+  uint32_t freeHeap;
+};
+
+// Пишет loopTask, читает обработчик /api/debug (async_tcp)
+static portMUX_TYPE loopStatsMux = portMUX_INITIALIZER_UNLOCKED;
+static uint64_t loopTotalUs = 0;
+static uint32_t loopCount = 0;
+static uint32_t loopMaxCurrentUs = 0;
+static uint32_t loopMaxPreviousUs = 0;
+static unsigned long loopWindowStartMs = 0;
+static uint32_t slowLoopCount = 0;
+static SlowLoopEvent slowLoops[DIAG_SLOW_LOOP_EVENTS];
+static uint8_t slowLoopNext = 0;
+
+// Участки текущей итерации - только в loopTask, без блокировки
+static uint32_t iterationStartUs = 0;
+static uint32_t phaseStartUs = 0;
+static const char* longestPhase = nullptr;
+static uint32_t longestPhaseUs = 0;
+
+void beginLoopIteration() {
+  iterationStartUs = micros();
+  phaseStartUs = iterationStartUs;
+  longestPhase = nullptr;
+  longestPhaseUs = 0;
+}
+
+void markLoopPhase(const char* name) {
+  uint32_t now = micros();
+  uint32_t elapsed = now - phaseStartUs;
+  if (elapsed > longestPhaseUs) {
+    longestPhaseUs = elapsed;
+    longestPhase = name;
+  }
+  phaseStartUs = now;
+}
+
+void endLoopIteration() {
+  uint32_t durationUs = micros() - iterationStartUs;
+  unsigned long now = millis();
+  bool slow = durationUs >= DIAG_SLOW_LOOP_THRESHOLD_US;
+  uint32_t freeHeap = slow ? ESP.getFreeHeap() : 0;
+
+  portENTER_CRITICAL(&loopStatsMux);
+  loopTotalUs += durationUs;
+  loopCount++;
+  // Максимум по двум окнам, чтобы после смены окна не терять пик, случившийся перед ней
+  if (now - loopWindowStartMs >= DIAG_LOOP_MAX_WINDOW) {
+    loopMaxPreviousUs = loopMaxCurrentUs;
+    loopMaxCurrentUs = 0;
+    loopWindowStartMs = now;
+  }
+  if (durationUs > loopMaxCurrentUs) {
+    loopMaxCurrentUs = durationUs;
+  }
+  if (slow) {
+    slowLoops[slowLoopNext] = {(uint32_t)now, durationUs, longestPhase, longestPhaseUs, freeHeap};
+    slowLoopNext = (slowLoopNext + 1) % DIAG_SLOW_LOOP_EVENTS;
+    slowLoopCount++;
+  }
+  portEXIT_CRITICAL(&loopStatsMux);
+}
+
+void getLoopStats(LoopStats& stats) {
+  portENTER_CRITICAL(&loopStatsMux);
+  stats.totalUs = loopTotalUs;
+  stats.count = loopCount;
+  stats.recentMaxUs = max(loopMaxCurrentUs, loopMaxPreviousUs);
+  stats.slowCount = slowLoopCount;
+  portEXIT_CRITICAL(&loopStatsMux);
+}
+
+// ========== Задачи ==========
+
+// Хэндлы ищутся по имени при первом обращении: loopTask и async_tcp создает не наш код
+static const char* const monitoredTaskNames[] = {"loopTask", "async_tcp", "TelegramTask", "TelegramSend", "MQTTTask"};
+#define MONITORED_TASK_COUNT ((int)(sizeof(monitoredTaskNames) / sizeof(monitoredTaskNames[0])))
+static TaskHandle_t monitoredTaskHandles[MONITORED_TASK_COUNT] = {NULL};
+
+static int16_t taskCpuPercent10[MONITORED_TASK_COUNT];
+static int16_t coreLoadPercent10[portNUM_PROCESSORS];
+static int16_t loopBusyPercent10 = DIAG_PERCENT_NONE;
+static bool diagnosticsReady = false;
+static unsigned long lastSampleMs = 0;
+static uint32_t lastSampleUs = 0;
+static uint64_t lastSampleLoopTotalUs = 0;
+
+#if DIAG_TASK_CPU
+static TaskStatus_t taskSnapshot[DIAG_MAX_TASKS];
+static DiagRunTime prevTaskRunTime[MONITORED_TASK_COUNT];
+static DiagRunTime prevIdleRunTime[portNUM_PROCESSORS];
+static DiagRunTime prevTotalRunTime = 0;
+#endif
+
+int getMonitoredTaskCount() {
+  return MONITORED_TASK_COUNT;
+}
+
+const char* getMonitoredTaskName(int index) {
+  if (index < 0 || index >= MONITORED_TASK_COUNT) {
+    return "";
+  }
+  return monitoredTaskNames[index];
+}
+
+static TaskHandle_t getMonitoredTaskHandle(int index) {
+  if (monitoredTaskHandles[index] == NULL) {
+    monitoredTaskHandles[index] = xTaskGetHandle(monitoredTaskNames[index]);
+  }
+  return monitoredTaskHandles[index];
+}
+
+bool getMonitoredTaskStackFree(int index, uint32_t& bytes) {
+  if (index < 0 || index >= MONITORED_TASK_COUNT) {
+    return false;
+  }
+  TaskHandle_t handle = getMonitoredTaskHandle(index);
+  if (handle == NULL) {
+    return false; // Задача не запущена (например, Telegram не настроен)
+  }
+  // В ESP-IDF высшая отметка стека - в байтах
+  bytes = uxTaskGetStackHighWaterMark(handle);
+  return true;
+}
+
+#if DIAG_TASK_CPU
+static int16_t runTimePercent10(DiagRunTime delta, DiagRunTime elapsed) {
+  return (int16_t)min((uint64_t)1000, (uint64_t)delta * 1000 / elapsed);
+}
+
+// Доля времени каждой задачи за интервал между двумя снимками. Время общее на оба ядра:
+// задача, занимающая одно ядро целиком, - 100%
+static void sampleTaskCpu() {
+  DiagRunTime totalRunTime = 0;
+  UBaseType_t count = uxTaskGetSystemState(taskSnapshot, DIAG_MAX_TASKS, &totalRunTime);
+  if (count == 0) {
+    return; // Задач больше, чем мест в снимке
+  }
+  DiagRunTime elapsed = totalRunTime - prevTotalRunTime;
+  bool havePrevious = (prevTotalRunTime != 0 && elapsed > 0);
+  prevTotalRunTime = totalRunTime;
+
+  for (int i = 0; i < MONITORED_TASK_COUNT; i++) {
+    taskCpuPercent10[i] = DIAG_PERCENT_NONE;
+    for (UBaseType_t j = 0; j < count; j++) {
+      if (strcmp(taskSnapshot[j].pcTaskName, monitoredTaskNames[i]) == 0) {
+        if (havePrevious) {
+          taskCpuPercent10[i] = runTimePercent10(taskSnapshot[j].ulRunTimeCounter - prevTaskRunTime[i], elapsed);
+        }
+        prevTaskRunTime[i] = taskSnapshot[j].ulRunTimeCounter;
+        break;
+      }
+    }
+  }
+
+  // Загрузка ядра - все, кроме его задачи простоя
+  for (int core = 0; core < portNUM_PROCESSORS; core++) {
+    TaskHandle_t idle = xTaskGetIdleTaskHandleForCPU(core);
+    for (UBaseType_t j = 0; j < count; j++) {
+      if (taskSnapshot[j].xHandle == idle) {
+        if (havePrevious) {
+          coreLoadPercent10[core] = 1000 - runTimePercent10(taskSnapshot[j].ulRunTimeCounter - prevIdleRunTime[core], elapsed);
+        }
+        prevIdleRunTime[core] = taskSnapshot[j].ulRunTimeCounter;
+        break;
+      }
+    }
+  }
+}
+#endif
+
+void updateDiagnostics() {
+  unsigned long now = millis();
+  if (!diagnosticsReady) {
+    for (int i = 0; i < MONITORED_TASK_COUNT; i++) {
+      taskCpuPercent10[i] = DIAG_PERCENT_NONE;
+    }
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+      coreLoadPercent10[core] = DIAG_PERCENT_NONE;
+    }
+    diagnosticsReady = true;
+  } else if (now - lastSampleMs < DIAG_SAMPLE_INTERVAL) {
+    return;
+  }
+  lastSampleMs = now;
+
+  // Занятость loop() считается по собственным счетчикам - доступна при любой сборке SDK
+  uint32_t nowUs = micros();
+  LoopStats stats;
+  getLoopStats(stats);
+  if (lastSampleUs != 0 && nowUs != lastSampleUs) {
+    uint64_t busyUs = stats.totalUs - lastSampleLoopTotalUs;
+    loopBusyPercent10 = (int16_t)min((uint64_t)1000, busyUs * 1000 / (uint32_t)(nowUs - lastSampleUs));
+  }
+  lastSampleUs = nowUs;
+  lastSampleLoopTotalUs = stats.totalUs;
+
+#if DIAG_TASK_CPU
+  sampleTaskCpu();
+#endif
+}
+
+// ========== /api/debug ==========
+
+static const char* resetReasonName(esp_reset_reason_t reason) {
+  switch (reason) {
+    case ESP_RST_POWERON: return "power_on";
+    case ESP_RST_EXT: return "external";
+    case ESP_RST_SW: return "software";
+    case ESP_RST_PANIC: return "panic";
+    case ESP_RST_INT_WDT: return "interrupt_watchdog";
+    case ESP_RST_TASK_WDT: return "task_watchdog";
+    case ESP_RST_WDT: return "watchdog";
+    case ESP_RST_DEEPSLEEP: return "deep_sleep";
+    case ESP_RST_BROWNOUT: return "brownout";
+    case ESP_RST_SDIO: return "sdio";
+    default: return "unknown";
+  }
+}
+
+static void setPercent(JsonObject obj, const char* key, int16_t percent10) {
+  if (percent10 == DIAG_PERCENT_NONE) {
+    obj[key] = nullptr;
+  } else {
+    obj[key] = percent10 / 10.0;
+  }
+}
+
+static void fillDiagnosticsJson(JsonDocument& doc) {
+  JsonObject firmware = doc.createNestedObject("firmware");
+  firmware["version"] = FIRMWARE_VERSION;
+  firmware["build"] = __DATE__ " " __TIME__;
+  firmware["sdk"] = ESP.getSdkVersion();
+  firmware["chip"] = ESP.getChipModel();
+  firmware["cpu_mhz"] = ESP.getCpuFreqMHz();
+
+  doc["uptime"] = deviceUptime;
+  doc["reset_reason"] = resetReasonName(esp_reset_reason());
+
+  // Фрагментация: насколько наибольший свободный блок меньше всей свободной памяти
+  multi_heap_info_t heapInfo;
+  heap_caps_get_info(&heapInfo, MALLOC_CAP_8BIT);
+  uint32_t heapTotal = ESP.getHeapSize();
+  JsonObject heap = doc.createNestedObject("heap");
+  heap["total"] = heapTotal;
+  heap["free"] = heapInfo.total_free_bytes;
+  heap["min_free"] = heapInfo.minimum_free_bytes;
+  heap["largest_free_block"] = heapInfo.largest_free_block;
+  heap["allocated_blocks"] = heapInfo.allocated_blocks;
+  heap["free_blocks"] = heapInfo.free_blocks;
+  heap["fragmentation"] = heapInfo.total_free_bytes > 0
+      ? 100 - (int)(heapInfo.largest_free_block * 100 / heapInfo.total_free_bytes) : 0;
+  heap["usage"] = heapTotal > 0 ? (int)((heapTotal - ESP.getFreeHeap()) * 100 / heapTotal) : 0;
+
+  JsonObject spiffs = doc.createNestedObject("spiffs");
+  spiffs["total"] = SPIFFS.totalBytes();
+  spiffs["used"] = SPIFFS.usedBytes();
+
+  JsonObject cpu = doc.createNestedObject("cpu");
+  cpu["task_stats"] = (bool)DIAG_TASK_CPU;
+  JsonArray cores = cpu.createNestedArray("cores");
+  for (int core = 0; core < portNUM_PROCESSORS; core++) {
+    if (coreLoadPercent10[core] == DIAG_PERCENT_NONE) {
+      cores.add(nullptr);
+    } else {
+      cores.add(coreLoadPercent10[core] / 10.0);
+    }
+  }
+
+  JsonArray tasks = doc.createNestedArray("tasks");
+  for (int i = 0; i < MONITORED_TASK_COUNT; i++) {
+    JsonObject task = tasks.createNestedObject();
+    task["name"] = monitoredTaskNames[i];
+    uint32_t stackFree;
+    if (getMonitoredTaskStackFree(i, stackFree)) {
+      task["running"] = true;
+      task["stack_free_min"] = stackFree;
+    } else {
+      task["running"] = false;
+    }
+    setPercent(task, "cpu", taskCpuPercent10[i]);
+  }
+
+  LoopStats stats;
+  getLoopStats(stats);
+  SlowLoopEvent events[DIAG_SLOW_LOOP_EVENTS];
+  uint8_t next;
+  portENTER_CRITICAL(&loopStatsMux);
+  memcpy(events, slowLoops, sizeof(events));
+  next = slowLoopNext;
+  portEXIT_CRITICAL(&loopStatsMux);
+
+  JsonObject loop = doc.createNestedObject("loop");
+  loop["count"] = stats.count;
+  loop["avg_us"] = stats.count > 0 ? (uint32_t)(stats.totalUs / stats.count) : 0;
+  loop["max_recent_us"] = stats.recentMaxUs;
+  setPercent(loop, "busy", loopBusyPercent10);
+  loop["slow_threshold_us"] = DIAG_SLOW_LOOP_THRESHOLD_US;
+  loop["slow_count"] = stats.slowCount;
+
+  // Новые первыми
+  unsigned long now = millis();
+  JsonArray slow = loop.createNestedArray("slow");
+  uint32_t stored = min(stats.slowCount, (uint32_t)DIAG_SLOW_LOOP_EVENTS);
+  for (uint32_t n = 0; n < stored; n++) {
+    const SlowLoopEvent& event = events[(next + DIAG_SLOW_LOOP_EVENTS - 1 - n) % DIAG_SLOW_LOOP_EVENTS];
+    JsonObject item = slow.createNestedObject();
+    item["ago_ms"] = (uint32_t)(now - event.atMs);
+    item["duration_us"] = event.durationUs;
+    item["phase"] = event.phase != nullptr ? event.phase : "";
+    item["phase_us"] = event.phaseUs;
+    item["free_heap"] = event.freeHeap;
+  }
+}
+
+void registerDiagnostics(AsyncWebServer& server) {
+  onRoute(server, "/api/debug", HTTP_GET, [](AsyncWebServerRequest *request){
+    DynamicJsonDocument doc(3072);
+    fillDiagnosticsJson(doc);
+
+    String response;
+    serializeJson(doc, response);
+
+    AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", response);
+    resp->addHeader("Access-Control-Allow-Origin", "*");
+    resp->addHeader("Cache-Control", "no-store");
+    request->send(resp);
+  });
+}
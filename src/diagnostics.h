@@ -0,0 +1,43 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <ESPAsyncWebServer.h>
+#include <stdint.h>
+
+// Диагностика работающего устройства (GET /api/debug): задачи, куча, SPIFFS,
+// медленные итерации loop(), причина перезагрузки. Счетчики включены всегда -
+// на итерацию loop() приходится несколько вызовов micros()
+#define DIAG_SLOW_LOOP_THRESHOLD_US 50000  // Итерация дольше 50 мс попадает в журнал
+#define DIAG_SLOW_LOOP_EVENTS 8            // Последние медленные итерации
+#define DIAG_LOOP_MAX_WINDOW 30000         // Максимум длительности loop() - за последние 30-60 секунд
+#define DIAG_SAMPLE_INTERVAL 5000          // Пересчет загрузки CPU
+#define DIAG_MAX_TASKS 24                  // Размер снимка uxTaskGetSystemState()
+
+// Сводка по итерациям loop() с момента загрузки
+struct LoopStats {
+  uint64_t totalUs;
+  uint32_t count;
+  uint32_t recentMaxUs;   // За последние 30-60 секунд
+  uint32_t slowCount;     // Итераций дольше DIAG_SLOW_LOOP_THRESHOLD_US
+};
+
+// Вызывать в начале и в конце каждой итерации loop()
+void beginLoopIteration();
+void endLoopIteration();
+// Конец участка name (с начала итерации или с прошлой отметки).
+// Для медленной итерации в журнал попадает самый долгий участок
+void markLoopPhase(const char* name);
+void getLoopStats(LoopStats& stats);
+
+// Вызывать из loop(): раз в DIAG_SAMPLE_INTERVAL пересчитывает загрузку CPU
+void updateDiagnostics();
+
+// Задачи под наблюдением: loopTask, async_tcp, TelegramTask, MQTTTask
+int getMonitoredTaskCount();
+const char* getMonitoredTaskName(int index);
+// Минимум свободного стека в байтах; false - задача не запущена
+bool getMonitoredTaskStackFree(int index, uint32_t& bytes);
+
+void registerDiagnostics(AsyncWebServer& server);
+
+#endif
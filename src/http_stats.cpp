@@ -0,0 +1,103 @@
+#include "http_stats.h"
+#include <Arduino.h>
+
+const uint32_t httpStatsBucketBoundsUs[HTTP_STATS_BUCKETS - 1] = {
+  100, 300, 1000, 3000, 10000, 30000, 100000, 300000, 1000000
+};
+
+static HttpRouteStats routeStats[HTTP_STATS_MAX_ROUTES];
+static int routeCount = 0;
+
+// Длина тела ответа. Поле защищенное: указатель на член берется через производный класс,
+// чтение через него допустимо для любого ответа. У потоковых ответов без Content-Length - 0
+struct ResponseLengthAccess : public AsyncWebServerResponse {
+  static size_t of(const AsyncWebServerResponse* response) {
+    return response->*(&ResponseLengthAccess::_contentLength);
+  }
+};
+
+int registerHttpRoute(const char* route, const char* method) {
+  for (int i = 0; i < routeCount; i++) {
+    if (strcmp(routeStats[i].route, route) == 0 && strcmp(routeStats[i].method, method) == 0) {
+      return i;
+    }
+  }
+  if (routeCount >= HTTP_STATS_MAX_ROUTES) {
+    Serial.print(F("WARNING: HTTP stats table full, not tracking "));
+    Serial.println(route);
+    return -1;
+  }
+  memset(&routeStats[routeCount], 0, sizeof(HttpRouteStats));
+  routeStats[routeCount].route = route;
+  routeStats[routeCount].method = method;
+  return routeCount++;
+}
+
+void beginHttpRequest(HttpRequestProbe& probe) {
+  probe.freeHeap = ESP.getFreeHeap();
+  probe.startUs = micros();
+}
+
+void finishHttpRequest(int slot, AsyncWebServerRequest *request, const HttpRequestProbe& probe) {
+  uint32_t durationUs = micros() - probe.startUs;
+  if (slot < 0 || slot >= routeCount) {
+    return;
+  }
+  HttpRouteStats& stats = routeStats[slot];
+  int bucket = 0;
+  while (bucket < HTTP_STATS_BUCKETS - 1 && durationUs > httpStatsBucketBoundsUs[bucket]) {
+    bucket++;
+  }
+  stats.buckets[bucket]++;
+  stats.count++;
+  stats.totalUs += durationUs;
+  stats.heapDelta += (int32_t)(probe.freeHeap - ESP.getFreeHeap());
+
+  AsyncWebServerResponse *response = request->getResponse();
+  if (response != nullptr) {
+    stats.responseBytes += ResponseLengthAccess::of(response);
+  }
+}
+
+int getHttpRouteCount() {
+  return routeCount;
+}
+
+const HttpRouteStats* getHttpRouteStats(int slot) {
+  if (slot < 0 || slot >= routeCount) {
+    return nullptr;
+  }
+  return &routeStats[slot];
+}
+
+void resetHttpStats() {
+  for (int i = 0; i < routeCount; i++) {
+    HttpRouteStats& stats = routeStats[i];
+    stats.count = 0;
+    memset(stats.buckets, 0, sizeof(stats.buckets));
+    stats.totalUs = 0;
+    stats.responseBytes = 0;
+    stats.heapDelta = 0;
+  }
+}
+
+static const char* methodName(WebRequestMethodComposite method) {
+  if (method == HTTP_GET) {
+    return "GET";
+  }
+  if (method == HTTP_POST) {
+    return "POST";
+  }
+  return "ANY";
+}
+
+AsyncCallbackWebHandler& onRoute(AsyncWebServer& server, const char* uri, WebRequestMethodComposite method,
+                                 ArRequestHandlerFunction handler, const char* label) {
+  int slot = registerHttpRoute(label != nullptr ? label : uri, methodName(method));
+  return server.on(uri, method, [slot, handler](AsyncWebServerRequest *request) {
+    HttpRequestProbe probe;
+    beginHttpRequest(probe);
+    handler(request);
+    finishHttpRequest(slot, request, probe);
+  });
+}
@@ -0,0 +1,45 @@
+#ifndef HTTP_STATS_H
+#define HTTP_STATS_H
+
+#include <ESPAsyncWebServer.h>
+#include <stdint.h>
+
+// Статистика HTTP по маршрутам: число запросов, время обработчика (гистограмма
+// с логарифмическими корзинами), размер ответа и изменение свободной кучи.
+// Все обработчики выполняются в задаче async_tcp, поэтому таблица не требует блокировки
+#define HTTP_STATS_MAX_ROUTES 40
+#define HTTP_STATS_BUCKETS 10            // 0.1, 0.3, 1, 3, 10, 30, 100, 300, 1000 мс, +Inf
+
+struct HttpRouteStats {
+  const char* route;
+  const char* method;
+  uint32_t count;
+  uint32_t buckets[HTTP_STATS_BUCKETS]; // Не накопительные: запросы, попавшие именно в эту корзину
+  uint64_t totalUs;
+  uint64_t responseBytes;
+  int64_t heapDelta;                    // Сумма (куча до - куча после): память, удерживаемая ответом
+};
+
+// Верхние границы корзин в микросекундах (последняя - +Inf)
+extern const uint32_t httpStatsBucketBoundsUs[HTTP_STATS_BUCKETS - 1];
+
+// Слот маршрута для учета; маршруты с одинаковыми route и method делят слот. -1 - таблица заполнена
+int registerHttpRoute(const char* route, const char* method);
+
+// Замер обработки одного запроса: begin - перед обработчиком, finish - после
+struct HttpRequestProbe {
+  uint32_t startUs;
+  uint32_t freeHeap;
+};
+void beginHttpRequest(HttpRequestProbe& probe);
+void finishHttpRequest(int slot, AsyncWebServerRequest *request, const HttpRequestProbe& probe);
+
+int getHttpRouteCount();
+const HttpRouteStats* getHttpRouteStats(int slot);
+void resetHttpStats();
+
+// server.on() с учетом статистики. label - имя маршрута в метриках (для регулярных выражений)
+AsyncCallbackWebHandler& onRoute(AsyncWebServer& server, const char* uri, WebRequestMethodComposite method,
+                                 ArRequestHandlerFunction handler, const char* label = nullptr);
+
+#endif
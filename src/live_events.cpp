@@ -0,0 +1,225 @@
+#include "live_events.h"
+#include <Arduino.h>
+#include <WiFi.h>
+#include <stdarg.h>
+#include "sensors.h"
+#include "sensor_config.h"
+#include "settings_store.h"
+#include "operation_modes.h"
+#include "mqtt_client.h"
+#include "tg_bot.h"
+
+extern unsigned long deviceUptime;
+extern String deviceIP;
+extern int wifiRSSI;
+
+static AsyncEventSource liveEvents(LIVE_EVENTS_PATH);
+
+// Нет показаний термометра (температура в десятых долях градуса)
+#define LIVE_TEMP_NONE INT16_MIN
+// Изменение RSSI меньше порога не считается изменением (шум радиоканала)
+#define LIVE_RSSI_HYSTERESIS 3
+
+// Состояние, видимое веб-интерфейсу. Температуры округлены до 0.1 - как на экране
+struct LiveState {
+  bool wifiConnected;
+  int rssi;
+  char ip[16];
+  const char* mqttStatus;
+  const char* telegramStatus;
+  uint8_t operationMode;
+  uint8_t sensorCount;
+  char addresses[MAX_SENSORS][24];
+  int16_t temps[MAX_SENSORS];
+};
+
+static LiveState lastSent;
+static bool lastSentValid = false;
+static uint32_t liveTopology = 0;
+static uint32_t lastSentTopology = 0;
+static uint32_t liveFrameId = 0;
+static unsigned long lastCheckMs = 0;
+static unsigned long lastFrameMs = 0;
+// Новый клиент: следующий кадр - полный (выставляется из задачи async_tcp)
+static volatile bool liveResyncRequested = false;
+
+static char frame[LIVE_FRAME_MAX_SIZE];
+static size_t frameLen = 0;
+
+static void frameAppend(const char* format, ...) {
+  if (frameLen >= sizeof(frame) - 1) {
+    return;
+  }
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(frame + frameLen, sizeof(frame) - frameLen, format, args);
+  va_end(args);
+  if (written > 0) {
+    frameLen += written;
+    if (frameLen > sizeof(frame) - 1) {
+      frameLen = sizeof(frame) - 1;
+    }
+  }
+}
+
+static void onLiveSensorSettingsChanged(uint32_t changedSections) {
+  (void)changedSections;
+  bumpLiveTopology();
+}
+
+void bumpLiveTopology() {
+  liveTopology++;
+}
+
+void registerLiveEvents(AsyncWebServer& server) {
+  liveEvents.onConnect([](AsyncEventSourceClient *client) {
+    // Интервал переподключения браузера 5 секунд
+    client->send("", NULL, 0, 5000);
+    liveResyncRequested = true;
+  });
+  server.addHandler(&liveEvents);
+  // Имена и режимы термометров меняются через настройки
+  subscribeSettings(SETTINGS_SECTION_SENSORS, onLiveSensorSettingsChanged);
+}
+
+static void captureLiveState(LiveState& state) {
+  memset(&state, 0, sizeof(state));
+  state.wifiConnected = (WiFi.status() == WL_CONNECTED);
+  state.rssi = wifiRSSI;
+  strlcpy(state.ip, deviceIP.c_str(), sizeof(state.ip));
+  state.mqttStatus = getMqttStatus();
+  state.telegramStatus = getTelegramStatus();
+  state.operationMode = (uint8_t)getOperationMode();
+
+  int count = getSensorCount();
+  if (count > MAX_SENSORS) {
+    count = MAX_SENSORS;
+  }
+  state.sensorCount = count;
+
+  float corrections[MAX_SENSORS] = {0};
+  for (int i = 0; i < count; i++) {
+    strlcpy(state.addresses[i], getSensorAddressString(i).c_str(), sizeof(state.addresses[i]));
+  }
+  // Коррекция из настроек в RAM - одна блокировка на все термометры
+  if (lockSettings(pdMS_TO_TICKS(100))) {
+    const DeviceSettings& settings = settingsRef();
+    for (int i = 0; i < count; i++) {
+      int storedIndex = findStoredSensor(settings, state.addresses[i]);
+      if (storedIndex >= 0) {
+        corrections[i] = settings.sensors[storedIndex].correction;
+      }
+    }
+    unlockSettings();
+  }
+  for (int i = 0; i < count; i++) {
+    float temp = getSensorTemperature(i);
+    state.temps[i] = (temp != -127.0) ? (int16_t)lroundf((temp + corrections[i]) * 10.0f) : LIVE_TEMP_NONE;
+  }
+}
+
+static bool sameTopology(const LiveState& a, const LiveState& b) {
+  if (a.sensorCount != b.sensorCount) {
+    return false;
+  }
+  for (int i = 0; i < a.sensorCount; i++) {
+    if (strcmp(a.addresses[i], b.addresses[i]) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void appendSensorTemp(const LiveState& state, int index, bool& first) {
+  frameAppend("%s{\"address\":\"%s\",\"currentTemp\":", first ? "" : ",", state.addresses[index]);
+  if (state.temps[index] == LIVE_TEMP_NONE) {
+    frameAppend("-127.0}");
+  } else {
+    int16_t t = state.temps[index];
+    frameAppend("%s%d.%d}", (t < 0) ? "-" : "", abs(t) / 10, abs(t) % 10);
+  }
+  first = false;
+}
+
+void updateLiveEvents() {
+  unsigned long now = millis();
+  if (now - lastCheckMs < LIVE_EVENTS_CHECK_INTERVAL) {
+    return;
+  }
+  lastCheckMs = now;
+
+  // Нет клиентов - нечего формировать
+  if (liveEvents.count() == 0) {
+    lastSentValid = false;
+    return;
+  }
+
+  LiveState state;
+  captureLiveState(state);
+
+  bool full = !lastSentValid || liveResyncRequested;
+  liveResyncRequested = false;
+  if (!full && !sameTopology(state, lastSent)) {
+    liveTopology++;
+    full = true;
+  }
+
+  // Дельта: только изменившиеся поля. uptime есть в каждом кадре - клиент досчитывает его сам
+  frameLen = 0;
+  frameAppend("{\"uptime\":%lu,\"topology\":%lu", deviceUptime, (unsigned long)liveTopology);
+  bool changed = full;
+  if (full) {
+    frameAppend(",\"full\":true");
+  }
+  if (full || state.wifiConnected != lastSent.wifiConnected ||
+      abs(state.rssi - lastSent.rssi) >= LIVE_RSSI_HYSTERESIS || strcmp(state.ip, lastSent.ip) != 0) {
+    frameAppend(",\"wifi_status\":\"%s\",\"wifi_rssi\":%d,\"ip\":\"%s\"",
+                state.wifiConnected ? "connected" : "disconnected", state.rssi, state.ip);
+    changed = true;
+  } else {
+    state.rssi = lastSent.rssi; // Накопленный дрейф RSSI сравнивается с последним отправленным
+  }
+  if (full || strcmp(state.mqttStatus, lastSent.mqttStatus) != 0) {
+    frameAppend(",\"mqtt\":{\"status\":\"%s\"}", state.mqttStatus);
+    changed = true;
+  }
+  if (full || strcmp(state.telegramStatus, lastSent.telegramStatus) != 0) {
+    frameAppend(",\"telegram\":{\"status\":\"%s\"}", state.telegramStatus);
+    changed = true;
+  }
+  if (full || state.operationMode != lastSent.operationMode) {
+    frameAppend(",\"operation_mode\":%u", state.operationMode);
+    changed = true;
+  }
+
+  bool first = true;
+  for (int i = 0; i < state.sensorCount; i++) {
+    if (full || state.temps[i] != lastSent.temps[i]) {
+      if (first) {
+        frameAppend(",\"sensors\":[");
+      }
+      appendSensorTemp(state, i, first);
+      changed = true;
+    }
+  }
+  if (!first) {
+    frameAppend("]");
+  }
+  frameAppend("}");
+
+  // Изменение топологии через настройки тоже должно дойти до клиентов
+  if (liveTopology != lastSentTopology) {
+    changed = true;
+  }
+
+  if (!changed && now - lastFrameMs < LIVE_EVENTS_HEARTBEAT) {
+    return;
+  }
+
+  // Один сериализованный кадр рассылается всем клиентам
+  liveEvents.send(frame, "data", ++liveFrameId);
+  lastSent = state;
+  lastSentValid = true;
+  lastSentTopology = liveTopology;
+  lastFrameMs = now;
+}
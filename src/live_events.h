@@ -0,0 +1,19 @@
+#ifndef LIVE_EVENTS_H
+#define LIVE_EVENTS_H
+
+#include <ESPAsyncWebServer.h>
+
+// Канал живых обновлений веб-интерфейса (Server-Sent Events, /api/events).
+// Кадр формируется один раз в loop() и рассылается всем подключенным клиентам
+#define LIVE_EVENTS_PATH "/api/events"
+#define LIVE_EVENTS_CHECK_INTERVAL 1000   // Проверка изменений, мс
+#define LIVE_EVENTS_HEARTBEAT 30000       // Кадр без изменений (keep-alive), мс
+#define LIVE_FRAME_MAX_SIZE 1536
+
+void registerLiveEvents(AsyncWebServer& server);
+// Вызывать из loop(): сравнивает состояние с последним отправленным и рассылает дельту
+void updateLiveEvents();
+// Изменился состав или настройки термометров: клиенты перечитают /api/sensors
+void bumpLiveTopology();
+
+#endif
@@ -19,6 +19,12 @@
 #include "buzzer.h"
 #include "wifi_power.h"
 #include "mqtt_client.h"
+#include "mqtt_commands.h"
+#include "settings_store.h"
+#include "live_events.h"
+#include "data_snapshot.h"
+#include "diagnostics.h"
+#include "text_buffer.h"
 
 // Объявления для использования в других модулях
 extern float currentTemp;
@@ -30,6 +36,9 @@ extern int displayScreen;
 // Объявления функций
 void sendTemperatureAlert(float temperature);
 void sendMetricsToTelegram();
+static void onSensorSettingsChanged(uint32_t changedSections);
+// Кеш термометров не перезагружен (хранилище было занято): повтор из loop(), уведомления больше не будет
+static bool sensorConfigReloadPending = false;
 
 // Инициализация объектов
 OneWire oneWire(TEMP_SENSOR_PIN);
@@ -69,9 +78,6 @@ unsigned long lastClickTime = 0;
 SensorConfig sensorConfigs[MAX_SENSORS];
 SensorState sensorStates[MAX_SENSORS];
 int sensorConfigCount = 0;
-bool forceReloadSettings = false;
-unsigned long lastSettingsReload = 0;
-const unsigned long SETTINGS_RELOAD_INTERVAL = 30000;
 
 // Индекс для быстрого поиска конфигурации по индексу датчика (O(1) вместо O(n))
 static int sensorToConfigIndex[MAX_SENSORS];  // -1 означает "нет конфигурации"
@@ -118,7 +124,7 @@ void setup() {
     Serial.println(F("ERROR: Failed to mount SPIFFS, trying to format..."));
     if (!SPIFFS.format()) {
       Serial.println(F("ERROR: Failed to format SPIFFS!"));
-      Serial.println(F("Note: Critical settings (WiFi/Telegram) will be loaded from NVS if available"));
+      Serial.println(F("Note: Settings are stored in NVS and will still be loaded"));
     } else {
       Serial.println(F("SPIFFS formatted, restarting..."));
       delay(2000);
@@ -128,8 +134,8 @@ void setup() {
     Serial.println(F("SPIFFS mounted OK"));
   }
   
-  // Preferences (NVS) инициализируется автоматически при первом использовании
-  Serial.println(F("Preferences (NVS) ready for critical settings backup"));
+  // Загрузка настроек из NVS (при первом запуске - миграция из settings.json)
+  initSettingsStore();
   
   // Инициализация истории температуры
   initTemperatureHistory();
@@ -185,43 +191,31 @@ void setup() {
   String savedMqttTopicStatus;
   String savedMqttTopicControl;
   String savedMqttSecurity;
-  {
-    String settingsJson = getSettings();
-    StaticJsonDocument<768> doc;
-    DeserializationError error = deserializeJson(doc, settingsJson);
-    if (!error && doc.containsKey("wifi")) {
-      const char* ssid = doc["wifi"]["ssid"] | "";
-      const char* password = doc["wifi"]["password"] | "";
-      savedSsid = String(ssid);
-      savedPassword = String(password);
-      Serial.print(F("Loaded WiFi SSID: "));
-      Serial.println(savedSsid.length() > 0 ? savedSsid : "(empty)");
-    } else {
-      Serial.println(F("No WiFi settings found in config"));
-    }
-    if (!error && doc.containsKey("telegram")) {
-      const char* token = doc["telegram"]["bot_token"] | "";
-      const char* chatId = doc["telegram"]["chat_id"] | "";
-      savedTelegramToken = String(token);
-      savedTelegramChatId = String(chatId);
-    }
-    if (!error && doc.containsKey("mqtt")) {
-      String server = doc["mqtt"]["server"] | "";
-      server.trim();
-      // Проверяем валидность адреса сервера
-      if (server.length() > 0 && server != "#" && server != "null") {
-        savedMqttServer = server;
-      } else {
-        savedMqttServer = "";
-      }
-      savedMqttPort = doc["mqtt"]["port"] | 1883;
-      savedMqttUser = doc["mqtt"]["user"] | "";
-      savedMqttPassword = doc["mqtt"]["password"] | "";
-      savedMqttTopicStatus = doc["mqtt"]["topic_status"] | "";
-      savedMqttTopicControl = doc["mqtt"]["topic_control"] | "";
-      savedMqttSecurity = doc["mqtt"]["security"] | "none";
-    }
+  int savedTimezone = 3;
+  OperationMode mode = MODE_LOCAL; // По умолчанию
+  if (lockSettings()) {
+    const DeviceSettings& settings = settingsRef();
+    savedSsid = settings.wifiSsid;
+    savedPassword = settings.wifiPassword;
+    savedTelegramToken = settings.telegramToken;
+    savedTelegramChatId = settings.telegramChatId;
+    savedMqttServer = settings.mqttServer;
+    savedMqttPort = settings.mqttPort;
+    savedMqttUser = settings.mqttUser;
+    savedMqttPassword = settings.mqttPassword;
+    savedMqttTopicStatus = settings.mqttTopicStatus;
+    savedMqttTopicControl = settings.mqttTopicControl;
+    savedMqttSecurity = settings.mqttSecurity;
+    savedTimezone = settings.timezoneOffset;
+    mode = (OperationMode)settings.operationMode;
+    unlockSettings();
   }
+  Serial.print(F("Loaded WiFi SSID: "));
+  Serial.println(savedSsid.length() > 0 ? savedSsid : "(empty)");
+  Serial.print(F("Loaded operation mode: "));
+  Serial.println(mode);
+  setTimezone(savedTimezone);
+  subscribeTimezoneSettings();
   {
     String token = savedTelegramToken.length() > 0 ? savedTelegramToken : String(TELEGRAM_BOT_TOKEN);
     String chatId = savedTelegramChatId.length() > 0 ? savedTelegramChatId : String(TELEGRAM_CHAT_ID);
@@ -250,22 +244,6 @@ void setup() {
     }
   }
 
-  // Загружаем режим работы из настроек
-  OperationMode mode = MODE_LOCAL; // По умолчанию
-  {
-    String settingsJson = getSettings();
-    StaticJsonDocument<256> modeDoc;
-    DeserializationError error = deserializeJson(modeDoc, settingsJson);
-    if (!error && modeDoc.containsKey("operation_mode")) {
-      int modeValue = modeDoc["operation_mode"] | 0;
-      mode = (OperationMode)modeValue;
-      Serial.print(F("Loaded operation mode: "));
-      Serial.println(mode);
-    } else {
-      Serial.println(F("No saved operation mode"));
-    }
-  }
-  
   // Если есть сохраненный SSID, но режим MODE_LOCAL - переключаем на MODE_MONITORING
   // чтобы устройство подключалось к WiFi, а не создавало точку доступа
   if (mode == MODE_LOCAL && savedSsid.length() > 0) {
@@ -367,9 +345,10 @@ void setup() {
     sensorConfigs[i].valid = false;
   }
   
-  // Загружаем настройки термометров
-  loadSensorConfigs();
+  // Загружаем настройки термометров; дальше кеш обновляется только при их изменении
+  sensorConfigReloadPending = !loadSensorConfigs();
   buildSensorConfigIndex();  // Построение индекса для O(1) поиска
+  subscribeSettings(SETTINGS_SECTION_SENSORS, onSensorSettingsChanged);
 
   // Инициализация Watchdog Timer (30 сек таймаут, panic при срабатывании)
   Serial.println(F("Initializing Watchdog Timer..."));
@@ -464,85 +443,70 @@ void handleButton() {
   }
 }
 
-// Функция загрузки настроек термометров в кеш
-void loadSensorConfigs() {
-  sensorConfigCount = 0;
-  
-  String settingsJson = getSettings();
-  StaticJsonDocument<4096> doc;
-  DeserializationError error = deserializeJson(doc, settingsJson);
-  
-  if (error || !doc.containsKey("sensors")) {
-    Serial.println(F("No sensor settings found or parse error"));
-    return;
+// Перезагрузка кеша термометров при изменении настроек (вызывается из loop через processPendingNvsSave)
+static void onSensorSettingsChanged(uint32_t changedSections) {
+  (void)changedSections;
+  sensorConfigReloadPending = !loadSensorConfigs();
+  buildSensorConfigIndex();  // Перестраиваем индекс после перезагрузки настроек
+}
+
+// Функция загрузки настроек термометров в кеш (из настроек в RAM, без JSON).
+// Хранилище занято - прежний кеш остается без изменений
+bool loadSensorConfigs() {
+  if (!lockSettings(pdMS_TO_TICKS(1000))) {
+    Serial.println(F("Settings store busy, sensor configs not reloaded"));
+    return false;
   }
-  
-  JsonArray sensorsArray = doc["sensors"];
-  int count = sensorsArray.size();
+
+  sensorConfigCount = 0;
+
+  const DeviceSettings& settings = settingsRef();
+  int count = settings.sensorCount;
   if (count > MAX_SENSORS) count = MAX_SENSORS;
-  
+
   for (int i = 0; i < count; i++) {
-    JsonObject sensor = sensorsArray[i];
+    const StoredSensorConfig& stored = settings.sensors[i];
     SensorConfig& config = sensorConfigs[sensorConfigCount];
-    
-    config.address = sensor["address"] | "";
-    String nameStr = sensor["name"].as<String>();
-    if (nameStr.length() == 0) {
+
+    config.address = stored.address;
+    if (stored.name[0] == '\0') {
       config.name = "Термометр " + String(sensorConfigCount + 1);
     } else {
-      config.name = nameStr;
-    }
-    config.enabled = sensor["enabled"] | true;
-    // Валидация: коррекция в пределах -10..+10 градусов
-    config.correction = constrain((float)(sensor["correction"] | 0.0), -10.0f, 10.0f);
-    String modeStr = sensor["mode"] | "monitoring";
-    config.mode = modeStr;
-    config.sendToNetworks = sensor["sendToNetworks"] | true;
-    config.buzzerEnabled = sensor["buzzerEnabled"] | false;
-    // Валидация: интервал мониторинга 1-3600 секунд (1 сек - 1 час)
-    config.monitoringInterval = constrain((int)(sensor["monitoringInterval"] | 5), 1, 3600);
-
-    // Настройки оповещения с валидацией температур (-55..+125°C - диапазон DS18B20)
-    if (sensor["alertSettings"].is<JsonObject>()) {
-      JsonObject alert = sensor["alertSettings"];
-      config.alertMinTemp = constrain((float)(alert["minTemp"] | 10.0), -55.0f, 125.0f);
-      config.alertMaxTemp = constrain((float)(alert["maxTemp"] | 30.0), -55.0f, 125.0f);
-      config.alertBuzzerEnabled = alert["buzzerEnabled"] | true;
-    } else {
-      config.alertMinTemp = 10.0;
-      config.alertMaxTemp = 30.0;
-      config.alertBuzzerEnabled = true;
+      config.name = stored.name;
     }
+    config.enabled = stored.enabled != 0;
+    config.correction = stored.correction;
+    config.mode = sensorModeName(stored.mode);
+    config.sendToNetworks = stored.sendToNetworks != 0;
+    config.buzzerEnabled = stored.buzzerEnabled != 0;
+    config.monitoringInterval = stored.monitoringInterval;
+
+    config.alertMinTemp = stored.alertMinTemp;
+    config.alertMaxTemp = stored.alertMaxTemp;
+    config.alertBuzzerEnabled = stored.alertBuzzerEnabled != 0;
 
-    // Настройки стабилизации с валидацией
     // tolerance - максимальный разброс температур за duration для признания стабильности
     // alertThreshold - порог резкого скачка от базовой температуры для тревоги
-    // duration - время ожидания стабилизации (по умолчанию 10 минут)
-    if (sensor["stabilizationSettings"].is<JsonObject>()) {
-      JsonObject stab = sensor["stabilizationSettings"];
-      config.stabTolerance = constrain((float)(stab["tolerance"] | 0.1), 0.01f, 5.0f);
-      config.stabAlertThreshold = constrain((float)(stab["alertThreshold"] | 0.2), 0.05f, 10.0f);
-      config.stabBuzzerEnabled = stab["buzzerEnabled"] | true;
-      // Валидация: длительность 1-60 минут (60-3600 секунд)
-      int durationMin = constrain((int)(stab["duration"] | 10), 1, 60);
-      config.stabDuration = durationMin * 60 * 1000UL; // Конвертируем минуты в миллисекунды
-    } else {
-      config.stabTolerance = 0.1;      // 0.1°C - разброс для стабильности
-      config.stabAlertThreshold = 0.2; // 0.2°C - порог резкого скачка
-      config.stabBuzzerEnabled = true;
-      config.stabDuration = 10 * 60 * 1000UL; // 10 минут по умолчанию
-    }
-    
+    config.stabTolerance = stored.stabTolerance;
+    config.stabAlertThreshold = stored.stabAlertThreshold;
+    config.stabBuzzerEnabled = stored.stabBuzzerEnabled != 0;
+    config.stabDuration = stored.stabDurationMin * 60 * 1000UL; // Конвертируем минуты в миллисекунды
+
     config.valid = true;
     sensorConfigCount++;
   }
-  
+
+  unlockSettings();
+
   Serial.print(F("Loaded "));
   Serial.print(sensorConfigCount);
   Serial.println(F(" sensor configurations"));
+  return true;
 }
 
 void loop() {
+  beginLoopIteration();
+
   // Сбрасываем Watchdog Timer в начале каждой итерации
   esp_task_wdt_reset();
 
@@ -599,9 +563,17 @@ void loop() {
   
   // Обновление бипера
   updateBuzzer();
+  markLoopPhase("wifi");
 
-  // Обработка отложенной записи в NVS (чтобы не блокировать WiFi при сохранении настроек)
+  // Обработка отложенной записи настроек в NVS (чтобы не блокировать WiFi при сохранении настроек)
   processPendingNvsSave();
+  markLoopPhase("settings");
+
+  // Пересборка снимка /api/data и рассылка изменений веб-клиентам (SSE)
+  updateDataSnapshot();
+  updateLiveEvents();
+  updateDiagnostics();
+  markLoopPhase("web");
 
   // Обработка кнопки
   handleButton();
@@ -616,6 +588,7 @@ void loop() {
   if (isWiFiEnabled()) {
     updateTime();
   }
+  markLoopPhase("time");
 
   // MQTT теперь обрабатывается в отдельной FreeRTOS задаче (mqtt_client.cpp)
   // Здесь только отправка метрик (не блокирующая операция)
@@ -625,20 +598,22 @@ void loop() {
     sendMqttMetrics(deviceUptime, currentTemp, deviceIP, wifiRSSI);
     lastMqttMetricsUpdate = millis();
   }
-  
-  // Перезагружаем настройки термометров каждые 30 секунд или принудительно после сохранения
-  // Но не чаще, чем раз в 5 секунд, чтобы не перегружать систему
-  static unsigned long lastReloadCheck = 0;
-  if (millis() - lastReloadCheck > 5000) {
-    lastReloadCheck = millis();
-    if (forceReloadSettings || (millis() - lastSettingsReload > SETTINGS_RELOAD_INTERVAL)) {
-      loadSensorConfigs();
-      buildSensorConfigIndex();  // Перестраиваем индекс после перезагрузки настроек
-      lastSettingsReload = millis();
-      forceReloadSettings = false;
-    }
+  // Команды из топика управления: выполняются здесь, рядом с остальными изменениями настроек
+  processMqttCommands();
+  markLoopPhase("mqtt");
+  
+  // Пересканирование шины раз в минуту (подключение/отключение термометров на ходу)
+  static unsigned long lastSensorScan = 0;
+  if (millis() - lastSensorScan > 60000) {
+    scanSensors();
+    buildSensorConfigIndex();  // Индексы термометров могли сместиться
+    lastSensorScan = millis();
   }
-  
+  if (sensorConfigReloadPending) {
+    onSensorSettingsChanged(SETTINGS_SECTION_SENSORS);
+  }
+  markLoopPhase("bus_scan");
+
   // Чтение температуры каждые 10 секунд
   if (millis() - lastSensorUpdate > 10000) {
     readTemperature();
@@ -681,6 +656,7 @@ void loop() {
       
       // Сохраняем историю температуры для этого термометра
       addTemperatureRecord(correctedTemp, addressStr);
+      reportMqttSensorReading(i, addressStr.c_str(), config->name.c_str(), correctedTemp);
       
       // Обрабатываем режим работы термометра
       if (config->mode == "monitoring") {
@@ -710,13 +686,15 @@ void loop() {
               yield(); // Даем время другим задачам
             }
           }
-          break; // Обработали, выходим из цикла
+          // Не break: остальные термометры в этом цикле тоже пишут историю и телеметрию MQTT
+          // и проверяют свои режимы. Повторной сводки не будет - lastSentTemp всех уже обновлен
+          continue;
         }
       } else if (config->mode == "alert") {
         if (correctedTemp <= config->alertMinTemp || correctedTemp >= config->alertMaxTemp) {
           if (fabs(correctedTemp - sensorStates[i].lastSentTemp) > 0.1) {
-            String alertType = (correctedTemp >= config->alertMaxTemp) ? "high" : "low";
-            sendTemperatureAlert(config->name, correctedTemp, alertType);
+            const char* alertType = (correctedTemp >= config->alertMaxTemp) ? "high" : "low";
+            sendTemperatureAlert(config->name.c_str(), correctedTemp, alertType);
             if (config->alertBuzzerEnabled) {
               buzzerBeep(BUZZER_ALERT);
             }
@@ -798,11 +776,12 @@ void loop() {
             // Короткий сигнал о достижении стабилизации
             buzzerBeep(BUZZER_STABILIZATION);
 
-            // Отправляем уведомление о стабилизации
-            if (config->sendToNetworks && WiFi.status() == WL_CONNECTED) {
-              String msg = "✅ " + config->name + ": температура стабилизировалась на " +
-                          String(state->baselineTemp, 1) + "°C";
-              sendTemperatureAlert(config->name, state->baselineTemp, msg);
+            // Отправляем уведомление о стабилизации (без Wi-Fi оно ждет в outbox)
+            if (config->sendToNetworks) {
+              TextBuffer<TELEGRAM_ALERT_TYPE_SIZE> msg;
+              msg.add("✅ ").add(config->name).add(": температура стабилизировалась на ")
+                 .addFloat(state->baselineTemp, 1).add("°C");
+              sendTemperatureAlert(config->name.c_str(), state->baselineTemp, msg.c_str());
               state->lastSentTemp = correctedTemp;
             }
           }
@@ -837,11 +816,12 @@ void loop() {
               // === ТРЕВОГА: резкий скачок температуры! ===
               // Cooldown 60 секунд между тревогами
               if (!state->alertSent || (now - state->lastAlertTime > 60000)) {
-                String direction = (diffFromBaseline > 0) ? "⬆️ РОСТ" : "⬇️ ПАДЕНИЕ";
-                String msg = "🚨 " + config->name + ": " + direction + " температуры!\n" +
-                            "Было: " + String(state->baselineTemp, 2) + "°C\n" +
-                            "Стало: " + String(correctedTemp, 2) + "°C\n" +
-                            "Скачок: " + String(diffFromBaseline, 2) + "°C";
+                const char* direction = (diffFromBaseline > 0) ? "⬆️ РОСТ" : "⬇️ ПАДЕНИЕ";
+                TextBuffer<TELEGRAM_ALERT_TYPE_SIZE> msg;
+                msg.add("🚨 ").add(config->name).add(": ").add(direction).add(" температуры!\n");
+                msg.add("Было: ").addFloat(state->baselineTemp, 2).add("°C\n");
+                msg.add("Стало: ").addFloat(correctedTemp, 2).add("°C\n");
+                msg.add("Скачок: ").addFloat(diffFromBaseline, 2).add("°C");
 
                 Serial.printf("[STAB] %s: ТРЕВОГА! Скачок %.2f°C (было %.2f, стало %.2f)\n",
                               config->name.c_str(), diffFromBaseline, state->baselineTemp, correctedTemp);
@@ -850,8 +830,9 @@ void loop() {
                   buzzerBeep(BUZZER_ALERT);
                 }
 
-                if (config->sendToNetworks && WiFi.status() == WL_CONNECTED) {
-                  sendTemperatureAlert(config->name, correctedTemp, msg);
+                // Без Wi-Fi тревога сохраняется в outbox и уйдет после восстановления
+                if (config->sendToNetworks) {
+                  sendTemperatureAlert(config->name.c_str(), correctedTemp, msg.c_str(), true); // Скачок - без ожидания сводки
                   state->lastSentTemp = correctedTemp;
                 }
 
@@ -943,9 +924,14 @@ void loop() {
     }
   }
   
+  markLoopPhase("sensors");
+
   // Telegram теперь обрабатывается в отдельной FreeRTOS задаче (tg_bot.cpp)
   // Это предотвращает блокировку основного loop при DNS запросах и HTTP операциях
 
   yield();
   updateDisplay();
+  markLoopPhase("display");
+
+  endLoopIteration();
 }
@@ -0,0 +1,530 @@
+#include "metrics.h"
+#include <Arduino.h>
+#include <WiFi.h>
+#include <stdarg.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sensors.h"
+#include "settings_store.h"
+#include "mqtt_client.h"
+#include "tg_bot.h"
+#include "telegram_outbox.h"
+#include "mqtt_backlog.h"
+#include "mqtt_commands.h"
+#include "alloc_probe.h"
+#include "diagnostics.h"
+#include "http_stats.h"
+#include "request_body.h"
+
+extern unsigned long deviceUptime;
+extern int wifiRSSI;
+
+void recordLatency(LatencyStats& stats, unsigned long durationMs, bool success) {
+  stats.count++;
+  if (!success) {
+    stats.failures++;
+  }
+  stats.totalMs += durationMs;
+  stats.lastMs = durationMs;
+}
+
+enum MetricFamilyId {
+  METRIC_UPTIME = 0,
+  METRIC_SENSOR_COUNT,
+  METRIC_SENSOR_TEMPERATURE,
+  METRIC_SENSOR_READ_ERRORS,
+  METRIC_SENSOR_INFO,
+  METRIC_LOOP_DURATION,
+  METRIC_LOOP_DURATION_MAX,
+  METRIC_HEAP_FREE,
+  METRIC_HEAP_MIN_FREE,
+  METRIC_HEAP_LARGEST_BLOCK,
+  METRIC_TASK_STACK_FREE,
+  METRIC_TELEGRAM_QUEUE_DEPTH,
+  METRIC_TELEGRAM_QUEUE_OLDEST_AGE,
+  METRIC_TELEGRAM_QUEUE_WAIT,
+  METRIC_TELEGRAM_QUEUE_EVICTED,
+  METRIC_TELEGRAM_QUEUE_REJECTED,
+  METRIC_TELEGRAM_QUEUE_REPLACED,
+  METRIC_TELEGRAM_OUTBOX_PENDING,
+  METRIC_TELEGRAM_OUTBOX_CAPACITY,
+  METRIC_TELEGRAM_OUTBOX_STORED,
+  METRIC_TELEGRAM_OUTBOX_DELIVERED,
+  METRIC_TELEGRAM_OUTBOX_DROPPED,
+  METRIC_TELEGRAM_SEND_DURATION,
+  METRIC_TELEGRAM_SEND_FAILURES,
+  METRIC_TELEGRAM_TLS_HANDSHAKE,
+  METRIC_TELEGRAM_TLS_HANDSHAKE_FAILURES,
+  METRIC_TELEGRAM_CONNECTION_REUSED,
+  METRIC_MQTT_CONNECTED,
+  METRIC_MQTT_PUBLISH_DURATION,
+  METRIC_MQTT_PUBLISH_FAILURES,
+  METRIC_MQTT_BACKLOG_PENDING,
+  METRIC_MQTT_BACKLOG_CAPACITY,
+  METRIC_MQTT_BACKLOG_STORED,
+  METRIC_MQTT_BACKLOG_REPLAYED,
+  METRIC_MQTT_BACKLOG_DROPPED,
+  METRIC_MQTT_COMMANDS_RECEIVED,
+  METRIC_MQTT_COMMANDS_DROPPED,
+  METRIC_MQTT_COMMANDS_FAILED,
+  METRIC_SEND_PATH_ALLOCATIONS,
+  METRIC_WIFI_CONNECTED,
+  METRIC_WIFI_RSSI,
+  METRIC_HTTP_REQUEST_DURATION,
+  METRIC_HTTP_RESPONSE_SIZE,
+  METRIC_HTTP_HEAP_DELTA,
+  METRIC_FAMILY_COUNT
+};
+
+struct MetricFamily {
+  const char* name;
+  const char* type;
+  const char* help;
+};
+
+static const MetricFamily metricFamilies[METRIC_FAMILY_COUNT] = {
+  {"thermo_uptime_seconds", "counter", "Time since boot"},
+  {"thermo_sensors", "gauge", "Temperature sensors found on the 1-Wire bus"},
+  {"thermo_sensor_temperature_celsius", "gauge", "Last reading with the configured correction applied"},
+  {"thermo_sensor_read_errors_total", "counter", "Failed reads since the sensor appeared on the bus"},
+  {"thermo_sensor_info", "gauge", "Sensor name by address, always 1"},
+  {"thermo_loop_duration_seconds", "summary", "Main loop iteration time"},
+  {"thermo_loop_duration_max_seconds", "gauge", "Longest main loop iteration in the last 30-60 s"},
+  {"thermo_heap_free_bytes", "gauge", "Free heap"},
+  {"thermo_heap_min_free_bytes", "gauge", "Lowest free heap since boot"},
+  {"thermo_heap_largest_free_block_bytes", "gauge", "Largest allocatable heap block"},
+  {"thermo_task_stack_free_min_bytes", "gauge", "Stack high-water mark: least free stack seen by the task"},
+  {"thermo_telegram_queue_depth", "gauge", "Messages waiting in the Telegram send queue"},
+  {"thermo_telegram_queue_oldest_age_seconds", "gauge", "Age of the oldest message waiting in the Telegram queue"},
+  {"thermo_telegram_queue_wait_seconds", "summary", "Time from enqueue to the start of sending"},
+  {"thermo_telegram_queue_evicted_total", "counter", "Queued Telegram messages evicted for higher-priority ones"},
+  {"thermo_telegram_queue_rejected_total", "counter", "New Telegram messages not accepted by a full or busy queue"},
+  {"thermo_telegram_queue_replaced_total", "counter", "Queued metrics snapshots replaced by a newer one"},
+  {"thermo_telegram_outbox_pending", "gauge", "Undelivered alerts stored in flash"},
+  {"thermo_telegram_outbox_capacity", "gauge", "Alerts the flash outbox can hold"},
+  {"thermo_telegram_outbox_stored_total", "counter", "Alerts written to the flash outbox"},
+  {"thermo_telegram_outbox_delivered_total", "counter", "Alerts replayed from the flash outbox"},
+  {"thermo_telegram_outbox_dropped_total", "counter", "Alerts overwritten in or not written to the flash outbox"},
+  {"thermo_telegram_send_duration_seconds", "summary", "Telegram sendMessage call time"},
+  {"thermo_telegram_send_failures_total", "counter", "Failed Telegram sendMessage calls"},
+  {"thermo_telegram_tls_handshake_seconds", "summary", "TLS handshakes with the Telegram API by connection"},
+  {"thermo_telegram_tls_handshake_failures_total", "counter", "Failed TLS handshakes with the Telegram API"},
+  {"thermo_telegram_connection_reused_total", "counter", "Telegram API requests sent over an already open connection"},
+  {"thermo_mqtt_connected", "gauge", "1 if connected to the MQTT broker"},
+  {"thermo_mqtt_publish_duration_seconds", "summary", "MQTT publish call time"},
+  {"thermo_mqtt_publish_failures_total", "counter", "Failed MQTT publish calls"},
+  {"thermo_mqtt_backlog_pending", "gauge", "Sensor readings waiting for MQTT replay in RAM and flash"},
+  {"thermo_mqtt_backlog_capacity", "gauge", "Readings the flash backlog can hold"},
+  {"thermo_mqtt_backlog_stored_total", "counter", "Readings added to the MQTT backlog"},
+  {"thermo_mqtt_backlog_replayed_total", "counter", "Backlog readings acknowledged by the broker"},
+  {"thermo_mqtt_backlog_dropped_total", "counter", "Backlog readings overwritten, corrupted or not stored"},
+  {"thermo_mqtt_commands_received_total", "counter", "Control topic commands queued for execution"},
+  {"thermo_mqtt_commands_dropped_total", "counter", "Control topic commands dropped: queue full or too long"},
+  {"thermo_mqtt_commands_failed_total", "counter", "Control topic commands answered with an error"},
+  {"thermo_send_path_heap_allocations_total", "counter", "Heap allocations while formatting and queueing outbound messages"},
+  {"thermo_wifi_connected", "gauge", "1 if connected to a Wi-Fi network"},
+  {"thermo_wifi_rssi_dbm", "gauge", "Wi-Fi signal strength"},
+  {"thermo_http_request_duration_seconds", "histogram", "HTTP handler time by route"},
+  {"thermo_http_response_size_bytes", "summary", "HTTP response body size by route, 0 for streamed responses"},
+  {"thermo_http_heap_delta_bytes", "summary", "Heap held by the response when the handler returns"},
+};
+
+// Строки семейства закончились
+#define METRIC_ROW_END -1
+
+// Строка целиком или ничего: обрезанная строка сломала бы разбор на стороне Prometheus
+static int rowPrintf(char* out, size_t size, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(out, size, format, args);
+  va_end(args);
+  if (written < 0 || (size_t)written >= size) {
+    return 0;
+  }
+  return written;
+}
+
+// Значение метки: экранируются \, " и перевод строки
+static void escapeLabelValue(const char* in, char* out, size_t size) {
+  size_t n = 0;
+  for (; *in != '\0' && n + 2 < size; in++) {
+    if (*in == '\\' || *in == '"') {
+      out[n++] = '\\';
+      out[n++] = *in;
+    } else if (*in == '\n') {
+      out[n++] = '\\';
+      out[n++] = 'n';
+    } else {
+      out[n++] = *in;
+    }
+  }
+  out[n] = '\0';
+}
+
+static int formatSensorRow(int family, int index, char* out, size_t size) {
+  const char* name = metricFamilies[family].name;
+  char address[24];
+  if (!formatSensorAddress(index, address, sizeof(address))) {
+    return METRIC_ROW_END; // Шину пересканировали во время ответа
+  }
+
+  if (family == METRIC_SENSOR_READ_ERRORS) {
+    return rowPrintf(out, size, "%s{address=\"%s\"} %lu\n", name, address,
+                     (unsigned long)getSensorReadErrors(index));
+  }
+
+  float temp = getSensorTemperature(index);
+  if (family == METRIC_SENSOR_TEMPERATURE && temp == -127.0) {
+    return 0; // Нет показаний - образец не выводится
+  }
+
+  // Коррекция и имя - из настроек в RAM
+  float correction = 0.0f;
+  char sensorName[sizeof(StoredSensorConfig::name)] = "";
+  if (!lockSettings(pdMS_TO_TICKS(50))) {
+    return 0;
+  }
+  const DeviceSettings& settings = settingsRef();
+  int storedIndex = findStoredSensor(settings, address);
+  if (storedIndex >= 0) {
+    correction = settings.sensors[storedIndex].correction;
+    strlcpy(sensorName, settings.sensors[storedIndex].name, sizeof(sensorName));
+  }
+  unlockSettings();
+
+  if (family == METRIC_SENSOR_TEMPERATURE) {
+    return rowPrintf(out, size, "%s{address=\"%s\"} %.2f\n", name, address, temp + correction);
+  }
+  char escapedName[sizeof(sensorName) * 2];
+  escapeLabelValue(sensorName, escapedName, sizeof(escapedName));
+  return rowPrintf(out, size, "%s{address=\"%s\",name=\"%s\"} 1\n", name, address, escapedName);
+}
+
+static int formatTaskStackRow(int index, char* out, size_t size) {
+  if (index >= getMonitoredTaskCount()) {
+    return METRIC_ROW_END;
+  }
+  uint32_t stackFree;
+  if (!getMonitoredTaskStackFree(index, stackFree)) {
+    return 0; // Задача не запущена (например, Telegram не настроен)
+  }
+  return rowPrintf(out, size, "%s{task=\"%s\"} %lu\n", metricFamilies[METRIC_TASK_STACK_FREE].name,
+                   getMonitoredTaskName(index), (unsigned long)stackFree);
+}
+
+// summary без квантилей: _sum и _count
+static int formatSummaryRow(const char* name, int sample, double sumSeconds, uint32_t count, char* out, size_t size) {
+  if (sample == 0) {
+    return rowPrintf(out, size, "%s_sum %.6f\n", name, sumSeconds);
+  }
+  if (sample == 1) {
+    return rowPrintf(out, size, "%s_count %lu\n", name, (unsigned long)count);
+  }
+  return METRIC_ROW_END;
+}
+
+// Статистика HTTP: по маршруту HTTP_STATS_BUCKETS корзин + _sum + _count (гистограмма)
+// или _sum + _count (summary). Маршруты без запросов не выводятся
+static int formatHttpRow(int family, int sample, char* out, size_t size) {
+  int rowsPerRoute = (family == METRIC_HTTP_REQUEST_DURATION) ? HTTP_STATS_BUCKETS + 2 : 2;
+  const HttpRouteStats* stats = getHttpRouteStats(sample / rowsPerRoute);
+  if (stats == nullptr) {
+    return METRIC_ROW_END;
+  }
+  if (stats->count == 0) {
+    return 0;
+  }
+  const char* name = metricFamilies[family].name;
+  int row = sample % rowsPerRoute;
+
+  if (family == METRIC_HTTP_REQUEST_DURATION) {
+    if (row < HTTP_STATS_BUCKETS) {
+      uint32_t cumulative = 0;
+      for (int bucket = 0; bucket <= row; bucket++) {
+        cumulative += stats->buckets[bucket];
+      }
+      char le[12];
+      if (row < HTTP_STATS_BUCKETS - 1) {
+        snprintf(le, sizeof(le), "%g", httpStatsBucketBoundsUs[row] / 1e6);
+      } else {
+        strlcpy(le, "+Inf", sizeof(le));
+      }
+      return rowPrintf(out, size, "%s_bucket{route=\"%s\",method=\"%s\",le=\"%s\"} %lu\n",
+                       name, stats->route, stats->method, le, (unsigned long)cumulative);
+    }
+    row -= HTTP_STATS_BUCKETS;
+  }
+
+  if (row == 0) {
+    double sum = (family == METRIC_HTTP_REQUEST_DURATION) ? stats->totalUs / 1e6
+               : (family == METRIC_HTTP_RESPONSE_SIZE) ? (double)stats->responseBytes
+               : (double)stats->heapDelta;
+    return rowPrintf(out, size, "%s_sum{route=\"%s\",method=\"%s\"} %.10g\n", name, stats->route, stats->method, sum);
+  }
+  return rowPrintf(out, size, "%s_count{route=\"%s\",method=\"%s\"} %lu\n", name, stats->route, stats->method,
+                   (unsigned long)stats->count);
+}
+
+// Рукопожатия и переиспользование соединений Telegram по соединению (poll, send)
+static int formatTelegramConnectionRow(int family, int sample, char* out, size_t size) {
+  int rowsPerConnection = (family == METRIC_TELEGRAM_TLS_HANDSHAKE) ? 2 : 1;
+  int connection = sample / rowsPerConnection;
+  if (connection >= TELEGRAM_CONNECTION_COUNT) {
+    return METRIC_ROW_END;
+  }
+  const char* name = metricFamilies[family].name;
+  const char* label = getTelegramConnectionName(connection);
+  const LatencyStats& stats = getTelegramHandshakeStats(connection);
+
+  if (family == METRIC_TELEGRAM_TLS_HANDSHAKE) {
+    if (sample % 2 == 0) {
+      return rowPrintf(out, size, "%s_sum{connection=\"%s\"} %.6f\n", name, label, stats.totalMs / 1e3);
+    }
+    return rowPrintf(out, size, "%s_count{connection=\"%s\"} %lu\n", name, label, (unsigned long)stats.count);
+  }
+  uint32_t value = (family == METRIC_TELEGRAM_TLS_HANDSHAKE_FAILURES) ? stats.failures
+                                                                       : getTelegramConnectionReuses(connection);
+  return rowPrintf(out, size, "%s{connection=\"%s\"} %lu\n", name, label, (unsigned long)value);
+}
+
+// Строка item семейства family: 0 - HELP и TYPE, дальше образцы.
+// METRIC_ROW_END - образцы закончились, 0 - образец пропущен
+static int formatMetricRow(int family, int item, char* out, size_t size) {
+  const MetricFamily& metric = metricFamilies[family];
+  if (item == 0) {
+    return rowPrintf(out, size, "# HELP %s %s\n# TYPE %s %s\n", metric.name, metric.help, metric.name, metric.type);
+  }
+  int sample = item - 1;
+
+  switch (family) {
+    case METRIC_SENSOR_TEMPERATURE:
+    case METRIC_SENSOR_READ_ERRORS:
+    case METRIC_SENSOR_INFO:
+      if (sample >= getSensorCount()) {
+        return METRIC_ROW_END;
+      }
+      return formatSensorRow(family, sample, out, size);
+
+    case METRIC_TASK_STACK_FREE:
+      return formatTaskStackRow(sample, out, size);
+
+    case METRIC_HTTP_REQUEST_DURATION:
+    case METRIC_HTTP_RESPONSE_SIZE:
+    case METRIC_HTTP_HEAP_DELTA:
+      return formatHttpRow(family, sample, out, size);
+
+    case METRIC_TELEGRAM_TLS_HANDSHAKE:
+    case METRIC_TELEGRAM_TLS_HANDSHAKE_FAILURES:
+    case METRIC_TELEGRAM_CONNECTION_REUSED:
+      return formatTelegramConnectionRow(family, sample, out, size);
+
+    case METRIC_LOOP_DURATION: {
+      LoopStats stats;
+      getLoopStats(stats);
+      return formatSummaryRow(metric.name, sample, stats.totalUs / 1e6, stats.count, out, size);
+    }
+
+    case METRIC_TELEGRAM_SEND_DURATION: {
+      const LatencyStats& stats = getTelegramSendStats();
+      return formatSummaryRow(metric.name, sample, stats.totalMs / 1e3, stats.count, out, size);
+    }
+
+    case METRIC_TELEGRAM_QUEUE_WAIT: {
+      const LatencyStats& stats = getTelegramQueueWaitStats();
+      return formatSummaryRow(metric.name, sample, stats.totalMs / 1e3, stats.count, out, size);
+    }
+
+    case METRIC_MQTT_PUBLISH_DURATION: {
+      const LatencyStats& stats = getMqttPublishStats();
+      return formatSummaryRow(metric.name, sample, stats.totalMs / 1e3, stats.count, out, size);
+    }
+
+    case METRIC_SEND_PATH_ALLOCATIONS:
+      if (!isAllocProbeEnabled()) {
+        return METRIC_ROW_END; // Собрано без HEAP_ALLOC_PROBE: счетчик ничего бы не доказывал
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  // Остальные семейства - одно значение без меток
+  if (sample > 0) {
+    return METRIC_ROW_END;
+  }
+  double value = 0;
+  switch (family) {
+    case METRIC_UPTIME:
+      value = deviceUptime;
+      break;
+    case METRIC_SENSOR_COUNT:
+      value = getSensorCount();
+      break;
+    case METRIC_LOOP_DURATION_MAX: {
+      LoopStats stats;
+      getLoopStats(stats);
+      value = stats.recentMaxUs / 1e6;
+      break;
+    }
+    case METRIC_HEAP_FREE:
+      value = ESP.getFreeHeap();
+      break;
+    case METRIC_HEAP_MIN_FREE:
+      value = ESP.getMinFreeHeap();
+      break;
+    case METRIC_HEAP_LARGEST_BLOCK:
+      value = ESP.getMaxAllocHeap();
+      break;
+    case METRIC_TELEGRAM_QUEUE_DEPTH:
+      value = getTelegramQueueDepth();
+      break;
+    case METRIC_TELEGRAM_QUEUE_OLDEST_AGE: {
+      TelegramQueueStats stats;
+      getTelegramQueueStats(stats);
+      value = stats.oldestAgeMs / 1e3;
+      break;
+    }
+    case METRIC_TELEGRAM_QUEUE_EVICTED:
+    case METRIC_TELEGRAM_QUEUE_REJECTED: {
+      TelegramQueueStats stats;
+      getTelegramQueueStats(stats);
+      value = family == METRIC_TELEGRAM_QUEUE_EVICTED ? stats.evicted : stats.rejected;
+      break;
+    }
+    case METRIC_TELEGRAM_QUEUE_REPLACED: {
+      TelegramQueueStats stats;
+      getTelegramQueueStats(stats);
+      value = stats.replaced;
+      break;
+    }
+    case METRIC_TELEGRAM_OUTBOX_PENDING:
+    case METRIC_TELEGRAM_OUTBOX_CAPACITY:
+    case METRIC_TELEGRAM_OUTBOX_STORED:
+    case METRIC_TELEGRAM_OUTBOX_DELIVERED:
+    case METRIC_TELEGRAM_OUTBOX_DROPPED: {
+      OutboxStats stats;
+      getOutboxStats(stats);
+      value = family == METRIC_TELEGRAM_OUTBOX_PENDING ? stats.pending
+            : family == METRIC_TELEGRAM_OUTBOX_CAPACITY ? stats.capacity
+            : family == METRIC_TELEGRAM_OUTBOX_STORED ? stats.stored
+            : family == METRIC_TELEGRAM_OUTBOX_DELIVERED ? stats.delivered
+            : stats.dropped;
+      break;
+    }
+    case METRIC_TELEGRAM_SEND_FAILURES:
+      value = getTelegramSendStats().failures;
+      break;
+    case METRIC_MQTT_CONNECTED:
+      value = isMqttConnected() ? 1 : 0;
+      break;
+    case METRIC_MQTT_PUBLISH_FAILURES:
+      value = getMqttPublishStats().failures;
+      break;
+    case METRIC_MQTT_BACKLOG_PENDING:
+    case METRIC_MQTT_BACKLOG_CAPACITY:
+    case METRIC_MQTT_BACKLOG_STORED:
+    case METRIC_MQTT_BACKLOG_REPLAYED:
+    case METRIC_MQTT_BACKLOG_DROPPED: {
+      BacklogStats stats;
+      getBacklogStats(stats);
+      value = family == METRIC_MQTT_BACKLOG_PENDING ? stats.pending
+            : family == METRIC_MQTT_BACKLOG_CAPACITY ? stats.capacity
+            : family == METRIC_MQTT_BACKLOG_STORED ? stats.stored
+            : family == METRIC_MQTT_BACKLOG_REPLAYED ? stats.replayed
+            : stats.dropped;
+      break;
+    }
+    case METRIC_MQTT_COMMANDS_RECEIVED:
+    case METRIC_MQTT_COMMANDS_DROPPED:
+    case METRIC_MQTT_COMMANDS_FAILED: {
+      MqttCommandStats stats;
+      getMqttCommandStats(stats);
+      value = family == METRIC_MQTT_COMMANDS_RECEIVED ? stats.received
+            : family == METRIC_MQTT_COMMANDS_DROPPED ? stats.dropped
+            : stats.failed;
+      break;
+    }
+    case METRIC_SEND_PATH_ALLOCATIONS:
+      value = getSendPathAllocations();
+      break;
+    case METRIC_WIFI_CONNECTED:
+      value = (WiFi.status() == WL_CONNECTED) ? 1 : 0;
+      break;
+    case METRIC_WIFI_RSSI:
+      value = wifiRSSI;
+      break;
+  }
+  return rowPrintf(out, size, "%s %.10g\n", metric.name, value);
+}
+
+// Ответ /metrics: строки формируются по мере освобождения места в TCP-буфере,
+// в памяти - только текущая строка
+class MetricsResponse : public AsyncAbstractResponse {
+ public:
+  explicit MetricsResponse(bool chunked) : _family(0), _item(0), _rowLength(0), _rowOffset(0) {
+    _code = 200;
+    _contentType = "text/plain; version=0.0.4; charset=utf-8";
+    // Длина заранее неизвестна: HTTP/1.1 - chunked, HTTP/1.0 - до закрытия соединения
+    _sendContentLength = false;
+    _chunked = chunked;
+  }
+
+  bool _sourceValid() const override {
+    return true;
+  }
+
+  size_t _fillBuffer(uint8_t* buf, size_t maxLen) override {
+    size_t written = 0;
+    while (written < maxLen) {
+      if (_rowOffset >= _rowLength && !nextRow()) {
+        break;
+      }
+      size_t count = _rowLength - _rowOffset;
+      if (count > maxLen - written) {
+        count = maxLen - written;
+      }
+      memcpy(buf + written, _row + _rowOffset, count);
+      written += count;
+      _rowOffset += count;
+    }
+    return written;
+  }
+
+ private:
+  bool nextRow() {
+    while (_family < METRIC_FAMILY_COUNT) {
+      int length = formatMetricRow(_family, _item, _row, sizeof(_row));
+      if (length == METRIC_ROW_END) {
+        _family++;
+        _item = 0;
+        continue;
+      }
+      _item++;
+      if (length > 0) {
+        _rowLength = length;
+        _rowOffset = 0;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  int _family;
+  int _item;
+  char _row[METRICS_ROW_SIZE];
+  size_t _rowLength;
+  size_t _rowOffset;
+};
+
+void registerMetrics(AsyncWebServer& server) {
+  onRoute(server, METRICS_PATH, HTTP_GET, [](AsyncWebServerRequest *request) {
+    request->send(new MetricsResponse(request->version() > 0));
+  });
+
+  // Сброс статистики HTTP - для замеров до и после оптимизации
+  onRoute(server, METRICS_RESET_PATH, HTTP_POST, [](AsyncWebServerRequest *request) {
+    resetHttpStats();
+    sendJsonStatus(request, 200, "success", "HTTP statistics reset");
+  });
+}
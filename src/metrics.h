@@ -0,0 +1,27 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <ESPAsyncWebServer.h>
+#include <stdint.h>
+
+// Экспорт метрик в формате Prometheus (GET /metrics).
+// Ответ формируется построчно в буфер фиксированного размера внутри объекта ответа
+// и сразу уходит в TCP - без String, ArduinoJson и промежуточного текста целиком
+#define METRICS_PATH "/metrics"
+#define METRICS_RESET_PATH "/api/metrics/reset"  // POST: обнуляет статистику HTTP по маршрутам
+#define METRICS_ROW_SIZE 256             // Самая длинная строка: HELP + TYPE одного семейства
+
+// Длительность и исход повторяющейся операции (отправка в Telegram, публикация MQTT).
+// Пишет одна задача, читает обработчик /metrics; 32-битные поля читаются атомарно
+struct LatencyStats {
+  volatile uint32_t count;
+  volatile uint32_t failures;
+  volatile uint32_t totalMs;
+  volatile uint32_t lastMs;
+};
+
+void recordLatency(LatencyStats& stats, unsigned long durationMs, bool success);
+
+void registerMetrics(AsyncWebServer& server);
+
+#endif
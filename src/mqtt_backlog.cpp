@@ -0,0 +1,309 @@
+#include "mqtt_backlog.h"
+#include "alloc_probe.h"
+#include <SPIFFS.h>
+#include <stddef.h>
+#include <time.h>
+
+#define BACKLOG_HEADER_MAGIC 0x4B4C4251UL  // "QBLK"
+#define BACKLOG_HEADER_SIZE 16             // Место под заголовок в начале файла
+#define BACKLOG_ACK_WRITE_INTERVAL 32      // Повторенных записей между обновлениями заголовка
+
+struct BacklogHeader {
+  uint32_t magic;
+  uint32_t ackedSequence;                  // Записи с номером не больше - доставлены
+  uint32_t crc;
+};
+
+// Запись в файле (36 байт), место - по номеру: sequence % MQTT_BACKLOG_CAPACITY
+struct BacklogRecord {
+  uint32_t sequence;
+  uint32_t unixTime;
+  uint32_t uptimeSec;
+  float temperature;
+  char id[MQTT_BACKLOG_ID_SIZE];
+  uint32_t crc;
+};
+
+#define BACKLOG_FILE_SIZE (BACKLOG_HEADER_SIZE + MQTT_BACKLOG_CAPACITY * sizeof(BacklogRecord))
+static_assert(sizeof(BacklogHeader) <= BACKLOG_HEADER_SIZE, "MQTT backlog header does not fit");
+static_assert(MQTT_BACKLOG_CAPACITY % MQTT_BACKLOG_SPILL_BATCH == 0,
+              "The flash ring is read in MQTT_BACKLOG_SPILL_BATCH chunks");
+
+// Номера [firstPending; flashNext) - во flash, [flashNext; nextSequence) - в RAM.
+// getBacklogStats читает firstPending раньше nextSequence: оба только растут
+static BacklogRecord ramRecords[MQTT_BACKLOG_RAM_CAPACITY];
+static BacklogRecord recordBuffer[MQTT_BACKLOG_SPILL_BATCH];  // Чтение файла (не на стеке задачи)
+static volatile uint32_t nextSequence = 1;
+static volatile uint32_t firstPending = 1;
+static uint32_t flashNext = 1;
+static uint32_t persistedAcked = 0;
+static uint32_t bootFirstSequence = 1;     // Записи с меньшим номером сделаны до перезагрузки
+static unsigned long ramOldestMs = 0;      // Когда RAM перестала быть пустой
+static bool backlogAvailable = false;
+static uint32_t backlogStored = 0;
+static uint32_t backlogReplayed = 0;
+static uint32_t backlogDropped = 0;
+
+static uint32_t crc32(const uint8_t* data, size_t size) {
+  uint32_t crc = 0xFFFFFFFFUL;
+  for (size_t i = 0; i < size; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+static uint32_t recordCrc(const BacklogRecord& record) {
+  return crc32((const uint8_t*)&record, offsetof(BacklogRecord, crc));
+}
+
+static size_t slotOffset(uint32_t slot) {
+  return BACKLOG_HEADER_SIZE + slot * sizeof(BacklogRecord);
+}
+
+static bool readBytes(size_t offset, void* data, size_t size) {
+  File file = SPIFFS.open(MQTT_BACKLOG_FILE, "r");
+  if (!file) {
+    return false;
+  }
+  bool ok = file.seek(offset) && file.read((uint8_t*)data, size) == size;
+  file.close();
+  return ok;
+}
+
+static bool writeHeader(uint32_t ackedSequence) {
+  BacklogHeader header;
+  header.magic = BACKLOG_HEADER_MAGIC;
+  header.ackedSequence = ackedSequence;
+  header.crc = crc32((const uint8_t*)&header, offsetof(BacklogHeader, crc));
+  File file = SPIFFS.open(MQTT_BACKLOG_FILE, "r+");
+  if (!file) {
+    return false;
+  }
+  bool ok = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+  file.close();
+  return ok;
+}
+
+// Файл создается один раз полного размера: дальше записи только перезаписываются
+static bool createBacklogFile() {
+  File file = SPIFFS.open(MQTT_BACKLOG_FILE, "w");
+  if (!file) {
+    return false;
+  }
+  memset(recordBuffer, 0, sizeof(recordBuffer));
+  bool ok = file.write((const uint8_t*)recordBuffer, BACKLOG_HEADER_SIZE) == BACKLOG_HEADER_SIZE;
+  for (int i = 0; i < MQTT_BACKLOG_CAPACITY && ok; i += MQTT_BACKLOG_SPILL_BATCH) {
+    ok = file.write((const uint8_t*)recordBuffer, sizeof(recordBuffer)) == sizeof(recordBuffer);
+  }
+  file.close();
+  return ok && writeHeader(0);
+}
+
+void initMqttBacklog() {
+  File file = SPIFFS.open(MQTT_BACKLOG_FILE, "r");
+  size_t size = file ? file.size() : 0;
+  if (file) {
+    file.close();
+  }
+  if (size != BACKLOG_FILE_SIZE) {
+    backlogAvailable = createBacklogFile();
+    if (!backlogAvailable) {
+      Serial.println(F("ERROR: Failed to create MQTT backlog file"));
+    }
+    return;
+  }
+
+  BacklogHeader header;
+  uint32_t acked = 0;
+  if (readBytes(0, &header, sizeof(header)) && header.magic == BACKLOG_HEADER_MAGIC &&
+      header.crc == crc32((const uint8_t*)&header, offsetof(BacklogHeader, crc))) {
+    acked = header.ackedSequence;
+  }
+
+  uint32_t newest = acked;
+  uint32_t oldestPending = 0;
+  for (uint32_t slot = 0; slot < MQTT_BACKLOG_CAPACITY; slot += MQTT_BACKLOG_SPILL_BATCH) {
+    if (!readBytes(slotOffset(slot), recordBuffer, sizeof(recordBuffer))) {
+      Serial.println(F("ERROR: Failed to read MQTT backlog file"));
+      return;
+    }
+    for (int i = 0; i < MQTT_BACKLOG_SPILL_BATCH; i++) {
+      const BacklogRecord& record = recordBuffer[i];
+      if (record.sequence == 0 || record.crc != recordCrc(record)) {
+        continue;  // Пустая или недописанная запись (питание пропало во время записи)
+      }
+      if (record.sequence > newest) {
+        newest = record.sequence;
+      }
+      if (record.sequence > acked && (oldestPending == 0 || record.sequence < oldestPending)) {
+        oldestPending = record.sequence;
+      }
+    }
+  }
+
+  nextSequence = newest + 1;
+  flashNext = nextSequence;
+  bootFirstSequence = nextSequence;
+  persistedAcked = acked;
+  // В кольце - только последние MQTT_BACKLOG_CAPACITY номеров
+  uint32_t oldestInRing = nextSequence > MQTT_BACKLOG_CAPACITY ? nextSequence - MQTT_BACKLOG_CAPACITY : 1;
+  firstPending = oldestPending == 0 ? nextSequence
+               : (oldestPending > oldestInRing ? oldestPending : oldestInRing);
+  backlogAvailable = true;
+
+  if (firstPending < nextSequence) {
+    Serial.print(F("MQTT backlog: "));
+    Serial.print(nextSequence - firstPending);
+    Serial.println(F(" unsent reading(s) from before restart"));
+  }
+}
+
+void storeBacklogReading(const char* id, float temperature) {
+  if (nextSequence - flashNext >= MQTT_BACKLOG_RAM_CAPACITY) {
+    // Flash не пишется: вытесняется самая старая запись в RAM
+    if (firstPending == flashNext) {
+      firstPending = flashNext + 1;
+    }
+    flashNext++;
+    backlogDropped++;
+  }
+  if (nextSequence == flashNext) {
+    ramOldestMs = millis();
+  }
+
+  BacklogRecord& record = ramRecords[nextSequence % MQTT_BACKLOG_RAM_CAPACITY];
+  memset(&record, 0, sizeof(record));
+  time_t now = time(nullptr);
+  record.sequence = nextSequence;
+  record.unixTime = now > 1600000000 ? (uint32_t)now : 0;  // До синхронизации NTP - 1970 год
+  record.uptimeSec = millis() / 1000;
+  record.temperature = temperature;
+  strncpy(record.id, id, sizeof(record.id));
+  record.crc = recordCrc(record);
+  nextSequence = nextSequence + 1;
+  backlogStored++;
+}
+
+void flushMqttBacklog(bool force) {
+  uint32_t ramCount = nextSequence - flashNext;
+  if (!backlogAvailable || ramCount == 0) {
+    return;
+  }
+  if (!force && ramCount < MQTT_BACKLOG_SPILL_BATCH && millis() - ramOldestMs < MQTT_BACKLOG_SPILL_MS) {
+    return;
+  }
+  // SPIFFS выделяет память под дескриптор файла - вне учета пути отправки
+  bool probed = allocProbePause();
+
+  File file = SPIFFS.open(MQTT_BACKLOG_FILE, "r+");
+  bool ok = (bool)file;
+  while (ok && flashNext != nextSequence) {
+    // Подряд идущие записи (до конца кольца во flash или в RAM) - одной записью в файл
+    uint32_t sequence = flashNext;
+    uint32_t run = nextSequence - sequence;
+    uint32_t flashRoom = MQTT_BACKLOG_CAPACITY - sequence % MQTT_BACKLOG_CAPACITY;
+    uint32_t ramRoom = MQTT_BACKLOG_RAM_CAPACITY - sequence % MQTT_BACKLOG_RAM_CAPACITY;
+    if (run > flashRoom) {
+      run = flashRoom;
+    }
+    if (run > ramRoom) {
+      run = ramRoom;
+    }
+    size_t bytes = run * sizeof(BacklogRecord);
+    ok = file.seek(slotOffset(sequence % MQTT_BACKLOG_CAPACITY)) &&
+         file.write((const uint8_t*)&ramRecords[sequence % MQTT_BACKLOG_RAM_CAPACITY], bytes) == bytes;
+    if (!ok) {
+      break;
+    }
+    flashNext = sequence + run;
+    // Записи на круг старше перезаписаны: неповторенные среди них потеряны
+    if (flashNext > MQTT_BACKLOG_CAPACITY && flashNext - MQTT_BACKLOG_CAPACITY > firstPending) {
+      uint32_t oldestInRing = flashNext - MQTT_BACKLOG_CAPACITY;
+      backlogDropped += oldestInRing - firstPending;
+      firstPending = oldestInRing;
+      Serial.println(F("MQTT backlog full, oldest readings overwritten"));
+    }
+  }
+  if (file) {
+    file.close();
+  }
+  if (!ok) {
+    Serial.println(F("ERROR: Failed to write MQTT backlog"));
+  }
+  ramOldestMs = millis();  // После ошибки - повтор не раньше чем через MQTT_BACKLOG_SPILL_MS
+  allocProbeResume(probed);
+}
+
+bool peekBacklogReading(BacklogReading& reading) {
+  while (firstPending < nextSequence) {
+    uint32_t sequence = firstPending;
+    const BacklogRecord* record = &ramRecords[sequence % MQTT_BACKLOG_RAM_CAPACITY];
+    if (sequence < flashNext) {
+      bool probed = allocProbePause();
+      bool ok = readBytes(slotOffset(sequence % MQTT_BACKLOG_CAPACITY), &recordBuffer[0], sizeof(BacklogRecord));
+      allocProbeResume(probed);
+      if (!ok || recordBuffer[0].crc != recordCrc(recordBuffer[0])) {
+        // Запись испорчена - пропускаем, иначе она заблокировала бы остальные
+        firstPending = sequence + 1;
+        backlogDropped++;
+        continue;
+      }
+      if (recordBuffer[0].sequence != sequence) {
+        firstPending = sequence + 1;  // Вытеснена из RAM до сохранения (уже учтена в dropped)
+        continue;
+      }
+      record = &recordBuffer[0];
+    }
+
+    reading.sequence = sequence;
+    reading.unixTime = record->unixTime;
+    reading.uptimeSec = record->uptimeSec;
+    reading.temperature = record->temperature;
+    memcpy(reading.id, record->id, MQTT_BACKLOG_ID_SIZE);
+    reading.id[MQTT_BACKLOG_ID_SIZE] = '\0';
+    if (reading.unixTime == 0 && sequence >= bootFirstSequence) {
+      // Измерено до синхронизации часов в этой же загрузке - время восстанавливается по uptime
+      time_t now = time(nullptr);
+      if (now > 1600000000) {
+        reading.unixTime = (uint32_t)now - (millis() / 1000 - reading.uptimeSec);
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+void markBacklogReplayed(uint32_t sequence) {
+  if (sequence < firstPending || sequence >= nextSequence) {
+    return;
+  }
+  firstPending = sequence + 1;
+  backlogReplayed++;
+  if (flashNext < firstPending) {
+    flashNext = firstPending;  // Повторено из RAM раньше, чем попало во flash
+  }
+
+  uint32_t acked = sequence;
+  bool caughtUp = firstPending == nextSequence;
+  if (backlogAvailable && acked != persistedAcked &&
+      (caughtUp || acked - persistedAcked >= BACKLOG_ACK_WRITE_INTERVAL)) {
+    bool probed = allocProbePause();
+    if (writeHeader(acked)) {
+      persistedAcked = acked;
+    }
+    allocProbeResume(probed);
+  }
+}
+
+void getBacklogStats(BacklogStats& stats) {
+  uint32_t first = firstPending;
+  stats.pending = nextSequence - first;
+  stats.capacity = MQTT_BACKLOG_CAPACITY;
+  stats.stored = backlogStored;
+  stats.replayed = backlogReplayed;
+  stats.dropped = backlogDropped;
+  stats.available = backlogAvailable;
+}
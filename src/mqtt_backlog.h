@@ -0,0 +1,59 @@
+#ifndef MQTT_BACKLOG_H
+#define MQTT_BACKLOG_H
+
+#include <Arduino.h>
+
+// Показания термометров, которые не удалось опубликовать (нет Wi-Fi или брокера, брокер
+// не подтвердил QoS 1), копятся с временем измерения и после подключения повторяются
+// по порядку в <base>/backlog.
+// Новые записи собираются в RAM и пишутся во flash пакетами (MQTT_BACKLOG_SPILL_BATCH
+// записей или раз в MQTT_BACKLOG_SPILL_MS): при пропаже питания теряется не больше минуты.
+// Файл - кольцо из MQTT_BACKLOG_CAPACITY записей фиксированного размера, созданное один раз;
+// место записи определяется ее номером. При переполнении перезаписываются самые старые
+// (счетчик dropped). Подтвержденный номер хранится в заголовке файла и обновляется
+// пакетами: после перезагрузки часть уже доставленных записей может прийти повторно
+// (как и при QoS 1) - получатель отбрасывает их по sequence.
+// Все функции, кроме getBacklogStats, вызываются только из задачи MQTT
+#define MQTT_BACKLOG_FILE "/mqtt_backlog.bin"
+#define MQTT_BACKLOG_CAPACITY 1024         // Записей во flash (36 КБ)
+#define MQTT_BACKLOG_RAM_CAPACITY 32       // Записей, ожидающих сохранения во flash
+#define MQTT_BACKLOG_SPILL_BATCH 16
+#define MQTT_BACKLOG_SPILL_MS 60000UL
+#define MQTT_BACKLOG_ID_SIZE 16            // Адрес термометра в hex без разделителей
+
+struct BacklogReading {
+  uint32_t sequence;                       // Порядковый номер (по возрастанию - порядок измерений)
+  uint32_t unixTime;                       // Время измерения, 0 - часы не были синхронизированы
+  uint32_t uptimeSec;                      // Время от запуска на момент измерения
+  float temperature;
+  char id[MQTT_BACKLOG_ID_SIZE + 1];
+};
+
+struct BacklogStats {
+  int pending;                             // Ожидают повтора (RAM и flash)
+  int capacity;
+  uint32_t stored;                         // Сохранено с момента загрузки
+  uint32_t replayed;                       // Повторено с подтверждением брокера
+  uint32_t dropped;                        // Перезаписаны до повтора, испорчены или не сохранены
+  bool available;                          // Файл открыт (SPIFFS смонтирован)
+};
+
+// Чтение файла при старте (после монтирования SPIFFS)
+void initMqttBacklog();
+
+// Сохранить показание в RAM; во flash оно попадет с ближайшим пакетом
+void storeBacklogReading(const char* id, float temperature);
+
+// Запись накопленного в RAM во flash, если набран пакет или самая старая запись
+// ждет дольше MQTT_BACKLOG_SPILL_MS (force - сразу)
+void flushMqttBacklog(bool force);
+
+// Самое старое неповторенное показание. false - повторять нечего
+bool peekBacklogReading(BacklogReading& reading);
+
+// Брокер подтвердил запись: следующей будет выдана запись с большим номером
+void markBacklogReplayed(uint32_t sequence);
+
+void getBacklogStats(BacklogStats& stats);
+
+#endif
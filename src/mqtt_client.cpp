@@ -1,29 +1,463 @@
 #include "mqtt_client.h"
 #include <WiFi.h>
-#include <PubSubClient.h>
+#include <MQTTClient.h>
 #include <esp_task_wdt.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "settings_store.h"
+#include "metrics.h"
+#include "text_buffer.h"
+#include "alloc_probe.h"
+#include "net_health.h"
+#include "sensor_config.h"
+#include "mqtt_backlog.h"
+#include "mqtt_commands.h"
+
+// Буферы пакета MQTTClient (чтение и запись, по MQTT_BUFFER_SIZE) выделяются один раз при запуске.
+// Публикация QoS 1 возвращает true только после PUBACK брокера
+#define MQTT_BUFFER_SIZE 1024
+#define MQTT_ACK_TIMEOUT_MS 5000    // Ожидание CONNACK/PUBACK
+
+#define MQTT_CLIENT_LOCK_MS 200     // Ожидание клиента публикацией из другой задачи
 
 WiFiClient wifiClient;
-PubSubClient mqttClient(wifiClient);
+MQTTClient mqttClient(MQTT_BUFFER_SIZE);
+// Клиентом пользуются задача MQTT и основной цикл (метрики, тест): пакеты не должны
+// перемешиваться в общем буфере записи, пока задача ждет PUBACK
+static SemaphoreHandle_t mqttClientMutex = NULL;
 
-// Ограничение частоты переподключений
-static unsigned long lastMqttConnectAttempt = 0;
-static const unsigned long MQTT_RECONNECT_INTERVAL = 30000; // 30 сек между попытками
+// Переподключение: первая попытка после обрыва - сразу, после неудачи - пауза
+// от 5 с до 5 минут, удваивается с каждой неудачей подряд
+static CircuitBreaker mqttBreaker = CIRCUIT_BREAKER("mqtt", 1, 5000, 300000);
 
 // FreeRTOS task handle для MQTT
 TaskHandle_t mqttTaskHandle = NULL;
 volatile bool mqttTaskRunning = false;
 
-static String mqttServer = "";
-static int mqttPort = 1883;
-static String mqttUser = "";
-static String mqttPassword = "";
-static String mqttTopicStatus = "";
-static String mqttTopicControl = "";
-static String mqttSecurity = "none";
-static bool mqttConfigured = false;
+// Настройки клиента в буферах фиксированного размера. setMqttConfig/disableMqtt (loop, async_tcp)
+// кладут новую версию в mqttPendingConfig и будят задачу MQTT, она применяет ее сама
+// (applyMqttConfig): задача пользуется строками mqttConfig без блокировки, а соединение
+// со старым брокером закрывает, не задерживая вызвавшую задачу.
+// mqttConfig меняется только задачей MQTT и под mqttClientMutex: другие задачи читают
+// топик статуса только под ним (publishMeasured с topic = NULL)
+struct MqttConfig {
+  char server[sizeof(DeviceSettings::mqttServer)];
+  int port;
+  char user[sizeof(DeviceSettings::mqttUser)];
+  char password[sizeof(DeviceSettings::mqttPassword)];
+  char topicStatus[sizeof(DeviceSettings::mqttTopicStatus)];
+  char topicControl[sizeof(DeviceSettings::mqttTopicControl)];
+  char security[sizeof(DeviceSettings::mqttSecurity)];
+  bool configured;
+};
+static MqttConfig mqttConfig = {"", 1883, "", "", "", "", "none", false};
+static MqttConfig mqttPendingConfig = {"", 1883, "", "", "", "", "none", false};
+static portMUX_TYPE mqttConfigMux = portMUX_INITIALIZER_UNLOCKED;
+static volatile uint32_t mqttConfigRequested = 0;  // Растет с каждым setMqttConfig/disableMqtt
+static uint32_t mqttConfigApplied = 0;             // Только задача MQTT
+static volatile bool mqttConfigured = false;       // Последняя запрошенная версия (для статуса)
+static LatencyStats mqttPublishStats = {0, 0, 0, 0};
+
+// Полезная нагрузка собирается в буфере на стеке: публикация не выделяет heap
+#define MQTT_PAYLOAD_SIZE 256
+#define MQTT_TOPIC_MAX (sizeof(DeviceSettings::mqttTopicStatus) - 1)
+// Заголовок пакета (до 5 байт) + длина топика (2 байта) + топик + нагрузка
+static_assert(5 + 2 + MQTT_TOPIC_MAX + MQTT_PAYLOAD_SIZE - 1 <= MQTT_BUFFER_SIZE,
+              "MQTT payload with the longest topic does not fit into the packet buffer");
+
+// Телеметрия по термометрам: <base>/<id>/temperature, где base - топик статуса без последнего
+// уровня ("home/thermo/status" -> "home/thermo"), id - адрес термометра (16 hex-цифр).
+// Показание публикуется с QoS 1 при изменении на MQTT_TEMPERATURE_DEADBAND и не реже раза
+// в MQTT_SENSOR_HEARTBEAT_MS; без связи или без PUBACK - сохраняется в backlog (mqtt_backlog.h). Конфиг обнаружения Home Assistant (retained) - после каждого
+// подключения и при смене имени. Топики всех термометров собраны в одном статическом буфере,
+// нагрузка - в статических TextBuffer: публикация не выделяет heap
+#define MQTT_TEMPERATURE_DEADBAND 0.2f
+#define MQTT_SENSOR_HEARTBEAT_MS 300000UL
+#define MQTT_SENSOR_STALE_MS 60000UL      // Без новых показаний дольше - термометр не публикуется
+#define MQTT_SENSOR_EXPIRE_SEC 900        // expire_after в Home Assistant: 3 пропущенных heartbeat
+#define MQTT_DISCOVERY_PREFIX "homeassistant"
+#define MQTT_SENSOR_ID_SIZE 17            // 8 байт адреса в hex + \0
+#define MQTT_SENSOR_NAME_SIZE sizeof(StoredSensorConfig::name)
+#define MQTT_SENSOR_TOPIC_SIZE (MQTT_TOPIC_MAX + TEXT_LITERAL_LEN("/") + MQTT_SENSOR_ID_SIZE - 1 + \
+                                TEXT_LITERAL_LEN("/temperature") + 1)
+#define MQTT_DISCOVERY_TOPIC_SIZE (TEXT_LITERAL_LEN(MQTT_DISCOVERY_PREFIX "/sensor/thermo_/config") + \
+                                   MQTT_SENSOR_ID_SIZE)
+#define MQTT_DISCOVERY_SIZE 768
+// Имя без управляющих символов экранируется не длиннее чем вдвое ("), остальное - константы
+static_assert(TEXT_LITERAL_LEN("{\"name\":\"\",\"unique_id\":\"thermo_\",\"object_id\":\"thermo_\","
+                               "\"state_topic\":\"\",\"device_class\":\"temperature\","
+                               "\"state_class\":\"measurement\",\"unit_of_measurement\":\"°C\","
+                               "\"expire_after\":,\"device\":{\"identifiers\":[\"thermo_\"],"
+                               "\"name\":\"ESP32 Thermo\",\"manufacturer\":\"Espressif\","
+                               "\"model\":\"ESP32 Temperature Monitor\"}}") +
+              2 * (MQTT_SENSOR_NAME_SIZE - 1) + 2 * (MQTT_SENSOR_ID_SIZE - 1) + MQTT_SENSOR_TOPIC_SIZE - 1 +
+              10 + 12 < MQTT_DISCOVERY_SIZE,
+              "MQTT_DISCOVERY_SIZE is too small for the discovery config");
+static_assert(MQTT_SENSOR_ID_SIZE == MQTT_BACKLOG_ID_SIZE + 1, "Backlog records keep the full sensor id");
+static_assert(5 + 2 + MQTT_DISCOVERY_TOPIC_SIZE - 1 + MQTT_DISCOVERY_SIZE - 1 <= MQTT_BUFFER_SIZE,
+              "Home Assistant discovery config does not fit into the packet buffer");
+
+// Показания от loop(); revision растет при смене термометра или имени
+struct MqttSensorReading {
+  char id[MQTT_SENSOR_ID_SIZE];
+  char name[MQTT_SENSOR_NAME_SIZE];
+  float temperature;
+  unsigned long reportedMs;
+  uint32_t revision;
+};
+static MqttSensorReading mqttSensorReadings[MAX_SENSORS];
+static SemaphoreHandle_t mqttSensorMutex = NULL;
+
+// Состояние публикации - только задача MQTT
+struct MqttSensorPublishState {
+  char topicId[MQTT_SENSOR_ID_SIZE];  // id, для которого собран топик
+  uint32_t topicsGeneration;
+  uint32_t discoveredRevision;
+  uint32_t discoveredConnection;
+  uint32_t publishedRevision;
+  float publishedTemperature;
+  unsigned long publishedMs;
+  bool backlogged;                    // Последнее показание ушло в backlog, а не в топик
+};
+static MqttSensorPublishState mqttSensorPublish[MAX_SENSORS];
+static char mqttSensorTopics[MAX_SENSORS * MQTT_SENSOR_TOPIC_SIZE];
+static volatile uint32_t mqttTopicsGeneration = 1;  // Растет при смене топика статуса
+static uint32_t mqttConnectionEpoch = 0;            // Растет при каждом подключении
+static char mqttDeviceId[13] = "";                  // MAC без разделителей
+
+// Повтор накопленного: не больше MQTT_BACKLOG_REPLAY_BATCH записей за итерацию задачи (1 с),
+// после текущих показаний - повтор не задерживает их публикацию
+#define MQTT_BACKLOG_REPLAY_BATCH 10
+#define MQTT_BACKLOG_TOPIC_SIZE (MQTT_TOPIC_MAX + TEXT_LITERAL_LEN("/backlog") + 1)
+#define MQTT_BACKLOG_PAYLOAD_SIZE 128
+// Номер, время и uptime - до 10 цифр, температура (addFloat) - до 12 символов
+static_assert(TEXT_LITERAL_LEN("{\"sensor\":\"\",\"sequence\":,\"time\":,\"uptime\":,\"temperature\":}") +
+              MQTT_BACKLOG_ID_SIZE + 3 * 10 + 12 < MQTT_BACKLOG_PAYLOAD_SIZE,
+              "MQTT backlog payload does not fit into MQTT_BACKLOG_PAYLOAD_SIZE");
+
+// Команды из топика управления (mqtt_commands.h): подписка с QoS 1 после каждого подключения
+// и при смене топика, ответы - в <base>/reply с QoS 1
+#define MQTT_REPLY_TOPIC_SIZE (MQTT_TOPIC_MAX + TEXT_LITERAL_LEN("/reply") + 1)
+static_assert(5 + 2 + MQTT_REPLY_TOPIC_SIZE - 1 + MQTT_REPLY_SIZE - 1 <= MQTT_BUFFER_SIZE,
+              "MQTT command reply does not fit into the packet buffer");
+static char mqttSubscribedTopic[sizeof(DeviceSettings::mqttTopicControl)] = "";
+static uint32_t mqttSubscribedConnection = 0;
+
+// publish с учетом длительности для /metrics. qos 1 - ожидание PUBACK (до MQTT_ACK_TIMEOUT_MS).
+// topic NULL - топик статуса: из других задач он читается только здесь, под мьютексом клиента
+static bool publishMeasured(const char* topic, const char* payload, bool retained = false, int qos = 0) {
+  unsigned long start = millis();
+  if (mqttClientMutex == NULL || xSemaphoreTake(mqttClientMutex, pdMS_TO_TICKS(MQTT_CLIENT_LOCK_MS)) != pdTRUE) {
+    recordLatency(mqttPublishStats, millis() - start, false);
+    return false;
+  }
+  if (topic == NULL) {
+    topic = mqttConfig.configured ? mqttConfig.topicStatus : "";
+  }
+  bool result = topic[0] != '\0' && mqttClient.publish(topic, payload, retained, qos);
+  xSemaphoreGive(mqttClientMutex);
+  recordLatency(mqttPublishStats, millis() - start, result);
+  return result;
+}
+
+const LatencyStats& getMqttPublishStats() {
+  return mqttPublishStats;
+}
+
+CircuitBreaker& getMqttBreaker() {
+  return mqttBreaker;
+}
+
+void reportMqttSensorReading(int index, const char* address, const char* name, float temperature) {
+  if (index < 0 || index >= MAX_SENSORS || mqttSensorMutex == NULL) {
+    return;
+  }
+  // "28:FF:12:..." -> "28ff12..."
+  char id[MQTT_SENSOR_ID_SIZE];
+  size_t length = 0;
+  for (const char* p = address; *p != '\0' && length < sizeof(id) - 1; p++) {
+    if (isxdigit((unsigned char)*p)) {
+      id[length++] = tolower((unsigned char)*p);
+    }
+  }
+  id[length] = '\0';
+  if (length == 0) {
+    return;
+  }
+
+  // Задача MQTT держит мьютекс только на время копирования
+  if (xSemaphoreTake(mqttSensorMutex, pdMS_TO_TICKS(10)) != pdTRUE) {
+    return;
+  }
+  MqttSensorReading& reading = mqttSensorReadings[index];
+  if (strcmp(reading.id, id) != 0 || strncmp(reading.name, name, sizeof(reading.name) - 1) != 0) {
+    strlcpy(reading.id, id, sizeof(reading.id));
+    strlcpy(reading.name, name, sizeof(reading.name));
+    reading.revision++;
+  }
+  reading.temperature = temperature;
+  reading.reportedMs = millis();
+  xSemaphoreGive(mqttSensorMutex);
+}
+
+// База топиков телеметрии: топик статуса без последнего уровня
+static size_t telemetryBaseLength() {
+  const char* status = mqttConfig.topicStatus;
+  const char* lastLevel = strrchr(status, '/');
+  return lastLevel != NULL ? (size_t)(lastLevel - status) : strlen(status);
+}
+
+// Топик показаний термометра в общем буфере; пересобирается при смене термометра или топика статуса
+static const char* sensorStateTopic(int index, const char* id) {
+  MqttSensorPublishState& state = mqttSensorPublish[index];
+  char* topic = mqttSensorTopics + index * MQTT_SENSOR_TOPIC_SIZE;
+  uint32_t generation = mqttTopicsGeneration;
+  if (state.topicsGeneration != generation || strcmp(state.topicId, id) != 0) {
+    TextBuilder builder(topic, MQTT_SENSOR_TOPIC_SIZE);
+    builder.addBytes(mqttConfig.topicStatus, telemetryBaseLength()).add('/').add(id).add("/temperature");
+    strlcpy(state.topicId, id, sizeof(state.topicId));
+    state.topicsGeneration = generation;
+    state.discoveredRevision = 0;  // Новый топик показаний - конфиг обнаружения публикуется заново
+    state.publishedRevision = 0;
+  }
+  return topic;
+}
+
+const char* getMqttDeviceId() {
+  if (mqttDeviceId[0] == '\0') {
+    uint8_t mac[6];
+    WiFi.macAddress(mac);
+    snprintf(mqttDeviceId, sizeof(mqttDeviceId), "%02x%02x%02x%02x%02x%02x",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+  }
+  return mqttDeviceId;
+}
+
+// Конфиг обнаружения Home Assistant (retained). false - публикация не удалась
+static bool publishSensorDiscovery(const MqttSensorReading& reading, const char* stateTopic) {
+  getMqttDeviceId();
+
+  static TextBuffer<MQTT_DISCOVERY_TOPIC_SIZE> topic;
+  static TextBuffer<MQTT_DISCOVERY_SIZE> payload;
+  topic.clear();
+  topic.add(MQTT_DISCOVERY_PREFIX "/sensor/thermo_").add(reading.id).add("/config");
+  payload.clear();
+  payload.add("{\"name\":").addJsonString(reading.name[0] != '\0' ? reading.name : reading.id);
+  payload.add(",\"unique_id\":\"thermo_").add(reading.id);
+  payload.add("\",\"object_id\":\"thermo_").add(reading.id);
+  payload.add("\",\"state_topic\":").addJsonString(stateTopic);
+  payload.add(",\"device_class\":\"temperature\",\"state_class\":\"measurement\","
+              "\"unit_of_measurement\":\"°C\",\"expire_after\":").addUInt(MQTT_SENSOR_EXPIRE_SEC);
+  payload.add(",\"device\":{\"identifiers\":[\"thermo_").add(mqttDeviceId);
+  payload.add("\"],\"name\":\"ESP32 Thermo\",\"manufacturer\":\"Espressif\","
+              "\"model\":\"ESP32 Temperature Monitor\"}}");
+  if (payload.truncated()) {
+    // Имя из одних управляющих символов - конфиг не публикуем, показания идут без него
+    Serial.print(F("MQTT: discovery config too long for sensor "));
+    Serial.println(reading.id);
+    return true;
+  }
+  return publishMeasured(topic.c_str(), payload.c_str(), true);
+}
+
+// Публикация показаний термометров (задача MQTT, и без подключения). Показание QoS 1
+// без подтверждения брокера, как и показания без связи, уходит в backlog.
+// После первой неудачной публикации остальные показания прохода - сразу в backlog
+static void publishMqttSensors() {
+  if (mqttSensorMutex == NULL || !mqttConfig.configured) {
+    return;
+  }
+  bool online = mqttClient.connected() && mqttConfig.topicStatus[0] != '\0';
+  bool probe = allocProbeBegin();
+  unsigned long now = millis();
+  for (int i = 0; i < MAX_SENSORS; i++) {
+    MqttSensorReading reading;
+    if (xSemaphoreTake(mqttSensorMutex, pdMS_TO_TICKS(50)) != pdTRUE) {
+      break;
+    }
+    reading = mqttSensorReadings[i];
+    xSemaphoreGive(mqttSensorMutex);
+    if (reading.revision == 0 || now - reading.reportedMs > MQTT_SENSOR_STALE_MS) {
+      continue;
+    }
+
+    MqttSensorPublishState& state = mqttSensorPublish[i];
+    const char* topic = online ? sensorStateTopic(i, reading.id) : NULL;
+    if (online && (state.discoveredRevision != reading.revision ||
+                   state.discoveredConnection != mqttConnectionEpoch)) {
+      if (publishSensorDiscovery(reading, topic)) {
+        state.discoveredRevision = reading.revision;
+        state.discoveredConnection = mqttConnectionEpoch;
+      } else {
+        online = false;
+      }
+    }
+
+    // Показание из backlog обновляет retained-значение сразу после подключения
+    bool changed = state.publishedRevision != reading.revision ||
+                   fabsf(reading.temperature - state.publishedTemperature) >= MQTT_TEMPERATURE_DEADBAND ||
+                   (online && state.backlogged);
+    if (!changed && now - state.publishedMs < MQTT_SENSOR_HEARTBEAT_MS) {
+      continue;
+    }
+    TextBuffer<16> payload;
+    payload.addFloat(reading.temperature, 2);
+    if (online && publishMeasured(topic, payload.c_str(), true, 1)) {
+      state.backlogged = false;
+    } else {
+      online = false;
+      storeBacklogReading(reading.id, reading.temperature);
+      state.backlogged = true;
+    }
+    state.publishedRevision = reading.revision;
+    state.publishedTemperature = reading.temperature;
+    state.publishedMs = now;
+  }
+  allocProbeEnd(probe);
+}
+
+// Повтор накопленных показаний по порядку в <base>/backlog (QoS 1, задача MQTT при подключении).
+// Запись считается доставленной после PUBACK; без подтверждения повтор - на следующей итерации
+static void replayMqttBacklog() {
+  if (!mqttClient.connected() || mqttConfig.topicStatus[0] == '\0') {
+    return;
+  }
+  static TextBuffer<MQTT_BACKLOG_TOPIC_SIZE> topic;
+  static TextBuffer<MQTT_BACKLOG_PAYLOAD_SIZE> payload;
+  topic.clear();
+  topic.addBytes(mqttConfig.topicStatus, telemetryBaseLength()).add("/backlog");
+
+  bool probe = allocProbeBegin();
+  BacklogReading reading;
+  for (int n = 0; n < MQTT_BACKLOG_REPLAY_BATCH && peekBacklogReading(reading); n++) {
+    payload.clear();
+    payload.add("{\"sensor\":\"").add(reading.id);
+    payload.addf("\",\"sequence\":%lu,\"time\":%lu,\"uptime\":%lu,\"temperature\":",
+                 (unsigned long)reading.sequence, (unsigned long)reading.unixTime,
+                 (unsigned long)reading.uptimeSec);
+    payload.addFloat(reading.temperature, 2).add('}');
+    if (!publishMeasured(topic.c_str(), payload.c_str(), false, 1)) {
+      break;
+    }
+    markBacklogReplayed(reading.sequence);
+  }
+  allocProbeEnd(probe);
+}
+
+// Обработчик входящих сообщений (задача MQTT, внутри loop()/publish клиента): публиковать
+// отсюда нельзя, команда только копируется в очередь основного цикла
+static void onMqttMessage(MQTTClient* client, char topic[], char bytes[], int length) {
+  (void)client;
+  if (mqttSubscribedTopic[0] == '\0' || strcmp(topic, mqttSubscribedTopic) != 0) {
+    return;
+  }
+  queueMqttCommand(bytes, length);
+}
+
+// Подписка на топик управления: заново после каждого подключения (чистая сессия) и при смене топика
+static void syncControlSubscription() {
+  if (!mqttClient.connected()) {
+    return;
+  }
+  const char* topic = mqttConfig.topicControl;
+  if (mqttSubscribedConnection == mqttConnectionEpoch && strcmp(mqttSubscribedTopic, topic) == 0) {
+    return;
+  }
+  if (xSemaphoreTake(mqttClientMutex, pdMS_TO_TICKS(MQTT_CLIENT_LOCK_MS)) != pdTRUE) {
+    return;
+  }
+  bool ok = true;
+  if (mqttSubscribedConnection == mqttConnectionEpoch && mqttSubscribedTopic[0] != '\0') {
+    mqttClient.unsubscribe(mqttSubscribedTopic);
+  }
+  mqttSubscribedTopic[0] = '\0';
+  if (topic[0] != '\0') {
+    ok = mqttClient.subscribe(topic, 1);
+  }
+  xSemaphoreGive(mqttClientMutex);
+  if (!ok) {
+    Serial.println(F("MQTT: control topic subscribe failed"));
+    return;  // Повтор на следующей итерации
+  }
+  strlcpy(mqttSubscribedTopic, topic, sizeof(mqttSubscribedTopic));
+  mqttSubscribedConnection = mqttConnectionEpoch;
+  if (topic[0] != '\0') {
+    Serial.print(F("MQTT subscribed to "));
+    Serial.println(topic);
+  }
+}
+
+void notifyMqttReplyReady() {
+  if (mqttTaskHandle != NULL) {
+    xTaskNotifyGive(mqttTaskHandle);
+  }
+}
+
+// Ответы на команды по порядку (QoS 1). Без связи или PUBACK ответ ждет следующей итерации;
+// очередь ответов короткая, и основной цикл не выполняет новые команды, пока она полна
+static void publishMqttReplies() {
+  static char pending[MQTT_REPLY_SIZE];
+  static bool hasPending = false;
+  static TextBuffer<MQTT_REPLY_TOPIC_SIZE> topic;
+  if (!mqttClient.connected() || mqttConfig.topicStatus[0] == '\0') {
+    return;
+  }
+  topic.clear();
+  topic.addBytes(mqttConfig.topicStatus, telemetryBaseLength()).add("/reply");
+  while (hasPending || takeMqttReply(pending)) {
+    hasPending = true;
+    if (!publishMeasured(topic.c_str(), pending, false, 1)) {
+      return;
+    }
+    hasPending = false;
+  }
+}
+
+// Применение настроек, запрошенных другими задачами (задача MQTT)
+static void applyMqttConfig() {
+  if (mqttConfigRequested == mqttConfigApplied) {
+    return;
+  }
+  static MqttConfig next;  // Не на стеке задачи
+  portENTER_CRITICAL(&mqttConfigMux);
+  memcpy(&next, &mqttPendingConfig, sizeof(next));
+  uint32_t requested = mqttConfigRequested;
+  portEXIT_CRITICAL(&mqttConfigMux);
+
+  // Соединение закрывается при отключении и смене брокера; смена топиков - без переподключения
+  bool brokerChanged = !next.configured ||
+                       strcmp(next.server, mqttConfig.server) != 0 || next.port != mqttConfig.port ||
+                       strcmp(next.user, mqttConfig.user) != 0 || strcmp(next.password, mqttConfig.password) != 0;
+  // Ожидание ограничено таймаутом PUBACK у публикации из основного цикла
+  xSemaphoreTake(mqttClientMutex, portMAX_DELAY);
+  if (brokerChanged && mqttClient.connected()) {
+    mqttClient.disconnect();
+  }
+  memcpy(&mqttConfig, &next, sizeof(mqttConfig));
+  xSemaphoreGive(mqttClientMutex);
+  mqttConfigApplied = requested;
+  mqttTopicsGeneration++;
+  if (mqttConfig.configured) {
+    breakerReset(mqttBreaker); // Новый брокер - подключаемся сразу
+  }
+}
+
+// Новая версия настроек для задачи MQTT (любая задача). config NULL - отключение
+static void requestMqttConfig(const MqttConfig* config) {
+  portENTER_CRITICAL(&mqttConfigMux);
+  if (config != NULL) {
+    memcpy(&mqttPendingConfig, config, sizeof(mqttPendingConfig));
+  } else {
+    mqttPendingConfig.configured = false;
+  }
+  mqttConfigRequested++;
+  portEXIT_CRITICAL(&mqttConfigMux);
+  mqttConfigured = config != NULL && config->configured;
+  if (mqttTaskHandle != NULL) {
+    xTaskNotifyGive(mqttTaskHandle);
+  }
+}
 
 // FreeRTOS задача для обработки MQTT подключения
 // Работает в фоне, не блокирует основной loop()
@@ -32,16 +466,22 @@ void mqttTask(void* parameter) {
   mqttTaskRunning = true;
 
   while (true) {
-    // Ждём 1 секунду между итерациями
-    vTaskDelay(pdMS_TO_TICKS(1000));
+    // Ждём 1 секунду между итерациями; готовый ответ на команду будит задачу раньше
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
 
-    // Проверяем, что WiFi подключен
-    if (WiFi.status() != WL_CONNECTED) {
-      continue;
+    applyMqttConfig();
+
+    // Обновляем MQTT (подключение/loop), если WiFi подключен
+    if (WiFi.status() == WL_CONNECTED) {
+      updateMqtt();
+      syncControlSubscription();
     }
 
-    // Обновляем MQTT (подключение/loop)
-    updateMqtt();
+    publishMqttReplies();
+    // Показания термометров - и без связи: тогда они копятся в backlog
+    publishMqttSensors();
+    replayMqttBacklog();
+    flushMqttBacklog(false);
 
     // Короткая пауза для yield
     vTaskDelay(pdMS_TO_TICKS(10));
@@ -51,9 +491,51 @@ void mqttTask(void* parameter) {
   vTaskDelete(NULL);
 }
 
+// Применение измененных настроек MQTT (вызывается из main loop)
+static void onMqttSettingsChanged(uint32_t changedSections) {
+  (void)changedSections;
+  char server[sizeof(DeviceSettings::mqttServer)];
+  char user[sizeof(DeviceSettings::mqttUser)];
+  char password[sizeof(DeviceSettings::mqttPassword)];
+  char topicStatus[sizeof(DeviceSettings::mqttTopicStatus)];
+  char topicControl[sizeof(DeviceSettings::mqttTopicControl)];
+  char security[sizeof(DeviceSettings::mqttSecurity)];
+  int port;
+
+  if (!lockSettings(pdMS_TO_TICKS(1000))) {
+    return;
+  }
+  const DeviceSettings& settings = settingsRef();
+  strlcpy(server, settings.mqttServer, sizeof(server));
+  strlcpy(user, settings.mqttUser, sizeof(user));
+  strlcpy(password, settings.mqttPassword, sizeof(password));
+  strlcpy(topicStatus, settings.mqttTopicStatus, sizeof(topicStatus));
+  strlcpy(topicControl, settings.mqttTopicControl, sizeof(topicControl));
+  strlcpy(security, settings.mqttSecurity, sizeof(security));
+  port = settings.mqttPort;
+  unlockSettings();
+
+  if (server[0] == '\0') {
+    disableMqtt();
+  } else {
+    // setMqttConfig сам отклоняет placeholder-адреса из формы
+    setMqttConfig(server, port, user, password, topicStatus, topicControl, security);
+  }
+}
+
 void initMqtt() {
-  mqttClient.setServer("", 1883);
-  mqttConfigured = false;
+  if (mqttClientMutex == NULL) {
+    mqttClientMutex = xSemaphoreCreateMutex();
+  }
+  mqttClient.begin(wifiClient);
+  mqttClient.setTimeout(MQTT_ACK_TIMEOUT_MS);
+  mqttClient.onMessageAdvanced(onMqttMessage);
+  initMqttCommands();
+  initMqttBacklog(); // Показания, не отправленные до перезагрузки, повторятся после подключения
+  if (mqttSensorMutex == NULL) {
+    mqttSensorMutex = xSemaphoreCreateMutex();
+  }
+  subscribeSettings(SETTINGS_SECTION_MQTT, onMqttSettingsChanged);
 
   // Создаём FreeRTOS задачу для MQTT
   // Запускаем на ядре 0 (Protocol CPU), чтобы не блокировать основной loop
@@ -85,30 +567,26 @@ void setMqttConfig(const String& server, int port, const String& user, const Str
                        trimmedServer.indexOf(' ') == -1 &&  // Не содержит пробелов
                        !(trimmedServer.startsWith("mqtt.") && trimmedServer.endsWith(".com") && trimmedServer.indexOf("server") != -1);  // Общий паттерн placeholder
   
+  static MqttConfig config;  // Вызовы - из основного цикла
+  memset(&config, 0, sizeof(config));
+  config.port = 1883;
+  strlcpy(config.security, "none", sizeof(config.security));
   if (isValidServer && port > 0 && port <= 65535) {
-    mqttServer = trimmedServer;
-    mqttPort = port;
-    mqttUser = user;
-    mqttPassword = password;
-    mqttTopicStatus = topicStatus;
-    mqttTopicControl = topicControl;
-    mqttSecurity = security;
-    mqttClient.setServer(mqttServer.c_str(), mqttPort);
-    mqttConfigured = true;
+    strlcpy(config.server, trimmedServer.c_str(), sizeof(config.server));
+    config.port = port;
+    strlcpy(config.user, user.c_str(), sizeof(config.user));
+    strlcpy(config.password, password.c_str(), sizeof(config.password));
+    strlcpy(config.topicStatus, topicStatus.c_str(), sizeof(config.topicStatus));
+    strlcpy(config.topicControl, topicControl.c_str(), sizeof(config.topicControl));
+    strlcpy(config.security, security.c_str(), sizeof(config.security));
+    config.configured = true;
+    requestMqttConfig(&config);
     Serial.print(F("MQTT configured: "));
-    Serial.print(mqttServer);
+    Serial.print(config.server);
     Serial.print(F(":"));
-    Serial.println(mqttPort);
+    Serial.println(config.port);
   } else {
-    mqttServer = "";
-    mqttPort = 1883;
-    mqttUser = "";
-    mqttPassword = "";
-    mqttTopicStatus = "";
-    mqttTopicControl = "";
-    mqttSecurity = "none";
-    mqttClient.setServer("", 1883);
-    mqttConfigured = false;
+    requestMqttConfig(&config);
     if (trimmedServer.length() > 0) {
       Serial.print(F("MQTT server invalid: '"));
       Serial.print(trimmedServer);
@@ -118,27 +596,20 @@ void setMqttConfig(const String& server, int port, const String& user, const Str
 }
 
 void disableMqtt() {
-  mqttClient.disconnect();
-  mqttServer = "";
-  mqttPort = 1883;
-  mqttUser = "";
-  mqttPassword = "";
-  mqttTopicStatus = "";
-  mqttTopicControl = "";
-  mqttSecurity = "none";
-  mqttClient.setServer("", 1883);
-  mqttConfigured = false;
+  // Вызывается и из async_tcp (/api/mqtt/disable): задача MQTT держит клиент во время
+  // подключения и ожидания PUBACK (до 5 с), поэтому соединение закрывает она сама
+  requestMqttConfig(NULL);
   Serial.println(F("MQTT disabled"));
 }
 
 void updateMqtt() {
   // Проверяем, что MQTT настроен и сервер валидный
-  if (!mqttConfigured || mqttServer.length() == 0) {
+  if (!mqttConfig.configured || mqttConfig.server[0] == '\0') {
     return;
   }
   
   // Дополнительная проверка валидности сервера перед подключением
-  String trimmedServer = mqttServer;
+  String trimmedServer = mqttConfig.server;
   trimmedServer.trim();
   
   // Если сервер невалидный (пустой, "#", "null", содержит пробелы, или это placeholder)
@@ -152,34 +623,45 @@ void updateMqtt() {
     if (mqttClient.connected()) {
       mqttClient.disconnect();
     }
+    mqttConfig.configured = false;
     mqttConfigured = false;
-    mqttServer = "";
     return;
   }
   
   if (!mqttClient.connected()) {
     if (WiFi.status() == WL_CONNECTED) {
-      // Ограничиваем частоту попыток переподключения
-      if (millis() - lastMqttConnectAttempt < MQTT_RECONNECT_INTERVAL) {
-        return; // Слишком рано для новой попытки
-      }
-
       // Дополнительная проверка стабильности WiFi перед подключением
       if (WiFi.localIP() == IPAddress(0, 0, 0, 0)) {
         return; // WiFi не имеет IP адреса
       }
 
-      lastMqttConnectAttempt = millis();
+      // Ограничиваем частоту попыток переподключения
+      if (!breakerAllow(mqttBreaker)) {
+        return; // Пауза после неудачи еще не прошла
+      }
+
+      // Адрес брокера - через общий автомат DNS: пока DNS не работает, задача не ждет таймаута
+      IPAddress brokerAddress;
+      NetResolveResult resolved = netResolve(mqttConfig.server, brokerAddress);
+      if (resolved == NET_RESOLVE_BUSY) {
+        breakerRelease(mqttBreaker); // DNS проверяет другой клиент - попытки не было
+        return;
+      }
+      if (resolved != NET_RESOLVE_OK) {
+        breakerFailure(mqttBreaker);
+        return;
+      }
+      mqttClient.setHost(brokerAddress, mqttConfig.port);
 
       // Устанавливаем короткий таймаут для MQTT подключения
-      wifiClient.setTimeout(5); // 5 секунд таймаут
-      mqttClient.setSocketTimeout(5); // Дополнительный таймаут PubSubClient
+      wifiClient.setTimeout(5); // 5 секунд таймаут (CONNACK ждет MQTT_ACK_TIMEOUT_MS)
 
       String clientId = "ESP32_Thermo_" + String(random(0xffff), HEX);
       bool connected = false;
 
       // Проверяем WiFi еще раз перед подключением
       if (WiFi.status() != WL_CONNECTED) {
+        breakerFailure(mqttBreaker);
         return;
       }
 
@@ -188,11 +670,13 @@ void updateMqtt() {
       yield();
 
       unsigned long connectStart = millis();
-      if (mqttUser.length() > 0) {
-        connected = mqttClient.connect(clientId.c_str(), mqttUser.c_str(), mqttPassword.c_str());
+      xSemaphoreTake(mqttClientMutex, portMAX_DELAY);
+      if (mqttConfig.user[0] != '\0') {
+        connected = mqttClient.connect(clientId.c_str(), mqttConfig.user, mqttConfig.password);
       } else {
         connected = mqttClient.connect(clientId.c_str());
       }
+      xSemaphoreGive(mqttClientMutex);
       unsigned long connectDuration = millis() - connectStart;
 
       // Сброс WDT после операции
@@ -203,14 +687,17 @@ void updateMqtt() {
       if (WiFi.status() != WL_CONNECTED) {
         Serial.println(F("MQTT: WiFi disconnected after connect attempt"));
         mqttClient.disconnect();
+        breakerFailure(mqttBreaker);
         return;
       }
       
       if (connected) {
+        breakerSuccess(mqttBreaker);
+        mqttConnectionEpoch++; // Конфиги обнаружения - заново после каждого подключения
         Serial.print(F("MQTT connected to "));
-        Serial.print(mqttServer);
+        Serial.print(mqttConfig.server);
         Serial.print(F(":"));
-        Serial.print(mqttPort);
+        Serial.print(mqttConfig.port);
         Serial.print(F(" ("));
         Serial.print(connectDuration);
         Serial.println(F(" ms)"));
@@ -218,17 +705,21 @@ void updateMqtt() {
         static unsigned long lastMqttError = 0;
         if (millis() - lastMqttError > 10000) { // Логируем ошибку не чаще раза в 10 секунд
           Serial.print(F("MQTT connection failed to "));
-          Serial.print(mqttServer);
+          Serial.print(mqttConfig.server);
           Serial.print(F(":"));
-          Serial.print(mqttPort);
-          Serial.print(F(" - state: "));
-          Serial.print(mqttClient.state());
+          Serial.print(mqttConfig.port);
+          Serial.print(F(" - error: "));
+          Serial.print((int)mqttClient.lastError());
+          Serial.print(F(", return code: "));
+          Serial.print((int)mqttClient.returnCode());
           Serial.print(F(", duration: "));
           Serial.print(connectDuration);
           Serial.println(F(" ms"));
           lastMqttError = millis();
         }
         
+        breakerFailure(mqttBreaker);
+
         // Если подключение заняло слишком много времени, это может быть DNS проблема
         if (connectDuration > 8000) {
           Serial.println(F("MQTT: Slow connection, possible DNS issue"));
@@ -241,12 +732,15 @@ void updateMqtt() {
       mqttClient.disconnect();
       return;
     }
-    mqttClient.loop();
+    if (xSemaphoreTake(mqttClientMutex, pdMS_TO_TICKS(MQTT_CLIENT_LOCK_MS)) == pdTRUE) {
+      mqttClient.loop();
+      xSemaphoreGive(mqttClientMutex);
+    }
   }
 }
 
 bool isMqttConfigured() {
-  return mqttConfigured && mqttServer.length() > 0;
+  return mqttConfigured;
 }
 
 bool isMqttConnected() {
@@ -254,7 +748,7 @@ bool isMqttConnected() {
 }
 
 const char* getMqttStatus() {
-  if (!mqttConfigured || mqttServer.length() == 0) {
+  if (!mqttConfigured) {
     return "disabled";
   }
   if (WiFi.status() != WL_CONNECTED) {
@@ -267,15 +761,17 @@ const char* getMqttStatus() {
 }
 
 bool sendMqttTestMessage() {
-  if (!mqttConfigured || !mqttClient.connected() || mqttTopicStatus.length() == 0) {
+  if (!mqttConfigured || !mqttClient.connected()) {
     return false;
   }
   
-  String message = "{\"type\":\"test\",\"message\":\"Test message from ESP32 Temperature Monitor\",\"timestamp\":";
-  message += millis() / 1000;
-  message += "}";
+  TextBuffer<MQTT_PAYLOAD_SIZE> message;
+  bool probe = allocProbeBegin();
+  message.add("{\"type\":\"test\",\"message\":\"Test message from ESP32 Temperature Monitor\",\"timestamp\":");
+  message.addUInt(millis() / 1000).add('}');
   
-  bool result = mqttClient.publish(mqttTopicStatus.c_str(), message.c_str());
+  bool result = publishMeasured(NULL, message.c_str());
+  allocProbeEnd(probe);
   if (result) {
     Serial.println(F("MQTT test message sent"));
   } else {
@@ -285,7 +781,7 @@ bool sendMqttTestMessage() {
 }
 
 bool sendMqttMetrics(unsigned long uptime, float temperature, const String& ip, int rssi) {
-  if (!mqttConfigured || !mqttClient.connected() || mqttTopicStatus.length() == 0) {
+  if (!mqttConfigured || !mqttClient.connected()) {
     return false;
   }
   
@@ -294,16 +790,20 @@ bool sendMqttMetrics(unsigned long uptime, float temperature, const String& ip,
   unsigned long minutes = (uptime % 3600) / 60;
   unsigned long seconds = uptime % 60;
   
-  String message = "{";
-  message += "\"type\":\"metrics\",";
-  message += "\"uptime_seconds\":" + String(uptime) + ",";
-  message += "\"uptime_formatted\":\"" + String(hours) + "h " + String(minutes) + "m " + String(seconds) + "s\",";
-  message += "\"temperature\":" + String(temperature, 2) + ",";
-  message += "\"ip\":\"" + ip + "\",";
-  message += "\"rssi\":" + String(rssi) + ",";
-  message += "\"timestamp\":" + String(millis() / 1000);
-  message += "}";
+  // Самые длинные значения: аптайм и время - 10 цифр, температура - FLOAT_TEXT_MAX, IP - 15 символов
+  static_assert(TEXT_LITERAL_LEN("{\"type\":\"metrics\",\"uptime_seconds\":,\"uptime_formatted\":\"h m s\","
+                                 "\"temperature\":,\"ip\":\"\",\"rssi\":,\"timestamp\":}") +
+                10 + 3 * 10 + 12 + 15 + 11 + 10 < MQTT_PAYLOAD_SIZE,
+                "MQTT metrics payload does not fit into MQTT_PAYLOAD_SIZE");
+
+  TextBuffer<MQTT_PAYLOAD_SIZE> message;
+  bool probe = allocProbeBegin();
+  message.addf("{\"type\":\"metrics\",\"uptime_seconds\":%lu,\"uptime_formatted\":\"%luh %lum %lus\",",
+               uptime, hours, minutes, seconds);
+  message.add("\"temperature\":").addFloat(temperature, 2);
+  message.addf(",\"ip\":\"%s\",\"rssi\":%d,\"timestamp\":%lu}", ip.c_str(), rssi, millis() / 1000);
   
-  bool result = mqttClient.publish(mqttTopicStatus.c_str(), message.c_str());
+  bool result = publishMeasured(NULL, message.c_str());
+  allocProbeEnd(probe);
   return result;
 }
@@ -3,14 +3,26 @@
 
 #include <Arduino.h>
 
+struct LatencyStats;
+struct CircuitBreaker;
+
 void initMqtt();
 void setMqttConfig(const String& server, int port, const String& user, const String& password, const String& topicStatus, const String& topicControl, const String& security);
-void disableMqtt(); // Принудительное отключение MQTT
+void disableMqtt(); // Принудительное отключение MQTT: без ожидания, соединение закрывает задача MQTT
 void updateMqtt();
 bool isMqttConfigured();
 bool isMqttConnected();
 const char* getMqttStatus();
 bool sendMqttTestMessage();
 bool sendMqttMetrics(unsigned long uptime, float temperature, const String& ip, int rssi);
+const LatencyStats& getMqttPublishStats(); // Длительность и исход вызовов publish
+CircuitBreaker& getMqttBreaker(); // Автомат переподключения к брокеру (net_health.h)
+// Показание термометра для телеметрии MQTT (вызывать из loop() после чтения): публикует задача MQTT
+// в <base>/<id>/temperature вместе с конфигом обнаружения Home Assistant. address - "28:FF:..."
+void reportMqttSensorReading(int index, const char* address, const char* name, float temperature);
+// Идентификатор устройства в топиках и ответах: MAC в hex без разделителей
+const char* getMqttDeviceId();
+// Разбудить задачу MQTT: в очереди есть ответ на команду (mqtt_commands.h)
+void notifyMqttReplyReady();
 
 #endif
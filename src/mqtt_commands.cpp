@@ -0,0 +1,501 @@
+#include "mqtt_commands.h"
+#include <ArduinoJson.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "mqtt_client.h"
+#include "operation_modes.h"
+#include "settings_store.h"
+#include "sensors.h"
+#include "temperature_history.h"
+#include "text_buffer.h"
+#include "time_manager.h"
+
+extern unsigned long deviceUptime;
+extern int wifiRSSI;
+
+#define MQTT_COMMANDS_PER_LOOP 4           // Команд или частей ответа за одну итерацию loop()
+#define MQTT_COMMAND_DOC_SIZE 512
+#define MQTT_REPLY_ID_SIZE 160             // id команды в виде JSON (строка с экранированием или число)
+#define MQTT_REPLY_ITEM_SIZE 256           // Один термометр или запись истории
+#define MQTT_HISTORY_PERIOD_DEFAULT 3600UL
+#define MQTT_HISTORY_PERIOD_MAX 604800UL   // 7 дней
+// Закрытие части ответа: массив и признак последней части
+#define MQTT_REPLY_TAIL TEXT_LITERAL_LEN("],\"last\":false}")
+
+struct MqttCommandMessage {
+  uint16_t length;
+  char payload[MQTT_COMMAND_SIZE];
+};
+
+enum MqttReplyStreamKind : uint8_t {
+  STREAM_NONE = 0,
+  STREAM_SNAPSHOT,
+  STREAM_HISTORY
+};
+
+// Ответ частями (snapshot, history): пока он не закончен, следующие команды ждут в очереди,
+// чтобы ответы шли в порядке команд
+struct MqttReplyStream {
+  uint8_t kind;
+  char id[MQTT_REPLY_ID_SIZE];
+  uint16_t part;
+  int sensorIndex;                         // snapshot: следующий термометр в настройках
+  unsigned long from;                      // history: период
+  unsigned long to;
+  unsigned long cursorTime;                // history: время следующей записи
+  int cursorSkip;                          // и сколько записей с этим временем уже выдано
+};
+
+enum MqttReplyItemResult : uint8_t {
+  ITEM_READY = 0,                          // Элемент собран в item
+  ITEM_END,                                // Элементы закончились
+  ITEM_BUSY                                // Настройки заняты - часть отправляется без него
+};
+
+static QueueHandle_t commandQueue = NULL;
+static QueueHandle_t replyQueue = NULL;
+static MqttCommandMessage incomingCommand;           // Только задача MQTT
+static MqttCommandMessage currentCommand;            // Только основной цикл
+static MqttReplyStream stream = {STREAM_NONE, "null", 0, 0, 0, 0, 0, 0};
+static TextBuffer<MQTT_REPLY_SIZE> reply;
+static TextBuffer<MQTT_REPLY_ITEM_SIZE> item;
+static char replyId[MQTT_REPLY_ID_SIZE] = "null";
+static uint32_t commandsReceived = 0;
+static uint32_t commandsDropped = 0;
+static uint32_t commandsFailed = 0;
+
+static_assert(MQTT_REPLY_ID_SIZE + MQTT_REPLY_ITEM_SIZE + 160 < MQTT_REPLY_SIZE,
+              "A reply part must hold the header and at least one item");
+// Термометр, не поместившийся в item (имя из управляющих символов экранируется вшестеро),
+// заменяется записью без имени и настроек
+#define MQTT_SNAPSHOT_ITEM_TOO_LONG ",\"error\":\"item too long\"}"
+static_assert(TEXT_LITERAL_LEN("{\"sensor\":\"\"" MQTT_SNAPSHOT_ITEM_TOO_LONG) +
+              sizeof(StoredSensorConfig::address) - 1 < MQTT_REPLY_ITEM_SIZE,
+              "MQTT_REPLY_ITEM_SIZE is too small for a flagged snapshot item");
+// Запись истории: время - до 10 цифр, id - 16 hex-цифр, температура (addFloat) - до 12 символов
+static_assert(TEXT_LITERAL_LEN("[,\"\",]") + 10 + 16 + 12 < MQTT_REPLY_ITEM_SIZE,
+              "MQTT_REPLY_ITEM_SIZE is too small for a history record");
+
+// Имена режимов устройства по значениям OperationMode
+static const char* const operationModeNames[] = {"local", "monitoring", "alert", "stabilization"};
+
+void initMqttCommands() {
+  if (commandQueue == NULL) {
+    commandQueue = xQueueCreate(MQTT_COMMAND_QUEUE_LENGTH, sizeof(MqttCommandMessage));
+  }
+  if (replyQueue == NULL) {
+    replyQueue = xQueueCreate(MQTT_REPLY_QUEUE_LENGTH, MQTT_REPLY_SIZE);
+  }
+}
+
+bool queueMqttCommand(const char* payload, size_t length) {
+  if (commandQueue == NULL || length >= MQTT_COMMAND_SIZE) {
+    commandsDropped++;
+    Serial.println(F("MQTT: command dropped (too long)"));
+    return false;
+  }
+  incomingCommand.length = length;
+  memcpy(incomingCommand.payload, payload, length);
+  incomingCommand.payload[length] = '\0';
+  if (xQueueSend(commandQueue, &incomingCommand, 0) != pdTRUE) {
+    commandsDropped++;
+    Serial.println(F("MQTT: command dropped (queue full)"));
+    return false;
+  }
+  commandsReceived++;
+  return true;
+}
+
+bool takeMqttReply(char* payload) {
+  return replyQueue != NULL && xQueueReceive(replyQueue, payload, 0) == pdTRUE;
+}
+
+void getMqttCommandStats(MqttCommandStats& stats) {
+  stats.received = commandsReceived;
+  stats.dropped = commandsDropped;
+  stats.failed = commandsFailed;
+}
+
+// id команды как JSON-значение: строка или целое; без id или слишком длинный - null
+static void setReplyId(JsonVariantConst id) {
+  TextBuilder builder(replyId, sizeof(replyId));
+  if (id.is<const char*>()) {
+    builder.addJsonString(id.as<const char*>());
+  } else if (id.is<long>()) {
+    builder.addInt(id.as<long>());
+  } else {
+    builder.add("null");
+  }
+  if (builder.truncated()) {
+    strlcpy(replyId, "null", sizeof(replyId));
+  }
+}
+
+static void beginReply(const char* id, const char* command, const char* status) {
+  reply.clear();
+  reply.add("{\"id\":").add(id);
+  reply.add(",\"device\":\"").add(getMqttDeviceId());
+  reply.add("\",\"command\":").addJsonString(command);
+  reply.add(",\"status\":\"").add(status).add('"');
+}
+
+// Ответ в очередь; место в очереди проверено до выполнения команды
+static void sendReply() {
+  reply.add('}');
+  if (reply.truncated()) {
+    // Не поместилось только эхо имени неизвестной команды - отвечаем без него
+    beginReply(replyId, "", "error");
+    reply.add(",\"error\":\"reply too long\"}");
+  }
+  xQueueSend(replyQueue, reply.c_str(), 0);
+  notifyMqttReplyReady();
+}
+
+static void replyError(const char* command, const char* error) {
+  commandsFailed++;
+  beginReply(replyId, command, "error");
+  reply.add(",\"error\":").addJsonString(error);
+  sendReply();
+}
+
+// Адрес "28:FF:12:..." и id "28ff12..." (в любом регистре) - один термометр
+static bool sameSensorId(const char* address, const char* id) {
+  const char* a = address;
+  const char* b = id;
+  while (true) {
+    while (*a != '\0' && !isxdigit((unsigned char)*a)) a++;
+    while (*b != '\0' && !isxdigit((unsigned char)*b)) b++;
+    if (*a == '\0' || *b == '\0') {
+      return *a == *b && a != address;
+    }
+    if (tolower((unsigned char)*a) != tolower((unsigned char)*b)) {
+      return false;
+    }
+    a++;
+    b++;
+  }
+}
+
+// Вызывать под блокировкой настроек
+static int findSensorById(const DeviceSettings& settings, const char* id) {
+  for (int i = 0; i < settings.sensorCount && i < MAX_SENSORS; i++) {
+    if (sameSensorId(settings.sensors[i].address, id)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Адрес термометра в виде id телеметрии: hex-цифры в нижнем регистре
+static void addSensorId(TextBuilder& out, const char* address) {
+  out.add('"');
+  for (const char* p = address; *p != '\0'; p++) {
+    if (isxdigit((unsigned char)*p)) {
+      out.add((char)tolower((unsigned char)*p));
+    }
+  }
+  out.add('"');
+}
+
+static void handleSetMode(JsonDocument& doc) {
+  const char* mode = doc["mode"] | "";
+  const char* sensor = doc["sensor"] | (const char*)NULL;
+
+  if (sensor != NULL) {
+    if (strcmp(mode, "monitoring") != 0 && strcmp(mode, "alert") != 0 && strcmp(mode, "stabilization") != 0) {
+      replyError("set_mode", "unknown sensor mode");
+      return;
+    }
+    if (!lockSettings(pdMS_TO_TICKS(100))) {
+      replyError("set_mode", "settings busy");
+      return;
+    }
+    DeviceSettings& settings = settingsRef();
+    int index = findSensorById(settings, sensor);
+    if (index >= 0) {
+      settings.sensors[index].mode = sensorModeFromName(mode);
+    }
+    unlockSettings();
+    if (index < 0) {
+      replyError("set_mode", "unknown sensor");
+      return;
+    }
+    scheduleSettingsCommit(SETTINGS_SECTION_SENSORS);
+  } else {
+    int value = -1;
+    for (int i = 0; i < (int)(sizeof(operationModeNames) / sizeof(operationModeNames[0])); i++) {
+      if (strcmp(mode, operationModeNames[i]) == 0) {
+        value = i;
+      }
+    }
+    if (value < 0) {
+      replyError("set_mode", "unknown mode");
+      return;
+    }
+    if (!lockSettings(pdMS_TO_TICKS(100))) {
+      replyError("set_mode", "settings busy");
+      return;
+    }
+    settingsRef().operationMode = (uint8_t)value;
+    unlockSettings();
+    scheduleSettingsCommit(SETTINGS_SECTION_OPERATION_MODE);
+  }
+
+  beginReply(replyId, "set_mode", "ok");
+  if (sensor != NULL) {
+    reply.add(",\"sensor\":");
+    addSensorId(reply, sensor);
+  }
+  reply.add(",\"mode\":\"").add(mode).add('"');
+  sendReply();
+}
+
+static void handleSetThresholds(JsonDocument& doc) {
+  JsonVariantConst minValue = doc["min"];
+  JsonVariantConst maxValue = doc["max"];
+  if (!minValue.is<float>() || !maxValue.is<float>()) {
+    replyError("set_thresholds", "min and max are required");
+    return;
+  }
+  float minTemp = minValue.as<float>();
+  float maxTemp = maxValue.as<float>();
+  if (minTemp < -55.0f || maxTemp > 125.0f || minTemp >= maxTemp) {
+    replyError("set_thresholds", "thresholds must satisfy -55 <= min < max <= 125");
+    return;
+  }
+  bool hasBuzzer = doc["buzzer"].is<bool>();
+  bool buzzer = doc["buzzer"] | false;
+  const char* sensor = doc["sensor"] | (const char*)NULL;
+
+  if (!lockSettings(pdMS_TO_TICKS(100))) {
+    replyError("set_thresholds", "settings busy");
+    return;
+  }
+  DeviceSettings& settings = settingsRef();
+  int index = -1;
+  if (sensor != NULL) {
+    index = findSensorById(settings, sensor);
+    if (index >= 0) {
+      StoredSensorConfig& config = settings.sensors[index];
+      config.alertMinTemp = minTemp;
+      config.alertMaxTemp = maxTemp;
+      if (hasBuzzer) {
+        config.alertBuzzerEnabled = buzzer ? 1 : 0;
+      }
+    }
+  } else {
+    settings.alertMinTemp = minTemp;
+    settings.alertMaxTemp = maxTemp;
+    if (hasBuzzer) {
+      settings.alertBuzzerEnabled = buzzer ? 1 : 0;
+    }
+  }
+  unlockSettings();
+  if (sensor != NULL && index < 0) {
+    replyError("set_thresholds", "unknown sensor");
+    return;
+  }
+  scheduleSettingsCommit(sensor != NULL ? SETTINGS_SECTION_SENSORS : SETTINGS_SECTION_ALERT);
+
+  beginReply(replyId, "set_thresholds", "ok");
+  if (sensor != NULL) {
+    reply.add(",\"sensor\":");
+    addSensorId(reply, sensor);
+  }
+  reply.add(",\"min\":").addFloat(minTemp, 2);
+  reply.add(",\"max\":").addFloat(maxTemp, 2);
+  sendReply();
+}
+
+static void startStream(uint8_t kind) {
+  stream.kind = kind;
+  strlcpy(stream.id, replyId, sizeof(stream.id));
+  stream.part = 1;
+  stream.sensorIndex = 0;
+  stream.cursorSkip = 0;
+}
+
+static void handleHistory(JsonDocument& doc) {
+  unsigned long period = doc["period"] | MQTT_HISTORY_PERIOD_DEFAULT;
+  if (period == 0 || period > MQTT_HISTORY_PERIOD_MAX) {
+    replyError("history", "period must be 1..604800 seconds");
+    return;
+  }
+  startStream(STREAM_HISTORY);
+  stream.to = getUnixTime();
+  stream.from = stream.to > period ? stream.to - period : 0;
+  stream.cursorTime = stream.from;
+}
+
+// Следующий термометр ответа snapshot в item
+static MqttReplyItemResult buildSnapshotItem() {
+  if (!lockSettings(pdMS_TO_TICKS(100))) {
+    return ITEM_BUSY;
+  }
+  const DeviceSettings& settings = settingsRef();
+  if (stream.sensorIndex >= settings.sensorCount || stream.sensorIndex >= MAX_SENSORS) {
+    unlockSettings();
+    return ITEM_END;
+  }
+  const StoredSensorConfig& config = settings.sensors[stream.sensorIndex];
+  item.clear();
+  item.add("{\"sensor\":");
+  addSensorId(item, config.address);
+  item.add(",\"name\":").addJsonString(config.name);
+  item.add(",\"enabled\":").add(config.enabled ? "true" : "false");
+  item.add(",\"mode\":\"").add(sensorModeName(config.mode));
+  item.add("\",\"min\":").addFloat(config.alertMinTemp, 2);
+  item.add(",\"max\":").addFloat(config.alertMaxTemp, 2);
+  item.add(",\"temperature\":");
+  // Показание - с шины по адресу: порядок термометров в настройках и на шине разный
+  float temperature = -127.0f;
+  char address[24];
+  for (int i = 0; i < getSensorCount(); i++) {
+    if (formatSensorAddress(i, address, sizeof(address)) && strcmp(address, config.address) == 0) {
+      temperature = getSensorTemperature(i);
+      if (temperature != -127.0f) {
+        temperature += config.correction;
+      }
+      break;
+    }
+  }
+  if (temperature == -127.0f) {
+    item.add("null");
+  } else {
+    item.addFloat(temperature, 2);
+  }
+  item.add('}');
+  if (item.truncated()) {
+    // Обрезанный элемент - не JSON: термометр отмечается ошибкой
+    item.clear();
+    item.add("{\"sensor\":");
+    addSensorId(item, config.address);
+    item.add(MQTT_SNAPSHOT_ITEM_TOO_LONG);
+  }
+  unlockSettings();
+  return ITEM_READY;
+}
+
+// Следующая запись истории периода в item.
+// Позиция - по времени записи: кольцо истории сдвигается, пока ответ отправляется частями
+static MqttReplyItemResult buildHistoryItem() {
+  int count = 0;
+  getHistory(&count);
+  int sameTime = 0;
+  for (int position = 0; position < count; position++) {
+    const TemperatureRecord* record = getHistoryRecord(position);
+    if (record->timestamp == 0 || record->temperature == -127.0f ||
+        record->timestamp < stream.cursorTime || record->timestamp > stream.to) {
+      continue;
+    }
+    if (record->timestamp == stream.cursorTime && sameTime++ < stream.cursorSkip) {
+      continue;
+    }
+    item.clear();
+    item.add('[').addUInt(record->timestamp).add(',');
+    addSensorId(item, record->sensorAddress.c_str());
+    item.add(',').addFloat(record->temperature, 2).add(']');
+    if (record->timestamp == stream.cursorTime) {
+      stream.cursorSkip++;
+    } else {
+      stream.cursorTime = record->timestamp;
+      stream.cursorSkip = 1;
+    }
+    return ITEM_READY;
+  }
+  return ITEM_END;
+}
+
+// Очередная часть ответа snapshot/history
+static void continueStream() {
+  bool snapshot = stream.kind == STREAM_SNAPSHOT;
+  beginReply(stream.id, snapshot ? "snapshot" : "history", "ok");
+  reply.add(",\"part\":").addUInt(stream.part);
+  if (stream.part == 1) {
+    if (snapshot) {
+      OperationMode mode = getOperationMode();
+      reply.add(",\"uptime\":").addUInt(deviceUptime);
+      reply.add(",\"mode\":\"").add(mode <= MODE_STABILIZATION ? operationModeNames[mode] : "unknown");
+      reply.add("\",\"wifi_rssi\":").addInt(wifiRSSI);
+      reply.add(",\"heap_free\":").addUInt(ESP.getFreeHeap());
+    } else {
+      reply.add(",\"from\":").addUInt(stream.from);
+      reply.add(",\"to\":").addUInt(stream.to);
+    }
+  }
+  reply.add(snapshot ? ",\"sensors\":[" : ",\"records\":[");
+
+  bool first = true;
+  bool done = false;
+  while (true) {
+    // Текущая позиция сохраняется: не поместившийся элемент откроет следующую часть
+    MqttReplyStream saved = stream;
+    MqttReplyItemResult result = snapshot ? buildSnapshotItem() : buildHistoryItem();
+    if (result != ITEM_READY) {
+      done = result == ITEM_END;
+      break;
+    }
+    if (item.truncated()) {
+      // Адрес в истории длиннее ожидаемого - запись пропускается, чтобы не испортить JSON
+      continue;
+    }
+    if (item.length() + 1 + MQTT_REPLY_TAIL > reply.remaining()) {
+      stream = saved;
+      break;
+    }
+    if (!first) {
+      reply.add(',');
+    }
+    reply.addBytes(item.c_str(), item.length());
+    first = false;
+    if (snapshot) {
+      stream.sensorIndex++;
+    }
+  }
+  reply.add("],\"last\":").add(done ? "true" : "false");
+  sendReply();
+  stream.part++;
+  if (done) {
+    stream.kind = STREAM_NONE;
+  }
+}
+
+static void executeCommand(const MqttCommandMessage& message) {
+  StaticJsonDocument<MQTT_COMMAND_DOC_SIZE> doc;
+  DeserializationError error = deserializeJson(doc, message.payload, message.length);
+  setReplyId(doc["id"]);
+  if (error || !doc.is<JsonObject>()) {
+    replyError("", "invalid JSON");
+    return;
+  }
+
+  const char* command = doc["command"] | "";
+  if (strcmp(command, "set_mode") == 0) {
+    handleSetMode(doc);
+  } else if (strcmp(command, "set_thresholds") == 0) {
+    handleSetThresholds(doc);
+  } else if (strcmp(command, "snapshot") == 0) {
+    startStream(STREAM_SNAPSHOT);
+  } else if (strcmp(command, "history") == 0) {
+    handleHistory(doc);
+  } else {
+    replyError(command, "unknown command");
+  }
+}
+
+void processMqttCommands() {
+  if (commandQueue == NULL || replyQueue == NULL) {
+    return;
+  }
+  // Каждый шаг дает не больше одного ответа: выполняется, только если для него есть место
+  for (int n = 0; n < MQTT_COMMANDS_PER_LOOP && uxQueueSpacesAvailable(replyQueue) > 0; n++) {
+    if (stream.kind != STREAM_NONE) {
+      continueStream();
+      continue;
+    }
+    if (xQueueReceive(commandQueue, &currentCommand, 0) != pdTRUE) {
+      break;
+    }
+    executeCommand(currentCommand);
+  }
+}
@@ -0,0 +1,42 @@
+#ifndef MQTT_COMMANDS_H
+#define MQTT_COMMANDS_H
+
+#include <Arduino.h>
+
+// Команды из топика управления MQTT (mqttTopicControl).
+// Задача MQTT кладет копию сообщения в очередь без ожидания, основной цикл выполняет
+// команды (processMqttCommands) и кладет ответы в очередь ответов, которую задача MQTT
+// публикует в <base>/reply с QoS 1. Команда - JSON:
+//   {"id":"42","command":"set_mode","mode":"alert"}                   режим устройства
+//   {"id":"43","command":"set_mode","sensor":"28ff...","mode":"alert"} режим термометра
+//   {"id":"44","command":"set_thresholds","sensor":"28ff...","min":10,"max":30,"buzzer":true}
+//   {"id":"45","command":"snapshot"}                                   состояние и термометры
+//   {"id":"46","command":"history","period":3600}                      история за period секунд
+// Ответ содержит id команды и адрес устройства; snapshot и history отвечают частями
+// ("part", "last"), следующая часть собирается, когда в очереди ответов есть место
+#define MQTT_COMMAND_SIZE 256              // Команда длиннее отбрасывается
+#define MQTT_COMMAND_QUEUE_LENGTH 8
+#define MQTT_REPLY_SIZE 768
+#define MQTT_REPLY_QUEUE_LENGTH 4
+
+struct MqttCommandStats {
+  uint32_t received;                       // Принято в очередь
+  uint32_t dropped;                        // Очередь полна или команда длиннее MQTT_COMMAND_SIZE
+  uint32_t failed;                         // Выполнены с ответом "error"
+};
+
+// Очереди команд и ответов (из initMqtt)
+void initMqttCommands();
+
+// Задача MQTT (обработчик сообщений клиента): копия команды в очередь без ожидания
+bool queueMqttCommand(const char* payload, size_t length);
+
+// Основной цикл: выполнение команд и сборка частей ответов, без ожидания
+void processMqttCommands();
+
+// Задача MQTT: следующий ответ в payload (MQTT_REPLY_SIZE байт). false - ответов нет
+bool takeMqttReply(char* payload);
+
+void getMqttCommandStats(MqttCommandStats& stats);
+
+#endif
@@ -0,0 +1,169 @@
+#include "net_health.h"
+#include <WiFi.h>
+#include "esp_system.h"
+
+// DNS общий для всех клиентов: две неудачи подряд - разрешение имен приостанавливается
+static CircuitBreaker dnsBreaker = CIRCUIT_BREAKER("dns", 2, 10000, 120000);
+
+// Пауза для очередного размыкания: base * 2^(streak-1), не больше max, случайно в [1/2; 1]
+static uint32_t nextBackoff(const CircuitBreaker& breaker) {
+  uint32_t backoff = breaker.baseBackoffMs;
+  for (uint8_t i = 1; i < breaker.openStreak && backoff < breaker.maxBackoffMs; i++) {
+    backoff *= 2;
+  }
+  if (backoff > breaker.maxBackoffMs) {
+    backoff = breaker.maxBackoffMs;
+  }
+  return backoff / 2 + esp_random() % (backoff / 2 + 1);
+}
+
+static void trip(CircuitBreaker& breaker) {
+  if (breaker.openStreak < 255) {
+    breaker.openStreak++;
+  }
+  breaker.state = BREAKER_OPEN;
+  breaker.probeInFlight = false;
+  breaker.backoffMs = nextBackoff(breaker);
+  breaker.openedMs = millis();
+  breaker.trips++;
+}
+
+bool breakerAllow(CircuitBreaker& breaker, bool* busy) {
+  bool allowed = false;
+  bool probeBusy = false;
+  portENTER_CRITICAL(&breaker.mux);
+  switch (breaker.state) {
+    case BREAKER_CLOSED:
+      allowed = true;
+      break;
+    case BREAKER_OPEN:
+      if (millis() - breaker.openedMs >= breaker.backoffMs) {
+        breaker.state = BREAKER_HALF_OPEN;
+        breaker.probeInFlight = true;
+        allowed = true;
+      }
+      break;
+    case BREAKER_HALF_OPEN:
+      if (!breaker.probeInFlight) {
+        breaker.probeInFlight = true;
+        allowed = true;
+      } else {
+        probeBusy = true;
+      }
+      break;
+  }
+  portEXIT_CRITICAL(&breaker.mux);
+  if (busy) {
+    *busy = probeBusy;
+  }
+  return allowed;
+}
+
+void breakerSuccess(CircuitBreaker& breaker) {
+  portENTER_CRITICAL(&breaker.mux);
+  breaker.state = BREAKER_CLOSED;
+  breaker.consecutiveFailures = 0;
+  breaker.openStreak = 0;
+  breaker.probeInFlight = false;
+  breaker.backoffMs = 0;
+  portEXIT_CRITICAL(&breaker.mux);
+}
+
+void breakerFailure(CircuitBreaker& breaker) {
+  bool tripped = false;
+  portENTER_CRITICAL(&breaker.mux);
+  if (breaker.consecutiveFailures < 255) {
+    breaker.consecutiveFailures++;
+  }
+  if (breaker.state == BREAKER_HALF_OPEN ||
+      (breaker.state == BREAKER_CLOSED && breaker.consecutiveFailures >= breaker.failureThreshold)) {
+    trip(breaker);
+    tripped = true;
+  }
+  uint32_t backoff = breaker.backoffMs;
+  portEXIT_CRITICAL(&breaker.mux);
+
+  if (tripped) {
+    Serial.print(F("Net: "));
+    Serial.print(breaker.name);
+    Serial.print(F(" circuit open for "));
+    Serial.print(backoff);
+    Serial.println(F(" ms"));
+  }
+}
+
+void breakerRelease(CircuitBreaker& breaker) {
+  portENTER_CRITICAL(&breaker.mux);
+  if (breaker.state == BREAKER_HALF_OPEN) {
+    breaker.probeInFlight = false;
+  }
+  portEXIT_CRITICAL(&breaker.mux);
+}
+
+void breakerReset(CircuitBreaker& breaker) {
+  portENTER_CRITICAL(&breaker.mux);
+  breaker.state = BREAKER_CLOSED;
+  breaker.consecutiveFailures = 0;
+  breaker.openStreak = 0;
+  breaker.probeInFlight = false;
+  breaker.backoffMs = 0;
+  portEXIT_CRITICAL(&breaker.mux);
+}
+
+unsigned long breakerRetryInMs(CircuitBreaker& breaker) {
+  unsigned long retryIn = 0;
+  portENTER_CRITICAL(&breaker.mux);
+  if (breaker.state == BREAKER_OPEN) {
+    unsigned long elapsed = millis() - breaker.openedMs;
+    if (elapsed < breaker.backoffMs) {
+      retryIn = breaker.backoffMs - elapsed;
+    }
+  }
+  portEXIT_CRITICAL(&breaker.mux);
+  return retryIn;
+}
+
+void getBreakerStatus(CircuitBreaker& breaker, BreakerStatus& status) {
+  portENTER_CRITICAL(&breaker.mux);
+  status.state = breaker.state;
+  status.consecutiveFailures = breaker.consecutiveFailures;
+  status.backoffMs = breaker.backoffMs;
+  status.trips = breaker.trips;
+  portEXIT_CRITICAL(&breaker.mux);
+}
+
+const char* getBreakerStateName(uint8_t state) {
+  switch (state) {
+    case BREAKER_CLOSED: return "closed";
+    case BREAKER_OPEN: return "open";
+    case BREAKER_HALF_OPEN: return "half_open";
+    default: return "unknown";
+  }
+}
+
+NetResolveResult netResolve(const char* host, IPAddress& address) {
+  if (address.fromString(host)) {
+    return NET_RESOLVE_OK;
+  }
+  bool busy = false;
+  if (!breakerAllow(dnsBreaker, &busy)) {
+    return busy ? NET_RESOLVE_BUSY : NET_RESOLVE_FAILED;
+  }
+  unsigned long start = millis();
+  bool ok = WiFi.hostByName(host, address) == 1 && (uint32_t)address != 0;
+  if (ok) {
+    breakerSuccess(dnsBreaker);
+  } else {
+    Serial.print(F("Net: DNS lookup of "));
+    Serial.print(host);
+    Serial.print(F(" failed after "));
+    Serial.print(millis() - start);
+    Serial.println(F(" ms"));
+    breakerFailure(dnsBreaker);
+  }
+  return ok ? NET_RESOLVE_OK : NET_RESOLVE_FAILED;
+}
+
+CircuitBreaker& getDnsBreaker() {
+  return dnsBreaker;
+}
@@ -0,0 +1,81 @@
+#ifndef NET_HEALTH_H
+#define NET_HEALTH_H
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include "freertos/FreeRTOS.h"
+
+// Состояние сетевых клиентов (Telegram, MQTT): автомат размыкания с экспоненциальной
+// паузой и общий признак работоспособности DNS.
+//  - closed: запросы идут; failureThreshold неудач подряд размыкают автомат;
+//  - open: запросов нет, пока не пройдет пауза; пауза удваивается с каждым размыканием
+//    подряд (до maxBackoffMs) и случайно сокращается до половины, чтобы клиенты
+//    не переподключались одновременно;
+//  - half_open: пауза прошла, идет один пробный запрос; успех замыкает автомат,
+//    неудача снова размыкает с удвоенной паузой.
+// Автомат может использоваться несколькими задачами: состояние защищено критической секцией
+
+enum BreakerState : uint8_t {
+  BREAKER_CLOSED = 0,
+  BREAKER_OPEN,
+  BREAKER_HALF_OPEN
+};
+
+struct CircuitBreaker {
+  const char* name;
+  uint8_t failureThreshold;      // Неудач подряд до размыкания
+  uint32_t baseBackoffMs;        // Пауза после первого размыкания
+  uint32_t maxBackoffMs;
+  portMUX_TYPE mux;
+  volatile uint8_t state;
+  uint8_t consecutiveFailures;
+  uint8_t openStreak;            // Размыканий подряд без успешного запроса
+  bool probeInFlight;            // half_open: пробный запрос уже выполняется
+  uint32_t backoffMs;            // Текущая пауза (с разбросом)
+  unsigned long openedMs;
+  uint32_t trips;                // Размыканий с момента загрузки
+};
+
+#define CIRCUIT_BREAKER(name, threshold, baseMs, maxMs) \
+  {name, threshold, baseMs, maxMs, portMUX_INITIALIZER_UNLOCKED, BREAKER_CLOSED, 0, 0, false, 0, 0, 0}
+
+// Копия состояния для /api/data
+struct BreakerStatus {
+  uint8_t state;
+  uint8_t consecutiveFailures;
+  uint32_t backoffMs;
+  uint32_t trips;
+};
+
+// Можно ли выполнить запрос сейчас. В open по истечении паузы переводит в half_open
+// и разрешает один пробный запрос; его исход обязательно сообщить breakerSuccess/breakerFailure
+// (или breakerRelease, если запрос так и не был выполнен). busy - отказ только потому,
+// что пробный запрос уже выполняет другой клиент
+bool breakerAllow(CircuitBreaker& breaker, bool* busy = NULL);
+void breakerSuccess(CircuitBreaker& breaker);
+void breakerFailure(CircuitBreaker& breaker);
+// Вернуть разрешение без исхода: запрос не выполнялся (например, занят пробный запрос DNS).
+// В half_open освобождает место пробного запроса, счетчики не меняет
+void breakerRelease(CircuitBreaker& breaker);
+// Сброс в closed (изменились настройки клиента - пробуем сразу)
+void breakerReset(CircuitBreaker& breaker);
+// Сколько ждать до следующей попытки: > 0 только в open до истечения паузы.
+// Для решений без запроса (положить оповещение в outbox, выбрать паузу задачи)
+unsigned long breakerRetryInMs(CircuitBreaker& breaker);
+void getBreakerStatus(CircuitBreaker& breaker, BreakerStatus& status);
+const char* getBreakerStateName(uint8_t state);
+
+// Разрешение имени через общий автомат DNS. При разомкнутом автомате сразу false,
+// без ожидания таймаута: клиенты не блокируют свои задачи, пока DNS не работает.
+// IP-адрес в строке разбирается без обращения к DNS и на автомат не влияет.
+// NET_RESOLVE_BUSY - пробный запрос DNS выполняет другой клиент: разрешения не было,
+// и вызывающий не должен считать это неудачей своего соединения
+enum NetResolveResult : uint8_t {
+  NET_RESOLVE_OK = 0,
+  NET_RESOLVE_FAILED,
+  NET_RESOLVE_BUSY
+};
+NetResolveResult netResolve(const char* host, IPAddress& address);
+CircuitBreaker& getDnsBreaker();
+
+#endif
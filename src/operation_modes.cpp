@@ -1,6 +1,7 @@
 #include "operation_modes.h"
 #include "config.h"
 #include <Arduino.h>
+#include "settings_store.h"
 
 // Текущий режим работы
 OperationMode currentMode = MODE_LOCAL;
@@ -20,6 +21,9 @@ StabilizationModeSettings stabilizationSettings = {
   .duration = 600  // 10 минут
 };
 
+// Поколение режима и его настроек (для ETag /api/mode)
+static volatile uint32_t modeGeneration = 1;
+
 // Состояние стабилизации
 struct StabilizationState {
   bool isStabilized;
@@ -33,16 +37,45 @@ struct StabilizationState {
   .lastChangeTime = 0
 };
 
+// Применение измененных настроек режимов (вызывается из main loop)
+static void onOperationSettingsChanged(uint32_t changedSections) {
+  if (!lockSettings(pdMS_TO_TICKS(1000))) {
+    return;
+  }
+  const DeviceSettings& settings = settingsRef();
+  OperationMode mode = (OperationMode)settings.operationMode;
+  float alertMin = settings.alertMinTemp;
+  float alertMax = settings.alertMaxTemp;
+  bool alertBuzzer = settings.alertBuzzerEnabled != 0;
+  float stabTolerance = settings.stabTolerance;
+  float stabAlertThreshold = settings.stabAlertThreshold;
+  unsigned long stabDuration = settings.stabDuration;
+  unlockSettings();
+
+  if (changedSections & SETTINGS_SECTION_OPERATION_MODE) {
+    setOperationMode(mode);
+  }
+  if (changedSections & SETTINGS_SECTION_ALERT) {
+    setAlertSettings(alertMin, alertMax, alertBuzzer);
+  }
+  if (changedSections & SETTINGS_SECTION_STABILIZATION) {
+    setStabilizationSettings(stabTolerance, stabAlertThreshold, stabDuration);
+  }
+}
+
 void initOperationModes() {
   currentMode = MODE_LOCAL;
   stabilizationState.isStabilized = false;
   stabilizationState.stabilizationStartTime = 0;
   stabilizationState.lastTemp = 0.0;
   stabilizationState.lastChangeTime = 0;
+  subscribeSettings(SETTINGS_SECTION_OPERATION_MODE | SETTINGS_SECTION_ALERT | SETTINGS_SECTION_STABILIZATION,
+                    onOperationSettingsChanged);
 }
 
 void setOperationMode(OperationMode mode) {
   currentMode = mode;
+  modeGeneration++;
   // Сброс состояния стабилизации при смене режима
   if (mode != MODE_STABILIZATION) {
     stabilizationState.isStabilized = false;
@@ -54,10 +87,15 @@ OperationMode getOperationMode() {
   return currentMode;
 }
 
+uint32_t getOperationModeGeneration() {
+  return modeGeneration;
+}
+
 void setAlertSettings(float minTemp, float maxTemp, bool buzzerEnabled) {
   alertSettings.minTemp = minTemp;
   alertSettings.maxTemp = maxTemp;
   alertSettings.buzzerEnabled = buzzerEnabled;
+  modeGeneration++;
 }
 
 AlertModeSettings getAlertSettings() {
@@ -69,6 +107,7 @@ void setStabilizationSettings(float tolerance, float alertThreshold, unsigned lo
   stabilizationSettings.tolerance = tolerance;
   stabilizationSettings.alertThreshold = alertThreshold;
   stabilizationSettings.duration = duration;
+  modeGeneration++;
 }
 
 StabilizationModeSettings getStabilizationSettings() {
@@ -1,6 +1,8 @@
 #ifndef OPERATION_MODES_H
 #define OPERATION_MODES_H
 
+#include <stdint.h>
+
 // Режимы работы термометра
 enum OperationMode {
   MODE_LOCAL = 0,           // Локальный режим - только мониторинг, WiFi только при нажатии кнопки
@@ -28,6 +30,7 @@ struct StabilizationModeSettings {
 void initOperationModes();
 void setOperationMode(OperationMode mode);
 OperationMode getOperationMode();
+uint32_t getOperationModeGeneration(); // Меняется при смене режима и его настроек
 void updateOperationMode();
 
 // Функции для режима оповещения
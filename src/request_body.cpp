@@ -0,0 +1,162 @@
+#include "request_body.h"
+#include <Arduino.h>
+#include "http_stats.h"
+
+// Буфер тела одного запроса. Все обработчики ESPAsyncWebServer выполняются в одной задаче
+// async_tcp, поэтому пул не требует блокировки
+struct RequestBodySlot {
+  char* buffer;
+  size_t capacity;
+  AsyncWebServerRequest* owner;
+  unsigned long startMs;
+  size_t received;
+};
+
+#define REQUEST_BODY_SLOTS (REQUEST_BODY_LARGE_SLOTS + REQUEST_BODY_SMALL_SLOTS)
+
+static char largeBodyBuffers[REQUEST_BODY_LARGE_SLOTS][REQUEST_BODY_LARGE_SIZE + 1];
+static char smallBodyBuffers[REQUEST_BODY_SMALL_SLOTS][REQUEST_BODY_SMALL_SIZE + 1];
+static RequestBodySlot bodySlots[REQUEST_BODY_SLOTS];
+static bool bodyPoolReady = false;
+
+static void initBodyPool() {
+  // Маленькие буферы первыми: при выборе берется наименьший подходящий
+  int n = 0;
+  for (int i = 0; i < REQUEST_BODY_SMALL_SLOTS; i++, n++) {
+    bodySlots[n] = {smallBodyBuffers[i], REQUEST_BODY_SMALL_SIZE, nullptr, 0, 0};
+  }
+  for (int i = 0; i < REQUEST_BODY_LARGE_SLOTS; i++, n++) {
+    bodySlots[n] = {largeBodyBuffers[i], REQUEST_BODY_LARGE_SIZE, nullptr, 0, 0};
+  }
+  bodyPoolReady = true;
+}
+
+static int findBodySlot(AsyncWebServerRequest *request) {
+  for (int i = 0; i < REQUEST_BODY_SLOTS; i++) {
+    if (bodySlots[i].owner == request) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void releaseBodySlot(int slot) {
+  if (slot >= 0) {
+    bodySlots[slot].owner = nullptr;
+    bodySlots[slot].received = 0;
+  }
+}
+
+static int acquireBodySlot(AsyncWebServerRequest *request, size_t total) {
+  unsigned long now = millis();
+  int found = -1;
+  for (int i = 0; i < REQUEST_BODY_SLOTS; i++) {
+    RequestBodySlot& slot = bodySlots[i];
+    // Оборванный запрос (клиент отключился, не передав тело) - буфер снова свободен
+    if (slot.owner != nullptr && now - slot.startMs >= REQUEST_BODY_TIMEOUT) {
+      releaseBodySlot(i);
+    }
+    if (found < 0 && slot.owner == nullptr && slot.capacity >= total) {
+      found = i;
+    }
+  }
+  if (found >= 0) {
+    bodySlots[found].owner = request;
+    bodySlots[found].startMs = now;
+    bodySlots[found].received = 0;
+  }
+  return found;
+}
+
+void sendJsonStatus(AsyncWebServerRequest *request, int code, const char* status, const char* message) {
+  StaticJsonDocument<192> doc;
+  doc["status"] = status;
+  doc["message"] = message;
+  String body;
+  serializeJson(doc, body);
+  AsyncWebServerResponse *response = request->beginResponse(code, "application/json", body);
+  response->addHeader("Access-Control-Allow-Origin", "*");
+  if (code == 503) {
+    response->addHeader("Retry-After", "1");
+  }
+  request->send(response);
+}
+
+static void handleBodyChunk(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total,
+                            size_t maxBodySize, int statsSlot, const JsonBodyHandler& handler) {
+  if (index == 0) {
+    if (total > maxBodySize) {
+      Serial.print(F("ERROR: Request too large: "));
+      Serial.print(total);
+      Serial.println(F(" bytes"));
+      sendJsonStatus(request, 413, "error", "Request too large");
+      return;
+    }
+    // Буфер мог остаться от прошлого запроса с тем же адресом объекта
+    releaseBodySlot(findBodySlot(request));
+    if (acquireBodySlot(request, total) < 0) {
+      sendJsonStatus(request, 503, "error", "Server busy, try again later");
+      return;
+    }
+  }
+
+  int slotIndex = findBodySlot(request);
+  if (slotIndex < 0) {
+    return; // Ответ уже отправлен на первом фрагменте
+  }
+  RequestBodySlot& slot = bodySlots[slotIndex];
+
+  if (index != slot.received || index + len > total || total > slot.capacity) {
+    releaseBodySlot(slotIndex);
+    sendJsonStatus(request, 400, "error", "Request corrupted");
+    return;
+  }
+
+  memcpy(slot.buffer + index, data, len);
+  slot.received += len;
+  if (slot.received < total) {
+    return;
+  }
+  slot.buffer[total] = '\0';
+
+  // Время обработки - от получения всего тела: разбор JSON и обработчик
+  HttpRequestProbe probe;
+  beginHttpRequest(probe);
+  DynamicJsonDocument doc(total + total / 2 + 256);
+  DeserializationError error = deserializeJson(doc, (const char*)slot.buffer, total);
+  releaseBodySlot(slotIndex);
+  if (error) {
+    Serial.print(F("ERROR: Invalid request JSON: "));
+    Serial.println(error.c_str());
+    char message[64];
+    snprintf(message, sizeof(message), "Invalid JSON: %s", error.c_str());
+    sendJsonStatus(request, 400, "error", message);
+    finishHttpRequest(statsSlot, request, probe);
+    return;
+  }
+
+  handler(request, doc.as<JsonVariantConst>());
+  finishHttpRequest(statsSlot, request, probe);
+}
+
+void onJsonPost(AsyncWebServer& server, const char* uri, size_t maxBodySize, JsonBodyHandler handler, const char* label) {
+  if (!bodyPoolReady) {
+    initBodyPool();
+  }
+  if (maxBodySize > REQUEST_BODY_LARGE_SIZE) {
+    maxBodySize = REQUEST_BODY_LARGE_SIZE;
+  }
+  int statsSlot = registerHttpRoute(label != nullptr ? label : uri, "POST");
+
+  server.on(uri, HTTP_POST,
+    [](AsyncWebServerRequest *request) {
+      // Ответ отправляет обработчик тела; здесь - только запрос без тела
+      if (request->contentLength() == 0) {
+        sendJsonStatus(request, 400, "error", "Empty request");
+      }
+    },
+    NULL,
+    [maxBodySize, statsSlot, handler](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+      handleBodyChunk(request, data, len, index, total, maxBodySize, statsSlot, handler);
+    });
+}
@@ -0,0 +1,29 @@
+#ifndef REQUEST_BODY_H
+#define REQUEST_BODY_H
+
+#include <ESPAsyncWebServer.h>
+#include <ArduinoJson.h>
+#include <functional>
+
+// Пул буферов тела POST-запросов: каждый запрос получает свой ограниченный буфер,
+// фрагменты копируются в него по мере поступления, JSON разбирается один раз.
+// Параллельные запросы не мешают друг другу, общий объем памяти фиксирован
+#define REQUEST_BODY_LARGE_SIZE 8192     // merge patch /api/settings, /api/sensors
+#define REQUEST_BODY_LARGE_SLOTS 1
+#define REQUEST_BODY_SMALL_SIZE 1024     // остальные POST с JSON
+#define REQUEST_BODY_SMALL_SLOTS 4
+#define REQUEST_BODY_TIMEOUT 10000       // Буфер оборванного запроса освобождается через 10 секунд
+
+// Обработчик разобранного тела. Вызывается в задаче async_tcp, ответ отправляет сам
+typedef std::function<void(AsyncWebServerRequest *request, JsonVariantConst body)> JsonBodyHandler;
+
+// POST с JSON-телом не больше maxBodySize. Ошибки приема отвечает сам:
+// 400 (пустое тело, некорректный JSON), 413 (слишком большое), 503 + Retry-After (пул занят).
+// label - имя маршрута в статистике HTTP (для регулярных выражений)
+void onJsonPost(AsyncWebServer& server, const char* uri, size_t maxBodySize, JsonBodyHandler handler,
+                const char* label = nullptr);
+
+// Ответ {"status": ..., "message": ...} с CORS
+void sendJsonStatus(AsyncWebServerRequest *request, int code, const char* status, const char* message);
+
+#endif
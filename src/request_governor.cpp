@@ -0,0 +1,156 @@
+#include "request_governor.h"
+#include <Arduino.h>
+#include "request_body.h"
+
+// Построенное тело ответа. Освобождается, когда не осталось ответов в передаче
+// и истекло время повторного использования (слот занимает следующий ответ)
+struct SharedBody {
+  char key[GOVERNOR_KEY_SIZE];   // Пусто - тело не переиспользуется (ошибка построения)
+  GovernedEndpoint* endpoint;    // nullptr - слот свободен
+  String body;
+  int code;
+  unsigned long builtMs;
+  uint8_t refs;                  // Ответов в передаче
+};
+
+static SharedBody sharedBodies[GOVERNOR_SHARED_BODIES];
+
+static void rejectOverloaded(AsyncWebServerRequest *request, GovernedEndpoint& endpoint) {
+  endpoint.rejected++;
+  Serial.print(F("Overload: rejecting "));
+  Serial.println(endpoint.name);
+  sendJsonStatus(request, 503, "error", "Server busy, try again later");
+}
+
+static bool canAdmit(const GovernedEndpoint& endpoint, size_t estimatedSize) {
+  return endpoint.inFlight < endpoint.maxInFlight &&
+         ESP.getMaxAllocHeap() >= estimatedSize + GOVERNOR_HEAP_RESERVE;
+}
+
+bool admitResponse(AsyncWebServerRequest *request, GovernedEndpoint& endpoint, size_t estimatedSize) {
+  if (!canAdmit(endpoint, estimatedSize)) {
+    rejectOverloaded(request, endpoint);
+    return false;
+  }
+  endpoint.inFlight++;
+  return true;
+}
+
+void releaseResponse(GovernedEndpoint& endpoint) {
+  if (endpoint.inFlight > 0) {
+    endpoint.inFlight--;
+  }
+}
+
+// Ответ из общего тела: копируется по мере освобождения TCP-буфера
+class SharedBodyResponse : public AsyncAbstractResponse {
+ public:
+  explicit SharedBodyResponse(int index) : _index(index), _offset(0) {
+    const SharedBody& shared = sharedBodies[index];
+    _code = shared.code;
+    _contentType = "application/json";
+    _contentLength = shared.body.length();
+    addHeader("Access-Control-Allow-Origin", "*");
+  }
+
+  ~SharedBodyResponse() {
+    SharedBody& shared = sharedBodies[_index];
+    shared.refs--;
+    releaseResponse(*shared.endpoint);
+  }
+
+  bool _sourceValid() const override {
+    return true;
+  }
+
+  size_t _fillBuffer(uint8_t* buf, size_t maxLen) override {
+    const String& body = sharedBodies[_index].body;
+    size_t count = body.length() - _offset;
+    if (count > maxLen) {
+      count = maxLen;
+    }
+    memcpy(buf, body.c_str() + _offset, count);
+    _offset += count;
+    return count;
+  }
+
+ private:
+  int _index;
+  size_t _offset;
+};
+
+static void sendShared(AsyncWebServerRequest *request, int index) {
+  SharedBody& shared = sharedBodies[index];
+  shared.refs++;
+  shared.endpoint->inFlight++;
+  request->send(new SharedBodyResponse(index));
+}
+
+static int findShared(const GovernedEndpoint& endpoint, const char* key) {
+  unsigned long now = millis();
+  for (int i = 0; i < GOVERNOR_SHARED_BODIES; i++) {
+    const SharedBody& shared = sharedBodies[i];
+    if (shared.endpoint == &endpoint && shared.key[0] != '\0' && strcmp(shared.key, key) == 0 &&
+        (shared.refs > 0 || now - shared.builtMs < endpoint.reuseMs)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Свободный слот или самый старый без ответов в передаче
+static int findFreeShared() {
+  int oldest = -1;
+  for (int i = 0; i < GOVERNOR_SHARED_BODIES; i++) {
+    const SharedBody& shared = sharedBodies[i];
+    if (shared.endpoint == nullptr) {
+      return i;
+    }
+    if (shared.refs == 0 && (oldest < 0 || shared.builtMs - sharedBodies[oldest].builtMs > 0x80000000UL)) {
+      oldest = i;
+    }
+  }
+  return oldest;
+}
+
+bool sendCoalesced(AsyncWebServerRequest *request, GovernedEndpoint& endpoint, const char* key) {
+  int index = findShared(endpoint, key);
+  if (index < 0) {
+    return false;
+  }
+  // Готовое тело ничего не стоит построить, но каждый ответ в передаче держит TCP-буферы
+  if (endpoint.inFlight >= endpoint.maxInFlight) {
+    rejectOverloaded(request, endpoint);
+    return true;
+  }
+  sendShared(request, index);
+  return true;
+}
+
+void sendGoverned(AsyncWebServerRequest *request, GovernedEndpoint& endpoint, const char* key,
+                  size_t estimatedSize, GovernedBuilder builder) {
+  if (sendCoalesced(request, endpoint, key)) {
+    return;
+  }
+  int index = findFreeShared();
+  if (index < 0 || !canAdmit(endpoint, estimatedSize)) {
+    rejectOverloaded(request, endpoint);
+    return;
+  }
+
+  // Старое тело освобождается до построения нового
+  SharedBody& shared = sharedBodies[index];
+  shared.endpoint = nullptr;
+  shared.body = String();
+
+  shared.code = builder(shared.body);
+  shared.endpoint = &endpoint;
+  shared.builtMs = millis();
+  shared.refs = 0;
+  if (shared.code == 200) {
+    strlcpy(shared.key, key, sizeof(shared.key));
+  } else {
+    shared.key[0] = '\0';
+  }
+  sendShared(request, index);
+}
@@ -0,0 +1,42 @@
+#ifndef REQUEST_GOVERNOR_H
+#define REQUEST_GOVERNOR_H
+
+#include <ESPAsyncWebServer.h>
+#include <functional>
+
+// Ограничение нагрузки на тяжелые GET (/api/wifi/scan, /api/temperature/history, /api/data):
+// - одинаковые запросы получают один построенный ответ (общее тело со счетчиком ссылок);
+// - у каждого endpoint свой предел ответов в передаче;
+// - при нехватке кучи ответ не строится: 503 + Retry-After.
+// Все вызовы - из задачи async_tcp, поэтому без блокировок
+#define GOVERNOR_SHARED_BODIES 4         // Готовых тел ответов в памяти одновременно
+#define GOVERNOR_KEY_SIZE 40
+#define GOVERNOR_HEAP_RESERVE 12288      // Наибольший свободный блок после построения ответа не меньше 12 КБ
+
+struct GovernedEndpoint {
+  const char* name;
+  uint8_t maxInFlight;    // Ответов этого endpoint одновременно в передаче
+  uint16_t reuseMs;       // Сколько построенный ответ отдается повторно (0 - только пока он в передаче)
+  uint8_t inFlight;
+  uint32_t rejected;      // Отказов 503 с момента загрузки
+};
+
+#define GOVERNED_ENDPOINT(name, maxInFlight, reuseMs) {name, maxInFlight, reuseMs, 0, 0}
+
+// Строит тело ответа, возвращает HTTP-код
+typedef std::function<int(String& body)> GovernedBuilder;
+
+// Отдать уже построенный ответ с тем же key, если он есть. false - ответа нет, запрос не обработан
+bool sendCoalesced(AsyncWebServerRequest *request, GovernedEndpoint& endpoint, const char* key);
+
+// Ответ с учетом ограничений: повторно использует готовый, иначе проверяет предел и кучу
+// (estimatedSize - примерный размер тела) и строит новый. При перегрузке - 503 + Retry-After
+void sendGoverned(AsyncWebServerRequest *request, GovernedEndpoint& endpoint, const char* key,
+                  size_t estimatedSize, GovernedBuilder builder);
+
+// Для ответов со своим классом (снимок /api/data): admit - перед построением
+// (false - 503 уже отправлен), release - из деструктора ответа
+bool admitResponse(AsyncWebServerRequest *request, GovernedEndpoint& endpoint, size_t estimatedSize);
+void releaseResponse(GovernedEndpoint& endpoint);
+
+#endif
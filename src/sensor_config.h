@@ -50,9 +50,9 @@ struct SensorState {
 extern SensorConfig sensorConfigs[MAX_SENSORS];
 extern SensorState sensorStates[MAX_SENSORS];
 extern int sensorConfigCount;
-extern bool forceReloadSettings;
 
-// Функция загрузки конфигурации (определена в main.cpp)
-void loadSensorConfigs();
+// Функция загрузки конфигурации (определена в main.cpp). false - хранилище настроек занято,
+// кеш не изменен
+bool loadSensorConfigs();
 
 #endif // SENSOR_CONFIG_H
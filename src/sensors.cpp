@@ -12,6 +12,11 @@ extern float currentTemp;
 static uint8_t sensorAddresses[MAX_SENSORS][8];
 static int sensorCount = 0;
 static bool sensorsScanned = false;
+static uint32_t readingsGeneration = 0; // Меняется при каждом чтении и сканировании шины
+// Последние показания: шина опрашивается только из readTemperature() в loop(),
+// остальные задачи (веб, Telegram, дисплей) читают кеш
+static float sensorTemperatures[MAX_SENSORS];
+static uint32_t sensorReadErrors[MAX_SENSORS];
 
 // Функция преобразования адреса в строку
 String addressToString(uint8_t* address) {
@@ -32,7 +37,14 @@ void scanSensors() {
   
   // Ищем все устройства на шине
   for (int i = 0; i < MAX_SENSORS; i++) {
-    if (sensors.getAddress(sensorAddresses[i], i)) {
+    uint8_t address[8];
+    if (sensors.getAddress(address, i)) {
+      // На этом месте теперь другой термометр - его показания и счетчик ошибок начинаются заново
+      if (!sensorsScanned || memcmp(address, sensorAddresses[i], sizeof(address)) != 0) {
+        memcpy(sensorAddresses[i], address, sizeof(address));
+        sensorTemperatures[i] = -127.0;
+        sensorReadErrors[i] = 0;
+      }
       sensorCount++;
     } else {
       break;
@@ -40,6 +52,7 @@ void scanSensors() {
   }
   
   sensorsScanned = true;
+  readingsGeneration++;
   
   Serial.print(F("Found "));
   Serial.print(sensorCount);
@@ -80,18 +93,32 @@ String getSensorAddressString(int index) {
   return addressToString(sensorAddresses[index]);
 }
 
+bool formatSensorAddress(int index, char* out, size_t size) {
+  uint8_t address[8];
+  if (!getSensorAddress(index, address)) {
+    return false;
+  }
+  snprintf(out, size, "%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X",
+           address[0], address[1], address[2], address[3],
+           address[4], address[5], address[6], address[7]);
+  return true;
+}
+
 // Получение температуры датчика по индексу
 float getSensorTemperature(int index) {
   if (index < 0 || index >= sensorCount) {
     return -127.0; // Ошибка чтения
   }
   
-  float temp = sensors.getTempC(sensorAddresses[index]);
-  if (temp == -127.0 || temp == 85.0) {
-    // Ошибка чтения или устройство не отвечает
-    return -127.0;
+  return sensorTemperatures[index];
+}
+
+// Число неудачных чтений термометра с момента его появления на шине
+uint32_t getSensorReadErrors(int index) {
+  if (index < 0 || index >= sensorCount) {
+    return 0;
   }
-  return temp;
+  return sensorReadErrors[index];
 }
 
 // Чтение температуры всех датчиков
@@ -101,6 +128,16 @@ void readTemperature() {
   }
   
   sensors.requestTemperatures();
+
+  for (int i = 0; i < sensorCount; i++) {
+    float temp = sensors.getTempC(sensorAddresses[i]);
+    if (temp == -127.0 || temp == 85.0) {
+      // Ошибка чтения или устройство не отвечает
+      temp = -127.0;
+      sensorReadErrors[i]++;
+    }
+    sensorTemperatures[i] = temp;
+  }
   
   // Читаем температуру первого датчика для обратной совместимости
   if (sensorCount > 0) {
@@ -108,4 +145,9 @@ void readTemperature() {
   } else {
     currentTemp = -127.0;
   }
+  readingsGeneration++;
+}
+
+uint32_t getSensorReadingsGeneration() {
+  return readingsGeneration;
 }
@@ -16,7 +16,10 @@ void readTemperature();
 int getSensorCount();
 bool getSensorAddress(int index, uint8_t* address);
 String getSensorAddressString(int index);
-float getSensorTemperature(int index);
+bool formatSensorAddress(int index, char* out, size_t size); // Адрес "28:FF:..." без выделения heap (24 байта)
+float getSensorTemperature(int index); // Показание последнего readTemperature(), -127.0 - нет данных
+uint32_t getSensorReadErrors(int index); // Неудачные чтения (нет ответа, CRC, 85°C после сброса)
 void scanSensors(); // Сканирование всех датчиков на шине
+uint32_t getSensorReadingsGeneration(); // Поколение показаний: меняется при чтении/сканировании
 
 #endif
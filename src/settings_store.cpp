@@ -0,0 +1,953 @@
+#include "settings_store.h"
+#include <Arduino.h>
+#include <Preferences.h>
+#include <stddef.h>
+#include <math.h>
+#include <SPIFFS.h>
+#include <ArduinoJson.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// Старый файл настроек (до перехода на бинарный блок) - читается только при миграции
+#define LEGACY_SETTINGS_FILE "/settings.json"
+
+#define PREF_NAMESPACE "esp32_thermo"
+#define PREF_SETTINGS_BLOB "settings"
+
+// Старые ключи NVS (версия 0) - читаются только при миграции
+#define PREF_WIFI_SSID "wifi_ssid"
+#define PREF_WIFI_PASS "wifi_pass"
+#define PREF_TG_TOKEN "tg_token"
+#define PREF_TG_CHATID "tg_chatid"
+#define PREF_MQTT_SERVER "mqtt_srv"
+#define PREF_MQTT_PORT "mqtt_port"
+#define PREF_MQTT_USER "mqtt_user"
+#define PREF_MQTT_PASS "mqtt_pass"
+#define PREF_MQTT_TOPIC_ST "mqtt_topic_st"
+#define PREF_MQTT_TOPIC_CT "mqtt_topic_ct"
+#define PREF_MQTT_SEC "mqtt_sec"
+
+#define SETTINGS_BLOB_MAGIC 0x54455354UL  // "TSET"
+
+// Заголовок блока в NVS
+struct SettingsBlobHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t payloadSize;
+  uint32_t crc;          // CRC32 полезной нагрузки
+};
+
+struct SettingsBlob {
+  SettingsBlobHeader header;
+  DeviceSettings payload;
+};
+static_assert(offsetof(SettingsBlob, payload) == sizeof(SettingsBlobHeader),
+              "Settings payload must follow the header without padding");
+
+// Хук миграции: переводит полезную нагрузку блока версии fromVersion в текущую схему.
+// Версия 0 - старое хранение (settings.json в SPIFFS + отдельные ключи NVS), payload пустой
+typedef bool (*SettingsMigrationFn)(const uint8_t* payload, size_t size, DeviceSettings& out);
+
+struct SettingsMigrationStep {
+  uint16_t fromVersion;
+  SettingsMigrationFn migrate;
+};
+
+static bool migrateLegacyStorage(const uint8_t* payload, size_t size, DeviceSettings& out);
+
+static const SettingsMigrationStep settingsMigrations[] = {
+  { 0, migrateLegacyStorage },
+};
+
+static DeviceSettings deviceSettings;
+static SettingsBlob commitBlob;  // Статический буфер для записи (не на стеке задачи)
+static SemaphoreHandle_t settingsStoreMutex = NULL;
+static bool pendingCommit = false;
+static uint32_t pendingChangedSections = 0;
+static volatile uint32_t settingsGeneration = 1;  // Увеличивается при каждом изменении в RAM
+static SettingsCommitState lastCommitState = SETTINGS_COMMIT_IDLE;
+
+struct SettingsSubscriber {
+  uint32_t sectionMask;
+  SettingsChangeCallback callback;
+};
+
+static SettingsSubscriber settingsSubscribers[MAX_SETTINGS_SUBSCRIBERS];
+static int settingsSubscriberCount = 0;
+
+// CRC32 (полином 0xEDB88320), побитовый вариант - блок небольшой, таблица не нужна
+static uint32_t settingsCrc32(const uint8_t* data, size_t len) {
+  uint32_t crc = 0xFFFFFFFFUL;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+static void copyString(char* dst, size_t size, const char* src) {
+  strlcpy(dst, src ? src : "", size);
+}
+
+bool lockSettings(TickType_t timeout) {
+  if (settingsStoreMutex == NULL) return true; // До инициализации - однопоточный старт
+  return xSemaphoreTake(settingsStoreMutex, timeout) == pdTRUE;
+}
+
+void unlockSettings() {
+  if (settingsStoreMutex != NULL) {
+    xSemaphoreGive(settingsStoreMutex);
+  }
+}
+
+DeviceSettings& settingsRef() {
+  return deviceSettings;
+}
+
+const char* sensorModeName(uint8_t mode) {
+  switch (mode) {
+    case SENSOR_MODE_ALERT: return "alert";
+    case SENSOR_MODE_STABILIZATION: return "stabilization";
+    default: return "monitoring";
+  }
+}
+
+uint8_t sensorModeFromName(const char* name) {
+  if (name == nullptr) return SENSOR_MODE_MONITORING;
+  if (strcmp(name, "alert") == 0) return SENSOR_MODE_ALERT;
+  if (strcmp(name, "stabilization") == 0) return SENSOR_MODE_STABILIZATION;
+  return SENSOR_MODE_MONITORING;
+}
+
+// ========== Таблицы полей ==========
+// Единый источник значений по умолчанию, допустимых диапазонов и ключей JSON.
+// По ним выполняются сброс к умолчаниям, выдача JSON и применение merge patch (RFC 7396)
+
+enum SettingsFieldType : uint8_t {
+  FIELD_STRING,       // char[], длина строго меньше размера буфера
+  FIELD_HOST,         // char[], пробелы по краям обрезаются, "#" и "null" означают пустое значение
+  FIELD_BOOL,         // uint8_t 0/1
+  FIELD_U8,
+  FIELD_I8,
+  FIELD_U16,
+  FIELD_U32,
+  FIELD_FLOAT,
+  FIELD_SENSOR_MODE   // uint8_t SensorModeId, в JSON - строка
+};
+
+struct SettingsField {
+  const char* key;
+  SettingsFieldType type;
+  uint16_t offset;
+  uint16_t size;
+  float minValue;
+  float maxValue;
+  float defaultValue;
+  const char* defaultString;
+};
+
+struct SettingsGroup {
+  const char* key;            // nullptr - поля лежат в корне объекта
+  uint32_t section;
+  const SettingsField* fields;
+  uint8_t fieldCount;
+};
+
+#define FIELD_AT(type, member) (uint16_t)offsetof(type, member), (uint16_t)sizeof(((type*)0)->member)
+#define STR_FIELD(key, kind, type, member, def) { key, kind, FIELD_AT(type, member), 0, 0, 0, def }
+#define NUM_FIELD(key, kind, type, member, minV, maxV, def) { key, kind, FIELD_AT(type, member), minV, maxV, def, nullptr }
+#define GROUP(key, section, fields) { key, section, fields, sizeof(fields) / sizeof(fields[0]) }
+
+static const SettingsField wifiFields[] = {
+  STR_FIELD("ssid", FIELD_STRING, DeviceSettings, wifiSsid, ""),
+  STR_FIELD("password", FIELD_STRING, DeviceSettings, wifiPassword, ""),
+};
+
+static const SettingsField telegramFields[] = {
+  STR_FIELD("bot_token", FIELD_STRING, DeviceSettings, telegramToken, ""),
+  STR_FIELD("chat_id", FIELD_STRING, DeviceSettings, telegramChatId, ""),
+};
+
+static const SettingsField mqttFields[] = {
+  STR_FIELD("server", FIELD_HOST, DeviceSettings, mqttServer, ""),
+  NUM_FIELD("port", FIELD_U16, DeviceSettings, mqttPort, 1, 65535, 1883),
+  STR_FIELD("user", FIELD_STRING, DeviceSettings, mqttUser, ""),
+  STR_FIELD("password", FIELD_STRING, DeviceSettings, mqttPassword, ""),
+  STR_FIELD("topic_status", FIELD_STRING, DeviceSettings, mqttTopicStatus, "home/thermo/status"),
+  STR_FIELD("topic_control", FIELD_STRING, DeviceSettings, mqttTopicControl, "home/thermo/control"),
+  STR_FIELD("security", FIELD_STRING, DeviceSettings, mqttSecurity, "none"),
+};
+
+static const SettingsField temperatureFields[] = {
+  NUM_FIELD("high_threshold", FIELD_FLOAT, DeviceSettings, highThreshold, -55, 125, 30.0f),
+  NUM_FIELD("low_threshold", FIELD_FLOAT, DeviceSettings, lowThreshold, -55, 125, 10.0f),
+};
+
+static const SettingsField timezoneFields[] = {
+  NUM_FIELD("offset", FIELD_I8, DeviceSettings, timezoneOffset, -12, 14, 3),  // UTC+3 по умолчанию
+};
+
+static const SettingsField rootFields[] = {
+  NUM_FIELD("operation_mode", FIELD_U8, DeviceSettings, operationMode, 0, 3, 0),  // MODE_LOCAL
+};
+
+static const SettingsField alertFields[] = {
+  NUM_FIELD("min_temp", FIELD_FLOAT, DeviceSettings, alertMinTemp, -55, 125, 10.0f),
+  NUM_FIELD("max_temp", FIELD_FLOAT, DeviceSettings, alertMaxTemp, -55, 125, 30.0f),
+  NUM_FIELD("buzzer_enabled", FIELD_BOOL, DeviceSettings, alertBuzzerEnabled, 0, 1, 1),
+};
+
+static const SettingsField stabilizationFields[] = {
+  NUM_FIELD("tolerance", FIELD_FLOAT, DeviceSettings, stabTolerance, 0.01f, 5, 0.1f),
+  NUM_FIELD("alert_threshold", FIELD_FLOAT, DeviceSettings, stabAlertThreshold, 0.05f, 10, 0.2f),
+  NUM_FIELD("duration", FIELD_U32, DeviceSettings, stabDuration, 10, 86400, 600),  // секунды
+};
+
+static const SettingsGroup deviceGroups[] = {
+  GROUP("wifi", SETTINGS_SECTION_WIFI, wifiFields),
+  GROUP("telegram", SETTINGS_SECTION_TELEGRAM, telegramFields),
+  GROUP("mqtt", SETTINGS_SECTION_MQTT, mqttFields),
+  GROUP("temperature", SETTINGS_SECTION_TEMPERATURE, temperatureFields),
+  GROUP("timezone", SETTINGS_SECTION_TIMEZONE, timezoneFields),
+  GROUP(nullptr, SETTINGS_SECTION_OPERATION_MODE, rootFields),
+  GROUP("alert", SETTINGS_SECTION_ALERT, alertFields),
+  GROUP("stabilization", SETTINGS_SECTION_STABILIZATION, stabilizationFields),
+};
+
+static const SettingsField sensorFields[] = {
+  STR_FIELD("address", FIELD_STRING, StoredSensorConfig, address, ""),
+  STR_FIELD("name", FIELD_STRING, StoredSensorConfig, name, ""),  // "Термометр N" подставляется при выдаче
+  NUM_FIELD("enabled", FIELD_BOOL, StoredSensorConfig, enabled, 0, 1, 1),
+  NUM_FIELD("correction", FIELD_FLOAT, StoredSensorConfig, correction, -10, 10, 0.0f),
+  NUM_FIELD("mode", FIELD_SENSOR_MODE, StoredSensorConfig, mode, 0, 2, SENSOR_MODE_MONITORING),
+  NUM_FIELD("monitoringInterval", FIELD_U16, StoredSensorConfig, monitoringInterval, 1, 3600, 5),
+  NUM_FIELD("sendToNetworks", FIELD_BOOL, StoredSensorConfig, sendToNetworks, 0, 1, 1),
+  NUM_FIELD("buzzerEnabled", FIELD_BOOL, StoredSensorConfig, buzzerEnabled, 0, 1, 0),
+};
+
+static const SettingsField sensorAlertFields[] = {
+  NUM_FIELD("minTemp", FIELD_FLOAT, StoredSensorConfig, alertMinTemp, -55, 125, 10.0f),
+  NUM_FIELD("maxTemp", FIELD_FLOAT, StoredSensorConfig, alertMaxTemp, -55, 125, 30.0f),
+  NUM_FIELD("buzzerEnabled", FIELD_BOOL, StoredSensorConfig, alertBuzzerEnabled, 0, 1, 1),
+};
+
+static const SettingsField sensorStabilizationFields[] = {
+  NUM_FIELD("tolerance", FIELD_FLOAT, StoredSensorConfig, stabTolerance, 0.01f, 5, 0.1f),
+  NUM_FIELD("alertThreshold", FIELD_FLOAT, StoredSensorConfig, stabAlertThreshold, 0.05f, 10, 0.2f),
+  NUM_FIELD("duration", FIELD_U16, StoredSensorConfig, stabDurationMin, 1, 60, 10),  // минуты
+  NUM_FIELD("buzzerEnabled", FIELD_BOOL, StoredSensorConfig, stabBuzzerEnabled, 0, 1, 1),
+};
+
+static const SettingsGroup sensorGroups[] = {
+  GROUP(nullptr, SETTINGS_SECTION_SENSORS, sensorFields),
+  GROUP("alertSettings", SETTINGS_SECTION_SENSORS, sensorAlertFields),
+  GROUP("stabilizationSettings", SETTINGS_SECTION_SENSORS, sensorStabilizationFields),
+};
+
+#define GROUP_COUNT(groups) (sizeof(groups) / sizeof(groups[0]))
+
+static void setFieldNumber(const SettingsField& field, uint8_t* base, float value) {
+  uint8_t* ptr = base + field.offset;
+  switch (field.type) {
+    case FIELD_BOOL: *ptr = value != 0.0f ? 1 : 0; break;
+    case FIELD_U8:
+    case FIELD_SENSOR_MODE: *ptr = (uint8_t)lroundf(value); break;
+    case FIELD_I8: *(int8_t*)ptr = (int8_t)lroundf(value); break;
+    case FIELD_U16: { uint16_t v = (uint16_t)lroundf(value); memcpy(ptr, &v, sizeof(v)); break; }
+    case FIELD_U32: { uint32_t v = (uint32_t)lroundf(value); memcpy(ptr, &v, sizeof(v)); break; }
+    case FIELD_FLOAT: memcpy(ptr, &value, sizeof(value)); break;
+    default: break;
+  }
+}
+
+static float getFieldNumber(const SettingsField& field, const uint8_t* base) {
+  const uint8_t* ptr = base + field.offset;
+  switch (field.type) {
+    case FIELD_BOOL:
+    case FIELD_U8:
+    case FIELD_SENSOR_MODE: return *ptr;
+    case FIELD_I8: return *(const int8_t*)ptr;
+    case FIELD_U16: { uint16_t v; memcpy(&v, ptr, sizeof(v)); return v; }
+    case FIELD_U32: { uint32_t v; memcpy(&v, ptr, sizeof(v)); return v; }
+    case FIELD_FLOAT: { float v; memcpy(&v, ptr, sizeof(v)); return v; }
+    default: return 0.0f;
+  }
+}
+
+static void setFieldDefault(const SettingsField& field, uint8_t* base) {
+  if (field.type == FIELD_STRING || field.type == FIELD_HOST) {
+    copyString((char*)(base + field.offset), field.size, field.defaultString);
+  } else {
+    setFieldNumber(field, base, field.defaultValue);
+  }
+}
+
+static void setGroupsDefault(const SettingsGroup* groups, size_t groupCount, uint8_t* base) {
+  for (size_t g = 0; g < groupCount; g++) {
+    for (uint8_t f = 0; f < groups[g].fieldCount; f++) {
+      setFieldDefault(groups[g].fields[f], base);
+    }
+  }
+}
+
+static void fieldToJson(const SettingsField& field, const uint8_t* base, JsonObject obj) {
+  switch (field.type) {
+    case FIELD_STRING:
+    case FIELD_HOST:
+      // char* (не const) - ArduinoJson копирует строку: документ может жить дольше блокировки
+      obj[field.key] = (char*)(base + field.offset);
+      break;
+    case FIELD_BOOL:
+      obj[field.key] = base[field.offset] != 0;
+      break;
+    case FIELD_SENSOR_MODE:
+      obj[field.key] = sensorModeName(base[field.offset]);
+      break;
+    case FIELD_FLOAT:
+      obj[field.key] = getFieldNumber(field, base);
+      break;
+    default:
+      obj[field.key] = (long)getFieldNumber(field, base);
+      break;
+  }
+}
+
+static void groupsToJson(const SettingsGroup* groups, size_t groupCount, const uint8_t* base, JsonObject obj) {
+  for (size_t g = 0; g < groupCount; g++) {
+    JsonObject target = groups[g].key ? obj.createNestedObject(groups[g].key) : obj;
+    for (uint8_t f = 0; f < groups[g].fieldCount; f++) {
+      fieldToJson(groups[g].fields[f], base, target);
+    }
+  }
+}
+
+void setDefaultSensorConfig(StoredSensorConfig& sensor, int index) {
+  (void)index; // Имя по умолчанию ("Термометр N") подставляется при выдаче, пустое не храним
+  memset(&sensor, 0, sizeof(sensor));
+  setGroupsDefault(sensorGroups, GROUP_COUNT(sensorGroups), (uint8_t*)&sensor);
+}
+
+void setDefaultSettings(DeviceSettings& settings) {
+  memset(&settings, 0, sizeof(settings));
+  setGroupsDefault(deviceGroups, GROUP_COUNT(deviceGroups), (uint8_t*)&settings);
+  settings.sensorCount = 0;
+}
+
+int findStoredSensor(const DeviceSettings& settings, const char* address) {
+  if (address == nullptr || address[0] == '\0') return -1;
+  for (int i = 0; i < settings.sensorCount && i < MAX_SENSORS; i++) {
+    if (strcmp(settings.sensors[i].address, address) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// ========== JSON (только для HTTP API и миграции) ==========
+
+void sensorToJson(const StoredSensorConfig& sensor, JsonObject obj) {
+  groupsToJson(sensorGroups, GROUP_COUNT(sensorGroups), (const uint8_t*)&sensor, obj);
+}
+
+void settingsToJson(const DeviceSettings& settings, JsonDocument& doc) {
+  JsonObject root = doc.to<JsonObject>();
+  groupsToJson(deviceGroups, GROUP_COUNT(deviceGroups), (const uint8_t*)&settings, root);
+
+  JsonArray sensorsArray = root.createNestedArray("sensors");
+  for (int i = 0; i < settings.sensorCount && i < MAX_SENSORS; i++) {
+    sensorToJson(settings.sensors[i], sensorsArray.createNestedObject());
+  }
+}
+
+// ========== Merge patch (RFC 7396) ==========
+
+enum FieldStatus : uint8_t {
+  FIELD_STATUS_OK,
+  FIELD_STATUS_WRONG_TYPE,
+  FIELD_STATUS_OUT_OF_RANGE,
+  FIELD_STATUS_TOO_LONG
+};
+
+static const char* fieldStatusText(FieldStatus status) {
+  switch (status) {
+    case FIELD_STATUS_WRONG_TYPE: return "wrong type";
+    case FIELD_STATUS_OUT_OF_RANGE: return "out of range";
+    case FIELD_STATUS_TOO_LONG: return "too long";
+    default: return "ok";
+  }
+}
+
+// Запись одного поля из patch. null - сброс к значению по умолчанию.
+// strict: значение вне диапазона отклоняется; иначе ограничивается (строки обрезаются)
+static FieldStatus writeField(const SettingsField& field, uint8_t* base, JsonVariantConst value, bool strict) {
+  if (value.isNull()) {
+    setFieldDefault(field, base);
+    return FIELD_STATUS_OK;
+  }
+
+  switch (field.type) {
+    case FIELD_STRING:
+    case FIELD_HOST: {
+      if (!value.is<const char*>()) return FIELD_STATUS_WRONG_TYPE;
+      const char* str = value.as<const char*>();
+      size_t len = strlen(str);
+      if (field.type == FIELD_HOST) {
+        while (len > 0 && isspace((unsigned char)*str)) { str++; len--; }
+        while (len > 0 && isspace((unsigned char)str[len - 1])) len--;
+        if ((len == 1 && str[0] == '#') || (len == 4 && strncmp(str, "null", 4) == 0)) len = 0;
+      }
+      if (len >= field.size) {
+        if (strict) return FIELD_STATUS_TOO_LONG;
+        len = field.size - 1;
+      }
+      char* dst = (char*)(base + field.offset);
+      memcpy(dst, str, len);
+      dst[len] = '\0';
+      return FIELD_STATUS_OK;
+    }
+
+    case FIELD_BOOL:
+      if (!value.is<bool>()) return FIELD_STATUS_WRONG_TYPE;
+      base[field.offset] = value.as<bool>() ? 1 : 0;
+      return FIELD_STATUS_OK;
+
+    case FIELD_SENSOR_MODE: {
+      if (!value.is<const char*>()) return FIELD_STATUS_WRONG_TYPE;
+      const char* name = value.as<const char*>();
+      uint8_t mode = sensorModeFromName(name);
+      if (strict && strcmp(sensorModeName(mode), name) != 0) return FIELD_STATUS_OUT_OF_RANGE;
+      base[field.offset] = mode;
+      return FIELD_STATUS_OK;
+    }
+
+    default: {
+      if (!value.is<float>()) return FIELD_STATUS_WRONG_TYPE;
+      float v = value.as<float>();
+      if (isnan(v)) return FIELD_STATUS_WRONG_TYPE;
+      if (v < field.minValue || v > field.maxValue) {
+        if (strict) return FIELD_STATUS_OUT_OF_RANGE;
+        v = constrain(v, field.minValue, field.maxValue);
+      }
+      setFieldNumber(field, base, v);
+      return FIELD_STATUS_OK;
+    }
+  }
+}
+
+static void setPatchError(SettingsPatchResult& result, const char* prefix, const char* group, const char* key, const char* text) {
+  snprintf(result.error, sizeof(result.error), "%s%s%s%s: %s",
+           prefix, group ? group : "", (group && key) ? "." : "", key ? key : "", text);
+}
+
+// Слияние объекта patch с набором групп полей. Неизвестные ключи игнорируются.
+// Возвращает false при ошибке валидации в strict-режиме
+static bool mergeGroups(const SettingsGroup* groups, size_t groupCount, JsonObjectConst patch, uint8_t* base,
+                        uint32_t allowedSections, bool strict, const char* prefix, SettingsPatchResult& result) {
+  for (size_t g = 0; g < groupCount; g++) {
+    const SettingsGroup& group = groups[g];
+    JsonObjectConst groupPatch;
+
+    if (group.key != nullptr) {
+      if (!patch.containsKey(group.key)) continue;
+      JsonVariantConst value = patch[group.key];
+      if (!(allowedSections & group.section)) {
+        if (strict) { setPatchError(result, prefix, group.key, nullptr, "not allowed here"); return false; }
+        continue;
+      }
+      result.changedSections |= group.section;
+      if (value.isNull()) {
+        // null для раздела - сброс всех его полей
+        for (uint8_t f = 0; f < group.fieldCount; f++) setFieldDefault(group.fields[f], base);
+        continue;
+      }
+      if (!value.is<JsonObjectConst>()) {
+        if (strict) { setPatchError(result, prefix, group.key, nullptr, "wrong type"); return false; }
+        continue;
+      }
+      groupPatch = value.as<JsonObjectConst>();
+    } else {
+      groupPatch = patch;
+    }
+
+    for (uint8_t f = 0; f < group.fieldCount; f++) {
+      const SettingsField& field = group.fields[f];
+      if (!groupPatch.containsKey(field.key)) continue;
+      if (group.key == nullptr) {
+        if (!(allowedSections & group.section)) {
+          if (strict) { setPatchError(result, prefix, nullptr, field.key, "not allowed here"); return false; }
+          continue;
+        }
+        result.changedSections |= group.section;
+      }
+      FieldStatus status = writeField(field, base, groupPatch[field.key], strict);
+      if (status != FIELD_STATUS_OK && strict) {
+        setPatchError(result, prefix, group.key, field.key, fieldStatusText(status));
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Применение merge patch к settings. В strict-режиме при ошибке settings остаются
+// частично измененными - вызывающий применяет patch к копии
+static bool applySettingsPatch(JsonVariantConst patch, DeviceSettings& settings, uint32_t allowedSections,
+                               bool strict, SettingsPatchResult& result) {
+  if (!patch.is<JsonObjectConst>()) {
+    copyString(result.error, sizeof(result.error), "patch must be a JSON object");
+    return false;
+  }
+  JsonObjectConst root = patch.as<JsonObjectConst>();
+
+  if (!mergeGroups(deviceGroups, GROUP_COUNT(deviceGroups), root, (uint8_t*)&settings,
+                   allowedSections, strict, "", result)) {
+    return false;
+  }
+
+  if (!root.containsKey("sensors")) {
+    return true;
+  }
+  if (!(allowedSections & SETTINGS_SECTION_SENSORS)) {
+    if (!strict) return true;
+    copyString(result.error, sizeof(result.error), "sensors: not allowed here");
+    return false;
+  }
+
+  // Массив по RFC 7396 заменяется целиком: отсутствующие поля термометра - значения по умолчанию
+  JsonVariantConst sensorsValue = root["sensors"];
+  result.changedSections |= SETTINGS_SECTION_SENSORS;
+  if (sensorsValue.isNull()) {
+    settings.sensorCount = 0;
+    return true;
+  }
+  if (!sensorsValue.is<JsonArrayConst>()) {
+    if (!strict) return true;
+    copyString(result.error, sizeof(result.error), "sensors: wrong type");
+    return false;
+  }
+  JsonArrayConst sensorsArray = sensorsValue.as<JsonArrayConst>();
+  if (strict && sensorsArray.size() > MAX_SENSORS) {
+    copyString(result.error, sizeof(result.error), "sensors: too many");
+    return false;
+  }
+
+  int count = 0;
+  char prefix[16];
+  for (JsonVariantConst item : sensorsArray) {
+    if (count >= MAX_SENSORS) break;
+    snprintf(prefix, sizeof(prefix), "sensors[%d].", count);
+    if (!item.is<JsonObjectConst>()) {
+      if (!strict) continue;
+      setPatchError(result, prefix, nullptr, nullptr, "wrong type");
+      return false;
+    }
+    StoredSensorConfig& sensor = settings.sensors[count];
+    setDefaultSensorConfig(sensor, count);
+    if (!mergeGroups(sensorGroups, GROUP_COUNT(sensorGroups), item.as<JsonObjectConst>(), (uint8_t*)&sensor,
+                     SETTINGS_SECTION_ALL, strict, prefix, result)) {
+      return false;
+    }
+    count++;
+  }
+  settings.sensorCount = count;
+  return true;
+}
+
+static DeviceSettings patchScratch;  // Копия для атомарного применения patch (не на стеке async_tcp)
+
+SettingsPatchStatus patchSettings(JsonVariantConst patch, uint32_t allowedSections, SettingsPatchResult& result) {
+  result.changedSections = 0;
+  result.error[0] = '\0';
+
+  if (!lockSettings(pdMS_TO_TICKS(500))) {
+    copyString(result.error, sizeof(result.error), "settings store busy");
+    return SETTINGS_PATCH_BUSY;
+  }
+
+  memcpy(&patchScratch, &deviceSettings, sizeof(DeviceSettings));
+  bool ok = applySettingsPatch(patch, patchScratch, allowedSections, true, result);
+  if (ok && result.changedSections != 0) {
+    memcpy(&deviceSettings, &patchScratch, sizeof(DeviceSettings));
+    pendingCommit = true;
+    pendingChangedSections |= result.changedSections;
+    settingsGeneration++;
+  }
+  unlockSettings();
+
+  if (!ok) {
+    Serial.print(F("Settings patch rejected: "));
+    Serial.println(result.error);
+    return SETTINGS_PATCH_INVALID;
+  }
+  return SETTINGS_PATCH_OK;
+}
+
+// Элемент пакета: merge patch к термометру в settings (под блокировкой, settings - копия)
+static bool applySensorBatchItem(JsonVariantConst item, DeviceSettings& settings, SensorBatchItemResult& itemResult) {
+  SettingsPatchResult patchResult;
+  patchResult.changedSections = 0;
+  patchResult.error[0] = '\0';
+
+  if (!item.is<JsonObjectConst>()) {
+    copyString(itemResult.error, sizeof(itemResult.error), "wrong type");
+    return false;
+  }
+  JsonObjectConst patch = item.as<JsonObjectConst>();
+  const char* address = patch["address"] | "";
+  copyString(itemResult.address, sizeof(itemResult.address), address);
+  if (address[0] == '\0' || strlen(address) >= sizeof(itemResult.address)) {
+    copyString(itemResult.error, sizeof(itemResult.error), "address: required");
+    return false;
+  }
+
+  int index = findStoredSensor(settings, address);
+  itemResult.status = SENSOR_BATCH_UPDATED;
+  if (index < 0) {
+    if (settings.sensorCount >= MAX_SENSORS) {
+      copyString(itemResult.error, sizeof(itemResult.error), "sensors: too many");
+      return false;
+    }
+    index = settings.sensorCount++;
+    setDefaultSensorConfig(settings.sensors[index], index);
+    copyString(settings.sensors[index].address, sizeof(settings.sensors[index].address), address);
+    itemResult.status = SENSOR_BATCH_CREATED;
+  }
+
+  if (!mergeGroups(sensorGroups, GROUP_COUNT(sensorGroups), patch, (uint8_t*)&settings.sensors[index],
+                   SETTINGS_SECTION_ALL, true, "", patchResult)) {
+    copyString(itemResult.error, sizeof(itemResult.error), patchResult.error);
+    return false;
+  }
+  return true;
+}
+
+SettingsPatchStatus patchSensorsBatch(JsonVariantConst batch, SensorBatchResult& result) {
+  memset(&result, 0, sizeof(result));
+
+  JsonArrayConst items = batch["sensors"].as<JsonArrayConst>();
+  if (!batch.is<JsonObjectConst>() || items.isNull()) {
+    copyString(result.error, sizeof(result.error), "sensors: array required");
+    return SETTINGS_PATCH_INVALID;
+  }
+  if (items.size() > MAX_SENSORS) {
+    copyString(result.error, sizeof(result.error), "sensors: too many");
+    return SETTINGS_PATCH_INVALID;
+  }
+
+  if (!lockSettings(pdMS_TO_TICKS(500))) {
+    copyString(result.error, sizeof(result.error), "settings store busy");
+    return SETTINGS_PATCH_BUSY;
+  }
+
+  memcpy(&patchScratch, &deviceSettings, sizeof(DeviceSettings));
+
+  // Остальные разделы - тем же patch, что и /api/settings, но без массива sensors
+  bool ok = true;
+  JsonVariantConst settingsPatch = batch["settings"];
+  if (!settingsPatch.isNull()) {
+    SettingsPatchResult patchResult;
+    patchResult.changedSections = 0;
+    patchResult.error[0] = '\0';
+    ok = applySettingsPatch(settingsPatch, patchScratch, SETTINGS_SECTION_ALL & ~SETTINGS_SECTION_SENSORS,
+                            true, patchResult);
+    if (ok) {
+      result.changedSections |= patchResult.changedSections;
+    } else {
+      snprintf(result.error, sizeof(result.error), "settings.%s", patchResult.error);
+    }
+  }
+
+  // Все элементы проверяются даже после первой ошибки: клиент получает полный список
+  for (JsonVariantConst item : items) {
+    SensorBatchItemResult& itemResult = result.items[result.itemCount++];
+    if (!applySensorBatchItem(item, patchScratch, itemResult)) {
+      itemResult.status = SENSOR_BATCH_INVALID;
+      result.failedCount++;
+    }
+  }
+  if (result.itemCount > 0) {
+    result.changedSections |= SETTINGS_SECTION_SENSORS;
+  }
+
+  ok = ok && result.failedCount == 0;
+  if (ok && result.changedSections != 0) {
+    memcpy(&deviceSettings, &patchScratch, sizeof(DeviceSettings));
+    pendingCommit = true;
+    pendingChangedSections |= result.changedSections;
+    settingsGeneration++;
+  }
+  unlockSettings();
+
+  if (!ok) {
+    for (uint8_t i = 0; i < result.itemCount; i++) {
+      if (result.items[i].status != SENSOR_BATCH_INVALID) {
+        result.items[i].status = SENSOR_BATCH_SKIPPED;
+      }
+    }
+    result.changedSections = 0;
+    Serial.print(F("Sensor batch rejected: "));
+    if (result.error[0] != '\0') {
+      Serial.println(result.error);
+    } else {
+      Serial.print(result.failedCount);
+      Serial.println(F(" invalid item(s)"));
+    }
+    return SETTINGS_PATCH_INVALID;
+  }
+
+  Serial.print(F("Sensor batch applied: "));
+  Serial.print(result.itemCount);
+  Serial.println(F(" item(s)"));
+  return SETTINGS_PATCH_OK;
+}
+
+// ========== Миграция ==========
+
+// Версия 0: settings.json в SPIFFS, критичные настройки продублированы отдельными ключами NVS.
+// Ключи NVS имели приоритет над файлом - сохраняем это поведение
+static bool migrateLegacyStorage(const uint8_t* payload, size_t size, DeviceSettings& out) {
+  (void)payload;
+  (void)size;
+  setDefaultSettings(out);
+  bool found = false;
+
+  File file = SPIFFS.open(LEGACY_SETTINGS_FILE, "r");
+  if (file) {
+    size_t fileSize = file.size();
+    if (fileSize > 0 && fileSize < 16384) {
+      DynamicJsonDocument* doc = new DynamicJsonDocument(8192);
+      if (doc != nullptr) {
+        DeserializationError error = deserializeJson(*doc, file);
+        if (!error) {
+          // Старый файл мог содержать значения вне диапазонов - ограничиваем, а не отклоняем
+          SettingsPatchResult result = {};
+          applySettingsPatch(doc->as<JsonVariantConst>(), out, SETTINGS_SECTION_ALL, false, result);
+          found = true;
+          Serial.println(F("Settings migration: settings.json imported"));
+        } else {
+          Serial.print(F("Settings migration: settings.json parse error: "));
+          Serial.println(error.c_str());
+        }
+        delete doc;
+      }
+    }
+    file.close();
+  }
+
+  Preferences legacy;
+  if (legacy.begin(PREF_NAMESPACE, true)) {
+    String wifiSsid = legacy.isKey(PREF_WIFI_SSID) ? legacy.getString(PREF_WIFI_SSID, "") : "";
+    if (wifiSsid.length() > 0) {
+      copyString(out.wifiSsid, sizeof(out.wifiSsid), wifiSsid.c_str());
+      copyString(out.wifiPassword, sizeof(out.wifiPassword), legacy.getString(PREF_WIFI_PASS, "").c_str());
+      found = true;
+    }
+    String tgToken = legacy.isKey(PREF_TG_TOKEN) ? legacy.getString(PREF_TG_TOKEN, "") : "";
+    if (tgToken.length() > 0) {
+      copyString(out.telegramToken, sizeof(out.telegramToken), tgToken.c_str());
+      copyString(out.telegramChatId, sizeof(out.telegramChatId), legacy.getString(PREF_TG_CHATID, "").c_str());
+      found = true;
+    }
+    String mqttServer = legacy.isKey(PREF_MQTT_SERVER) ? legacy.getString(PREF_MQTT_SERVER, "") : "";
+    if (mqttServer.length() > 0) {
+      copyString(out.mqttServer, sizeof(out.mqttServer), mqttServer.c_str());
+      int port = legacy.getInt(PREF_MQTT_PORT, 0);
+      if (port > 0 && port <= 65535) {
+        out.mqttPort = port;
+      }
+      copyString(out.mqttUser, sizeof(out.mqttUser), legacy.getString(PREF_MQTT_USER, "").c_str());
+      copyString(out.mqttPassword, sizeof(out.mqttPassword), legacy.getString(PREF_MQTT_PASS, "").c_str());
+      if (legacy.isKey(PREF_MQTT_TOPIC_ST)) {
+        copyString(out.mqttTopicStatus, sizeof(out.mqttTopicStatus), legacy.getString(PREF_MQTT_TOPIC_ST, "").c_str());
+      }
+      if (legacy.isKey(PREF_MQTT_TOPIC_CT)) {
+        copyString(out.mqttTopicControl, sizeof(out.mqttTopicControl), legacy.getString(PREF_MQTT_TOPIC_CT, "").c_str());
+      }
+      if (legacy.isKey(PREF_MQTT_SEC)) {
+        copyString(out.mqttSecurity, sizeof(out.mqttSecurity), legacy.getString(PREF_MQTT_SEC, "").c_str());
+      }
+      found = true;
+    }
+    legacy.end();
+  }
+
+  return found;
+}
+
+static bool runSettingsMigration(uint16_t fromVersion, const uint8_t* payload, size_t size, DeviceSettings& out) {
+  for (size_t i = 0; i < sizeof(settingsMigrations) / sizeof(settingsMigrations[0]); i++) {
+    if (settingsMigrations[i].fromVersion == fromVersion) {
+      Serial.print(F("Settings migration from schema v"));
+      Serial.println(fromVersion);
+      return settingsMigrations[i].migrate(payload, size, out);
+    }
+  }
+  Serial.print(F("Settings: no migration from schema v"));
+  Serial.println(fromVersion);
+  return false;
+}
+
+// ========== NVS ==========
+
+void initSettingsStore() {
+  if (settingsStoreMutex == NULL) {
+    settingsStoreMutex = xSemaphoreCreateMutex();
+    if (settingsStoreMutex == NULL) {
+      Serial.println(F("WARNING: Failed to create settings store mutex"));
+    }
+  }
+
+  setDefaultSettings(deviceSettings);
+
+  Preferences prefs;
+  size_t storedSize = 0;
+  bool loaded = false;
+  bool migrated = false;
+
+  if (prefs.begin(PREF_NAMESPACE, true)) {
+    storedSize = prefs.isKey(PREF_SETTINGS_BLOB) ? prefs.getBytesLength(PREF_SETTINGS_BLOB) : 0;
+
+    if (storedSize >= sizeof(SettingsBlobHeader)) {
+      // Основной путь (блок текущего размера): один getBytes() прямо в статический буфер.
+      // Другой размер - вероятно, другая версия схемы: буфер в куче на время миграции
+      uint8_t* raw = storedSize == sizeof(SettingsBlob) ? (uint8_t*)&commitBlob : (uint8_t*)malloc(storedSize);
+      if (raw != nullptr) {
+        prefs.getBytes(PREF_SETTINGS_BLOB, raw, storedSize);
+        SettingsBlobHeader header;
+        memcpy(&header, raw, sizeof(header));
+        const uint8_t* payload = raw + sizeof(header);
+        size_t payloadSize = storedSize - sizeof(header);
+        if (header.magic != SETTINGS_BLOB_MAGIC ||
+            header.payloadSize != payloadSize ||
+            header.crc != settingsCrc32(payload, payloadSize)) {
+          Serial.println(F("Settings blob: corrupted, ignoring"));
+        } else if (header.version == SETTINGS_SCHEMA_VERSION && payloadSize == sizeof(DeviceSettings)) {
+          memcpy(&deviceSettings, payload, sizeof(DeviceSettings));
+          loaded = true;
+        } else {
+          // Версия решает, а не размер: схема могла измениться без изменения размера
+          migrated = runSettingsMigration(header.version, payload, payloadSize, deviceSettings);
+        }
+        if (raw != (uint8_t*)&commitBlob) {
+          free(raw);
+        }
+      }
+    }
+    prefs.end();
+  }
+
+  if (!loaded && !migrated && storedSize == 0) {
+    // Блока нет - первый запуск после обновления прошивки
+    migrated = runSettingsMigration(0, nullptr, 0, deviceSettings);
+  }
+
+  if (!loaded && !migrated) {
+    setDefaultSettings(deviceSettings);
+    Serial.println(F("Settings: using defaults"));
+  }
+
+  if (migrated) {
+    commitSettings();
+  }
+
+  if (loaded) {
+    Serial.print(F("Settings loaded from NVS ("));
+    Serial.print(sizeof(SettingsBlob));
+    Serial.println(F(" bytes)"));
+  }
+}
+
+bool commitSettings() {
+  if (!lockSettings(pdMS_TO_TICKS(1000))) {
+    Serial.println(F("Settings commit: lock timeout"));
+    return false;
+  }
+
+  commitBlob.header.magic = SETTINGS_BLOB_MAGIC;
+  commitBlob.header.version = SETTINGS_SCHEMA_VERSION;
+  commitBlob.header.payloadSize = sizeof(DeviceSettings);
+  memcpy(&commitBlob.payload, &deviceSettings, sizeof(DeviceSettings));
+  commitBlob.header.crc = settingsCrc32((const uint8_t*)&commitBlob.payload, sizeof(DeviceSettings));
+
+  Preferences prefs;
+  size_t written = 0;
+  if (prefs.begin(PREF_NAMESPACE, false)) {
+    written = prefs.putBytes(PREF_SETTINGS_BLOB, &commitBlob, sizeof(commitBlob));
+    prefs.end();
+  }
+  pendingCommit = false;
+  lastCommitState = (written == sizeof(commitBlob)) ? SETTINGS_COMMIT_OK : SETTINGS_COMMIT_FAILED;
+  unlockSettings();
+
+  if (written != sizeof(commitBlob)) {
+    Serial.println(F("Settings commit: NVS write failed"));
+    return false;
+  }
+  Serial.println(F("Settings committed to NVS"));
+  return true;
+}
+
+void scheduleSettingsCommit(uint32_t changedSections) {
+  if (lockSettings(pdMS_TO_TICKS(100))) {
+    pendingCommit = true;
+    pendingChangedSections |= changedSections;
+    settingsGeneration++;
+    unlockSettings();
+  }
+}
+
+uint32_t getSettingsGeneration() {
+  return settingsGeneration;
+}
+
+SettingsCommitState getSettingsCommitState() {
+  return pendingCommit ? SETTINGS_COMMIT_PENDING : lastCommitState;
+}
+
+void notifySettingsChanged(uint32_t sections) {
+  if (lockSettings(pdMS_TO_TICKS(100))) {
+    pendingChangedSections |= sections;
+    settingsGeneration++;
+    unlockSettings();
+  }
+}
+
+// Подписчики регистрируются в setup() до запуска loop(), поэтому таблица без блокировки
+bool subscribeSettings(uint32_t sectionMask, SettingsChangeCallback callback) {
+  if (callback == nullptr || settingsSubscriberCount >= MAX_SETTINGS_SUBSCRIBERS) {
+    Serial.println(F("Settings: subscriber table full"));
+    return false;
+  }
+  settingsSubscribers[settingsSubscriberCount].sectionMask = sectionMask;
+  settingsSubscribers[settingsSubscriberCount].callback = callback;
+  settingsSubscriberCount++;
+  return true;
+}
+
+// Отложенная запись блока в NVS и уведомление подписчиков из loop(),
+// чтобы не блокировать WiFi в обработчиках. Без изменений - ничего не делает
+void processPendingNvsSave() {
+  if (!pendingCommit && pendingChangedSections == 0) {
+    return;
+  }
+
+  if (pendingCommit) {
+    commitSettings(); // При ошибке записи настройки в RAM все равно применяются
+  }
+
+  uint32_t changed = 0;
+  if (lockSettings(pdMS_TO_TICKS(100))) {
+    changed = pendingChangedSections;
+    pendingChangedSections = 0;
+    unlockSettings();
+  }
+
+  for (int i = 0; i < settingsSubscriberCount && changed != 0; i++) {
+    uint32_t sections = changed & settingsSubscribers[i].sectionMask;
+    if (sections != 0) {
+      settingsSubscribers[i].callback(sections);
+    }
+  }
+}
@@ -0,0 +1,186 @@
+#ifndef SETTINGS_STORE_H
+#define SETTINGS_STORE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "freertos/FreeRTOS.h"
+#include "sensor_config.h"
+
+// Версия схемы бинарного блока настроек в NVS.
+// При любом изменении DeviceSettings увеличить версию и добавить хук миграции
+// в таблицу settingsMigrations (settings_store.cpp)
+#define SETTINGS_SCHEMA_VERSION 1
+
+// Режим термометра в бинарном виде (в JSON API - строки "monitoring", "alert", "stabilization")
+enum SensorModeId : uint8_t {
+  SENSOR_MODE_MONITORING = 0,
+  SENSOR_MODE_ALERT = 1,
+  SENSOR_MODE_STABILIZATION = 2
+};
+
+// Сохраняемая конфигурация одного термометра (фиксированный размер, без String)
+struct StoredSensorConfig {
+  char address[24];             // "28:FF:..." (23 символа + \0)
+  char name[64];                // Пользовательское имя (UTF-8)
+  uint8_t enabled;
+  uint8_t mode;                 // SensorModeId
+  uint8_t sendToNetworks;
+  uint8_t buzzerEnabled;
+  float correction;             // -10..+10
+  uint16_t monitoringInterval;  // 1..3600 сек
+  uint8_t alertBuzzerEnabled;
+  uint8_t stabBuzzerEnabled;
+  float alertMinTemp;           // -55..+125
+  float alertMaxTemp;           // -55..+125
+  float stabTolerance;          // 0.01..5
+  float stabAlertThreshold;     // 0.05..10
+  uint16_t stabDurationMin;     // 1..60 минут
+};
+
+// Все настройки устройства. Хранятся в NVS одним блоком с CRC
+struct DeviceSettings {
+  char wifiSsid[33];
+  char wifiPassword[65];
+
+  char telegramToken[64];
+  char telegramChatId[32];
+
+  char mqttServer[64];
+  uint16_t mqttPort;
+  char mqttUser[33];
+  char mqttPassword[65];
+  char mqttTopicStatus[96];
+  char mqttTopicControl[96];
+  char mqttSecurity[12];
+
+  float highThreshold;
+  float lowThreshold;
+  int8_t timezoneOffset;
+  uint8_t operationMode;
+
+  // Глобальные настройки режимов (для обратной совместимости)
+  uint8_t alertBuzzerEnabled;
+  float alertMinTemp;
+  float alertMaxTemp;
+  float stabTolerance;
+  float stabAlertThreshold;
+  uint32_t stabDuration;        // секунды
+
+  uint8_t sensorCount;
+  StoredSensorConfig sensors[MAX_SENSORS];
+};
+
+// Разделы настроек для подписки на изменения (битовая маска)
+enum SettingsSection : uint32_t {
+  SETTINGS_SECTION_WIFI = 1UL << 0,
+  SETTINGS_SECTION_TELEGRAM = 1UL << 1,
+  SETTINGS_SECTION_MQTT = 1UL << 2,
+  SETTINGS_SECTION_TIMEZONE = 1UL << 3,
+  SETTINGS_SECTION_OPERATION_MODE = 1UL << 4,
+  SETTINGS_SECTION_ALERT = 1UL << 5,
+  SETTINGS_SECTION_STABILIZATION = 1UL << 6,
+  SETTINGS_SECTION_TEMPERATURE = 1UL << 7,
+  SETTINGS_SECTION_SENSORS = 1UL << 8,
+  SETTINGS_SECTION_ALL = 0xFFFFFFFFUL
+};
+
+// Обработчик изменения настроек. changedSections - измененные разделы из маски подписки.
+// Вызывается из main loop (через processPendingNvsSave), настройки читать под блокировкой
+typedef void (*SettingsChangeCallback)(uint32_t changedSections);
+
+#define MAX_SETTINGS_SUBSCRIBERS 8
+
+// Загрузка настроек при старте: один getBytes() из NVS, без JSON.
+// При отсутствии блока выполняется однократная миграция из settings.json/старых ключей NVS
+void initSettingsStore();
+
+// Доступ к настройкам в RAM. Любое чтение/изменение - только под блокировкой
+bool lockSettings(TickType_t timeout = portMAX_DELAY);
+void unlockSettings();
+DeviceSettings& settingsRef();
+
+// Подписка модуля на изменения разделов настроек
+bool subscribeSettings(uint32_t sectionMask, SettingsChangeCallback callback);
+// Пометить разделы измененными: подписчики будут уведомлены из loop()
+void notifySettingsChanged(uint32_t sections);
+
+// Поколение настроек: увеличивается при каждом изменении в RAM (для кешей и ETag)
+uint32_t getSettingsGeneration();
+
+// Запись блока в NVS (putBytes). Блокирует на время записи во flash
+bool commitSettings();
+// Отложенная запись + уведомление подписчиков: выполняется из loop() через processPendingNvsSave()
+void scheduleSettingsCommit(uint32_t changedSections);
+void processPendingNvsSave();
+
+// Состояние записи в NVS (для /api/settings/status)
+enum SettingsCommitState : uint8_t {
+  SETTINGS_COMMIT_IDLE,     // С момента запуска ничего не сохранялось
+  SETTINGS_COMMIT_PENDING,
+  SETTINGS_COMMIT_OK,
+  SETTINGS_COMMIT_FAILED
+};
+SettingsCommitState getSettingsCommitState();
+
+// Значения по умолчанию
+void setDefaultSettings(DeviceSettings& settings);
+void setDefaultSensorConfig(StoredSensorConfig& sensor, int index);
+
+// Поиск термометра по адресу (-1 если не найден). Вызывать под блокировкой
+int findStoredSensor(const DeviceSettings& settings, const char* address);
+
+// Преобразования режима термометра
+const char* sensorModeName(uint8_t mode);
+uint8_t sensorModeFromName(const char* name);
+
+// Представление для HTTP API
+void settingsToJson(const DeviceSettings& settings, JsonDocument& doc);
+void sensorToJson(const StoredSensorConfig& sensor, JsonObject obj);
+
+// Результат применения merge patch
+enum SettingsPatchStatus : uint8_t {
+  SETTINGS_PATCH_OK,
+  SETTINGS_PATCH_INVALID,  // Ошибка валидации, настройки не изменены
+  SETTINGS_PATCH_BUSY      // Не удалось захватить блокировку
+};
+
+struct SettingsPatchResult {
+  uint32_t changedSections;  // Маска измененных разделов (SettingsSection)
+  char error[64];            // Поле и причина ошибки, например "mqtt.port: out of range"
+};
+
+// JSON Merge Patch (RFC 7396) к настройкам в RAM: объекты сливаются, null сбрасывает
+// поле/раздел к значению по умолчанию, массив sensors заменяется целиком.
+// Каждое поле проверяется по таблице (тип, диапазон, длина); при ошибке ничего не меняется.
+// Разделы вне allowedSections отклоняются. Запись в NVS и уведомление - отложенно из loop()
+SettingsPatchStatus patchSettings(JsonVariantConst patch, uint32_t allowedSections, SettingsPatchResult& result);
+
+// Результат пакетного изменения термометров по каждому элементу
+enum SensorBatchItemStatus : uint8_t {
+  SENSOR_BATCH_UPDATED,
+  SENSOR_BATCH_CREATED,    // Адреса не было в настройках - термометр добавлен
+  SENSOR_BATCH_INVALID,
+  SENSOR_BATCH_SKIPPED     // Элемент корректен, но пакет отклонен из-за ошибок в других
+};
+
+struct SensorBatchItemResult {
+  char address[24];
+  SensorBatchItemStatus status;
+  char error[64];
+};
+
+struct SensorBatchResult {
+  uint32_t changedSections;
+  uint8_t itemCount;
+  uint8_t failedCount;
+  char error[64];            // Ошибка пакета целиком (формат тела, раздел settings)
+  SensorBatchItemResult items[MAX_SENSORS];
+};
+
+// Пакетное изменение термометров одной транзакцией: {"sensors":[{"address":...,<patch>}, ...],
+// "settings":{...}}. Каждый элемент - merge patch к термометру с этим адресом (отсутствующий
+// добавляется), settings - необязательный patch остальных разделов. Проверяются все элементы;
+// при любой ошибке ничего не меняется. Одна отложенная запись в NVS и одно уведомление подписчиков
+SettingsPatchStatus patchSensorsBatch(JsonVariantConst batch, SensorBatchResult& result);
+
+#endif // SETTINGS_STORE_H
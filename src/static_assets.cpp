@@ -0,0 +1,53 @@
+#include "static_assets.h"
+#include "http_stats.h"
+#include <Arduino.h>
+#include "web_assets_data.h"
+
+// Кеширование: HTML всегда перепроверяется по ETag (ответ 304 почти бесплатен),
+// JS/CSS подключаются из HTML со ссылкой ?v=<хеш> и не меняются по этому адресу
+#define CACHE_CONTROL_REVALIDATE "no-cache"
+#define CACHE_CONTROL_IMMUTABLE "public, max-age=31536000, immutable"
+
+#define EMBEDDED_ASSET_COUNT (sizeof(embeddedAssets) / sizeof(embeddedAssets[0]))
+
+static void serveAsset(AsyncWebServerRequest *request, const EmbeddedAsset& asset) {
+  bool isHtml = strcmp(asset.mime, "text/html") == 0;
+  const char* cacheControl = isHtml ? CACHE_CONTROL_REVALIDATE : CACHE_CONTROL_IMMUTABLE;
+
+  if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == asset.etag) {
+    AsyncWebServerResponse *response = request->beginResponse(304);
+    response->addHeader("ETag", asset.etag);
+    response->addHeader("Cache-Control", cacheControl);
+    request->send(response);
+    return;
+  }
+
+  // Ответ из памяти: тело копируется из flash прямо в TCP-буфер по мере отправки
+  AsyncWebServerResponse *response = request->beginResponse(200, asset.mime, asset.data, asset.size);
+  response->addHeader("Content-Encoding", "gzip");
+  response->addHeader("ETag", asset.etag);
+  response->addHeader("Cache-Control", cacheControl);
+  request->send(response);
+}
+
+void registerStaticAssets(AsyncWebServer& server) {
+  size_t totalSize = 0;
+  for (size_t i = 0; i < EMBEDDED_ASSET_COUNT; i++) {
+    const EmbeddedAsset* asset = &embeddedAssets[i];
+    totalSize += asset->size;
+    onRoute(server, asset->url, HTTP_GET, [asset](AsyncWebServerRequest *request){
+      serveAsset(request, *asset);
+    });
+    if (strcmp(asset->url, "/index.html") == 0) {
+      onRoute(server, "/", HTTP_GET, [asset](AsyncWebServerRequest *request){
+        serveAsset(request, *asset);
+      });
+    }
+  }
+
+  Serial.print(F("Web assets: "));
+  Serial.print(EMBEDDED_ASSET_COUNT);
+  Serial.print(F(" files embedded, "));
+  Serial.print(totalSize);
+  Serial.println(F(" bytes gzip"));
+}
@@ -0,0 +1,20 @@
+#ifndef STATIC_ASSETS_H
+#define STATIC_ASSETS_H
+
+#include <ESPAsyncWebServer.h>
+
+// Файл веб-интерфейса, встроенный в прошивку (gzip). Таблица embeddedAssets
+// генерируется scripts/build_web_assets.py в src/web_assets_data.h
+struct EmbeddedAsset {
+  const char* url;     // "/script.js"
+  const char* etag;    // "\"<16 hex>\"" - хеш несжатого содержимого
+  const char* mime;
+  const uint8_t* data; // Во flash (раздел app), читается через кеш без копирования в RAM
+  size_t size;
+};
+
+// Регистрация обработчиков веб-интерфейса. Файлы отдаются из образа прошивки,
+// SPIFFS не используется: веб-интерфейс доступен даже при поврежденной файловой системе
+void registerStaticAssets(AsyncWebServer& server);
+
+#endif
@@ -0,0 +1,161 @@
+#include "telegram_api.h"
+#include "tg_bot.h"
+#include "text_buffer.h"
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define TELEGRAM_API_LINE_SIZE 160     // Строка статуса или заголовка (длиннее - обрезается)
+#define TELEGRAM_API_DISCARD_SIZE 128
+
+// Ожидание данных до срока. false - соединение закрыто или срок прошел
+static bool waitAvailable(WiFiClientSecure& client, unsigned long deadline) {
+  while (client.available() <= 0) {
+    if (!client.connected() || (long)(millis() - deadline) >= 0) {
+      return false;
+    }
+    vTaskDelay(pdMS_TO_TICKS(5));
+  }
+  return true;
+}
+
+// Строка до \n без \r. Длиннее буфера - хвост пропускается. -1 - обрыв или таймаут
+static int readLine(WiFiClientSecure& client, char* line, size_t size, unsigned long deadline) {
+  size_t length = 0;
+  while (true) {
+    if (!waitAvailable(client, deadline)) {
+      return -1;
+    }
+    int c = client.read();
+    if (c < 0) {
+      return -1;
+    }
+    if (c == '\n') {
+      break;
+    }
+    if (c != '\r' && length + 1 < size) {
+      line[length++] = (char)c;
+    }
+  }
+  line[length] = '\0';
+  return (int)length;
+}
+
+// Чтение length байт тела (или до закрытия соединения, если length < 0): в буфер сколько
+// поместится, остальное отбрасывается. false - обрыв или таймаут до конца тела
+static bool readBody(WiFiClientSecure& client, long length, unsigned long deadline,
+                     char* body, size_t bodySize, TelegramApiResponse& response) {
+  char discard[TELEGRAM_API_DISCARD_SIZE];
+  long received = 0;
+  while (length < 0 || received < length) {
+    if (!waitAvailable(client, deadline)) {
+      // Без Content-Length конец тела - закрытие соединения
+      return length < 0 && !client.connected();
+    }
+    size_t want = length < 0 ? (size_t)client.available() : (size_t)(length - received);
+    char* target = discard;
+    size_t room = sizeof(discard);
+    if (response.bodyLength + 1 < bodySize) {
+      target = body + response.bodyLength;
+      room = bodySize - 1 - response.bodyLength;
+    }
+    if (want > room) {
+      want = room;
+    }
+    int count = client.read((uint8_t*)target, want);
+    if (count <= 0) {
+      continue;
+    }
+    if (target == discard) {
+      response.bodyTruncated = true;
+    } else {
+      response.bodyLength += count;
+    }
+    received += count;
+  }
+  return true;
+}
+
+// Поле "ok" ответа равно true. Bot API пишет его первым: проверка верна и для обрезанного тела
+static bool isOkResponse(const char* body) {
+  const char* p = strstr(body, "\"ok\"");
+  if (p == NULL) {
+    return false;
+  }
+  p += 4;
+  while (*p == ' ' || *p == ':') p++;
+  return strncmp(p, "true", 4) == 0;
+}
+
+TelegramApiResult telegramApiPost(WiFiClientSecure& client, const char* token, const char* method,
+                                  const char* json, size_t jsonLength, unsigned long timeoutMs,
+                                  char* body, size_t bodySize, TelegramApiResponse& response) {
+  response.httpStatus = 0;
+  response.bodyLength = 0;
+  response.bodyTruncated = false;
+  body[0] = '\0';
+
+  // Заголовки одной записью TLS, тело - второй
+  TextBuffer<TELEGRAM_API_LINE_SIZE + 96> head;
+  head.add("POST /bot").add(token).add('/').add(method).add(" HTTP/1.1\r\n")
+      .add("Host: " TELEGRAM_API_HOST "\r\n")
+      .add("Content-Type: application/json\r\n")
+      .add("Connection: keep-alive\r\n")
+      .add("Content-Length: ").addUInt(jsonLength).add("\r\n\r\n");
+  if (head.truncated() ||
+      client.write((const uint8_t*)head.c_str(), head.length()) != head.length() ||
+      client.write((const uint8_t*)json, jsonLength) != jsonLength) {
+    client.stop();
+    return TELEGRAM_API_IO_ERROR;
+  }
+
+  unsigned long deadline = millis() + timeoutMs;
+  char line[TELEGRAM_API_LINE_SIZE];
+  if (readLine(client, line, sizeof(line), deadline) < 0 || strncmp(line, "HTTP/1.", 7) != 0) {
+    client.stop();
+    return TELEGRAM_API_IO_ERROR;
+  }
+  const char* status = strchr(line, ' ');
+  response.httpStatus = status ? atoi(status + 1) : 0;
+
+  long contentLength = -1;
+  bool keepAlive = strncmp(line, "HTTP/1.1", 8) == 0;
+  while (true) {
+    int length = readLine(client, line, sizeof(line), deadline);
+    if (length < 0) {
+      client.stop();
+      return TELEGRAM_API_IO_ERROR;
+    }
+    if (length == 0) {
+      break;  // Конец заголовков
+    }
+    if (strncasecmp(line, "Content-Length:", 15) == 0) {
+      contentLength = atol(line + 15);
+    } else if (strncasecmp(line, "Connection:", 11) == 0) {
+      const char* value = line + 11;
+      while (*value == ' ') value++;
+      keepAlive = strncasecmp(value, "close", 5) != 0;
+    } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+      // Bot API отвечает с Content-Length; chunked не разбираем - соединение не переиспользуем
+      keepAlive = false;
+    }
+  }
+  if (contentLength < 0) {
+    keepAlive = false;
+  }
+
+  bool complete = readBody(client, contentLength, deadline, body, bodySize, response);
+  body[response.bodyLength] = '\0';
+  if (!complete || !keepAlive) {
+    client.stop();
+  }
+  if (!complete) {
+    return TELEGRAM_API_IO_ERROR;
+  }
+  if (response.httpStatus != 200 || !isOkResponse(body)) {
+    return TELEGRAM_API_REJECTED;
+  }
+  return TELEGRAM_API_OK;
+}
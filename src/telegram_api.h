@@ -0,0 +1,32 @@
+#ifndef TELEGRAM_API_H
+#define TELEGRAM_API_H
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+
+// Запрос к Bot API по уже открытому TLS-соединению: HTTP/1.1 keep-alive, одна попытка,
+// без повторов и без переподключения внутри (соединение открывает ensureTelegramConnection
+// в tg_bot.cpp - через TELEGRAM_API_HOST/TELEGRAM_API_PORT и автомат DNS).
+// После ответа соединение остается открытым для следующего запроса; после обрыва, таймаута
+// или "Connection: close" закрывается здесь.
+// Тело ответа - в буфер вызывающего (bodySize >= 2); не поместившийся хвост читается и отбрасывается,
+// чтобы следующий ответ по тому же соединению начинался с начала
+enum TelegramApiResult : uint8_t {
+  TELEGRAM_API_OK = 0,       // HTTP 200 и "ok":true
+  TELEGRAM_API_REJECTED,     // API ответил ошибкой: HTTP 4xx/5xx или "ok":false
+  TELEGRAM_API_IO_ERROR      // Соединение закрыто, таймаут, неполный ответ
+};
+
+struct TelegramApiResponse {
+  int httpStatus;            // 0 - ответа не было
+  size_t bodyLength;         // Байт тела в буфере (без нуля)
+  bool bodyTruncated;        // Тело длиннее буфера: хвост отброшен
+};
+
+// POST /bot<token>/<method> с телом JSON длиной jsonLength. timeoutMs - на весь ответ
+// (для длинного опроса - больше его timeout)
+TelegramApiResult telegramApiPost(WiFiClientSecure& client, const char* token, const char* method,
+                                  const char* json, size_t jsonLength, unsigned long timeoutMs,
+                                  char* body, size_t bodySize, TelegramApiResponse& response);
+
+#endif
@@ -0,0 +1,263 @@
+#include "telegram_outbox.h"
+#include "alloc_probe.h"
+#include "text_buffer.h"
+#include <SPIFFS.h>
+#include <stddef.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#define OUTBOX_RECORD_MAGIC 0x5842544FUL  // "OTBX"
+#define OUTBOX_DELIVERED 1
+
+// Запись в файле (1 КБ). delivered не входит в CRC: доставка - перезапись одного байта
+struct OutboxRecord {
+  uint32_t magic;
+  uint32_t sequence;
+  uint32_t unixTime;
+  uint32_t uptimeSec;
+  uint16_t length;
+  uint8_t priority;
+  uint8_t delivered;
+  uint32_t crc;
+  char text[OUTBOX_TEXT_SIZE];
+};
+
+// Индекс в RAM: файл читается только при старте и при выдаче текста
+static uint32_t slotSequence[OUTBOX_CAPACITY];  // 0 - запись пуста
+static bool slotPending[OUTBOX_CAPACITY];
+static uint32_t nextSequence = 1;
+static OutboxRecord recordBuffer;                // Под outboxMutex (не на стеке задачи)
+static SemaphoreHandle_t outboxMutex = NULL;
+static bool outboxAvailable = false;
+static uint32_t outboxStored = 0;
+static uint32_t outboxDelivered = 0;
+static uint32_t outboxDropped = 0;
+
+static uint32_t recordCrc(const OutboxRecord& record) {
+  uint32_t crc = 0xFFFFFFFFUL;
+  const uint8_t* parts[2] = {(const uint8_t*)&record.sequence, (const uint8_t*)record.text};
+  const size_t sizes[2] = {offsetof(OutboxRecord, delivered) - offsetof(OutboxRecord, sequence), record.length};
+  for (int p = 0; p < 2; p++) {
+    for (size_t i = 0; i < sizes[p]; i++) {
+      crc ^= parts[p][i];
+      for (int bit = 0; bit < 8; bit++) {
+        crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+      }
+    }
+  }
+  return ~crc;
+}
+
+// Файл создается один раз полного размера: дальше записи только перезаписываются
+static bool createOutboxFile() {
+  File file = SPIFFS.open(OUTBOX_FILE, "w");
+  if (!file) {
+    return false;
+  }
+  memset(&recordBuffer, 0, sizeof(recordBuffer));
+  bool ok = true;
+  for (int i = 0; i < OUTBOX_CAPACITY && ok; i++) {
+    ok = file.write((const uint8_t*)&recordBuffer, sizeof(recordBuffer)) == sizeof(recordBuffer);
+  }
+  file.close();
+  return ok;
+}
+
+static bool writeRecordBytes(int slot, size_t offset, const uint8_t* data, size_t size) {
+  File file = SPIFFS.open(OUTBOX_FILE, "r+");
+  if (!file) {
+    return false;
+  }
+  bool ok = file.seek(slot * sizeof(OutboxRecord) + offset) &&
+            file.write(data, size) == size;
+  file.close();
+  return ok;
+}
+
+static bool readRecord(int slot) {
+  File file = SPIFFS.open(OUTBOX_FILE, "r");
+  if (!file) {
+    return false;
+  }
+  bool ok = file.seek(slot * sizeof(OutboxRecord)) &&
+            file.read((uint8_t*)&recordBuffer, sizeof(recordBuffer)) == sizeof(recordBuffer);
+  file.close();
+  return ok;
+}
+
+void initTelegramOutbox() {
+  if (outboxMutex == NULL) {
+    outboxMutex = xSemaphoreCreateMutex();
+  }
+  memset(slotSequence, 0, sizeof(slotSequence));
+  memset(slotPending, 0, sizeof(slotPending));
+
+  File file = SPIFFS.open(OUTBOX_FILE, "r");
+  size_t size = file ? file.size() : 0;
+  if (file) {
+    file.close();
+  }
+  if (size != OUTBOX_CAPACITY * sizeof(OutboxRecord)) {
+    outboxAvailable = createOutboxFile();
+    if (!outboxAvailable) {
+      Serial.println(F("ERROR: Failed to create Telegram outbox file"));
+    }
+    return;
+  }
+
+  int pending = 0;
+  for (int i = 0; i < OUTBOX_CAPACITY; i++) {
+    if (!readRecord(i)) {
+      Serial.println(F("ERROR: Failed to read Telegram outbox file"));
+      return;
+    }
+    if (recordBuffer.magic != OUTBOX_RECORD_MAGIC || recordBuffer.length > OUTBOX_TEXT_SIZE ||
+        recordBuffer.crc != recordCrc(recordBuffer)) {
+      continue;  // Пустая или недописанная запись (питание пропало во время записи)
+    }
+    slotSequence[i] = recordBuffer.sequence;
+    slotPending[i] = recordBuffer.delivered != OUTBOX_DELIVERED;
+    if (slotPending[i]) {
+      pending++;
+    }
+    if (recordBuffer.sequence >= nextSequence) {
+      nextSequence = recordBuffer.sequence + 1;
+    }
+  }
+  outboxAvailable = true;
+
+  if (pending > 0) {
+    Serial.print(F("Telegram outbox: "));
+    Serial.print(pending);
+    Serial.println(F(" undelivered alert(s) from before restart"));
+  }
+}
+
+// Запись для нового сообщения: пустая/доставленная с наименьшим номером (равномерный износ),
+// иначе самая старая недоставленная
+static int chooseSlot(bool& overwritesPending) {
+  int best = -1;
+  for (int i = 0; i < OUTBOX_CAPACITY; i++) {
+    if (!slotPending[i] && (best < 0 || slotSequence[i] < slotSequence[best])) {
+      best = i;
+    }
+  }
+  overwritesPending = best < 0;
+  if (overwritesPending) {
+    best = 0;
+    for (int i = 1; i < OUTBOX_CAPACITY; i++) {
+      if (slotSequence[i] < slotSequence[best]) {
+        best = i;
+      }
+    }
+  }
+  return best;
+}
+
+bool storeOutboxMessage(const char* text, uint8_t priority) {
+  if (!outboxAvailable || outboxMutex == NULL || xSemaphoreTake(outboxMutex, pdMS_TO_TICKS(500)) != pdTRUE) {
+    outboxDropped++;
+    return false;
+  }
+  // SPIFFS выделяет память под дескриптор файла - вне учета пути отправки
+  bool probed = allocProbePause();
+
+  bool overwritesPending = false;
+  int slot = chooseSlot(overwritesPending);
+
+  memset(&recordBuffer, 0, sizeof(recordBuffer));
+  time_t now = time(nullptr);
+  recordBuffer.magic = OUTBOX_RECORD_MAGIC;
+  recordBuffer.sequence = nextSequence;
+  recordBuffer.unixTime = now > 1600000000 ? (uint32_t)now : 0;  // До синхронизации NTP - 1970 год
+  recordBuffer.uptimeSec = millis() / 1000;
+  recordBuffer.priority = priority;
+  size_t length = strlen(text);
+  recordBuffer.length = length > OUTBOX_TEXT_SIZE ? utf8PrefixLength(text, OUTBOX_TEXT_SIZE) : length;
+  memcpy(recordBuffer.text, text, recordBuffer.length);
+  recordBuffer.crc = recordCrc(recordBuffer);
+
+  // Пишется только заполненная часть записи
+  bool ok = writeRecordBytes(slot, 0, (const uint8_t*)&recordBuffer,
+                             offsetof(OutboxRecord, text) + recordBuffer.length);
+  if (ok) {
+    if (overwritesPending) {
+      outboxDropped++;
+      Serial.println(F("Telegram outbox full, oldest alert overwritten"));
+    }
+    slotSequence[slot] = nextSequence++;
+    slotPending[slot] = true;
+    outboxStored++;
+  } else {
+    outboxDropped++;
+    Serial.println(F("ERROR: Failed to write Telegram outbox"));
+  }
+  allocProbeResume(probed);
+  xSemaphoreGive(outboxMutex);
+  return ok;
+}
+
+bool peekOutboxMessage(OutboxEntry& entry) {
+  if (!outboxAvailable || outboxMutex == NULL || xSemaphoreTake(outboxMutex, pdMS_TO_TICKS(50)) != pdTRUE) {
+    return false;
+  }
+  bool found = false;
+  while (!found) {
+    int oldest = -1;
+    for (int i = 0; i < OUTBOX_CAPACITY; i++) {
+      if (slotPending[i] && (oldest < 0 || slotSequence[i] < slotSequence[oldest])) {
+        oldest = i;
+      }
+    }
+    if (oldest < 0) {
+      break;
+    }
+    if (!readRecord(oldest) || recordBuffer.sequence != slotSequence[oldest] ||
+        recordBuffer.length > OUTBOX_TEXT_SIZE || recordBuffer.crc != recordCrc(recordBuffer)) {
+      // Запись испорчена - пропускаем, иначе она заблокировала бы остальные
+      slotPending[oldest] = false;
+      outboxDropped++;
+      continue;
+    }
+    entry.sequence = recordBuffer.sequence;
+    entry.unixTime = recordBuffer.unixTime;
+    entry.uptimeSec = recordBuffer.uptimeSec;
+    entry.priority = recordBuffer.priority;
+    memcpy(entry.text, recordBuffer.text, recordBuffer.length);
+    entry.text[recordBuffer.length] = '\0';
+    found = true;
+  }
+  xSemaphoreGive(outboxMutex);
+  return found;
+}
+
+void markOutboxDelivered(uint32_t sequence) {
+  if (!outboxAvailable || outboxMutex == NULL || xSemaphoreTake(outboxMutex, pdMS_TO_TICKS(500)) != pdTRUE) {
+    return;
+  }
+  for (int i = 0; i < OUTBOX_CAPACITY; i++) {
+    if (slotPending[i] && slotSequence[i] == sequence) {
+      uint8_t delivered = OUTBOX_DELIVERED;
+      writeRecordBytes(i, offsetof(OutboxRecord, delivered), &delivered, 1);
+      slotPending[i] = false;
+      outboxDelivered++;
+      break;
+    }
+  }
+  xSemaphoreGive(outboxMutex);
+}
+
+void getOutboxStats(OutboxStats& stats) {
+  stats.pending = 0;
+  for (int i = 0; i < OUTBOX_CAPACITY; i++) {
+    if (slotPending[i]) {
+      stats.pending++;
+    }
+  }
+  stats.capacity = OUTBOX_CAPACITY;
+  stats.stored = outboxStored;
+  stats.delivered = outboxDelivered;
+  stats.dropped = outboxDropped;
+  stats.available = outboxAvailable;
+}
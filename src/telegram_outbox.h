@@ -0,0 +1,46 @@
+#ifndef TELEGRAM_OUTBOX_H
+#define TELEGRAM_OUTBOX_H
+
+#include <Arduino.h>
+
+// Исходящие оповещения, которые не удалось отправить (нет Wi-Fi, ошибка Telegram,
+// вытеснение из очереди), сохраняются в SPIFFS и отправляются по порядку после
+// восстановления связи с исходным временем события.
+// Файл - кольцо из записей фиксированного размера, созданное один раз: сохранение -
+// перезапись одной записи, доставка - запись одного байта. При переполнении
+// перезаписывается самое старое недоставленное (счетчик dropped)
+#define OUTBOX_FILE "/tg_outbox.bin"
+#define OUTBOX_CAPACITY 16
+#define OUTBOX_TEXT_SIZE 1000          // Байт текста в записи (длиннее - обрезается)
+
+struct OutboxEntry {
+  uint32_t sequence;                   // Порядковый номер (по возрастанию - порядок событий)
+  uint32_t unixTime;                   // Время события, 0 - часы не были синхронизированы
+  uint32_t uptimeSec;                  // Время от запуска на момент события
+  uint8_t priority;                    // Приоритет сообщения в очереди Telegram
+  char text[OUTBOX_TEXT_SIZE + 1];
+};
+
+struct OutboxStats {
+  int pending;                         // Ожидают отправки
+  int capacity;
+  uint32_t stored;                     // Сохранено с момента загрузки
+  uint32_t delivered;
+  uint32_t dropped;                    // Перезаписаны до отправки или не сохранены (ошибка SPIFFS)
+  bool available;                      // Файл открыт (SPIFFS смонтирован)
+};
+
+// Чтение файла при старте (после монтирования SPIFFS)
+void initTelegramOutbox();
+
+// Сохранить оповещение. Блокирует на время записи во flash (десятки мс)
+bool storeOutboxMessage(const char* text, uint8_t priority);
+
+// Самое старое недоставленное оповещение. false - очередь пуста
+bool peekOutboxMessage(OutboxEntry& entry);
+
+void markOutboxDelivered(uint32_t sequence);
+
+void getOutboxStats(OutboxStats& stats);
+
+#endif
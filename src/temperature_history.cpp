@@ -66,6 +66,13 @@ TemperatureRecord* getHistory(int* count) {
   return history;
 }
 
+const TemperatureRecord* getHistoryRecord(int position) {
+  if (position < 0 || position >= historyCount) {
+    return nullptr;
+  }
+  return &history[(historyIndex - historyCount + position + MAX_HISTORY_SIZE) % MAX_HISTORY_SIZE];
+}
+
 TemperatureRecord* getHistoryForPeriod(unsigned long startTime, unsigned long endTime, int* count) {
   // Используем оригинальный массив истории вместо создания копии для экономии памяти
   // Подсчитываем количество записей в периоде
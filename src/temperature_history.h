@@ -15,6 +15,8 @@ void initTemperatureHistory();
 void addTemperatureRecord(float temp, const String& sensorAddress = "");
 TemperatureRecord* getHistory(int* count);
 TemperatureRecord* getHistoryForPeriod(unsigned long startTime, unsigned long endTime, int* count);
+// Запись по порядку от самой старой (0..count-1) без копирования; nullptr - за пределами
+const TemperatureRecord* getHistoryRecord(int position);
 bool saveHistoryToSPIFFS();
 bool loadHistoryFromSPIFFS();
 
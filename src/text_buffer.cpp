@@ -0,0 +1,145 @@
+#include "text_buffer.h"
+#include <math.h>
+#include <stdarg.h>
+
+size_t utf8PrefixLength(const char* text, size_t maxBytes) {
+  // Начало последнего символа в пределах maxBytes: не дальше 3 байт продолжения назад
+  size_t start = maxBytes;
+  while (start > 0 && maxBytes - start < 4 && ((uint8_t)text[start - 1] & 0xC0) == 0x80) {
+    start--;
+  }
+  if (start == 0) {
+    return 0;
+  }
+  uint8_t lead = (uint8_t)text[start - 1];
+  size_t charLength = (lead & 0x80) == 0 ? 1 : (lead & 0xE0) == 0xC0 ? 2 : (lead & 0xF0) == 0xE0 ? 3 : 4;
+  return (start - 1 + charLength <= maxBytes) ? maxBytes : start - 1;
+}
+
+TextBuilder::TextBuilder(char* data, size_t capacity)
+    : data_(data), capacity_(capacity), length_(0), truncated_(false) {
+  data_[0] = '\0';
+}
+
+void TextBuilder::clear() {
+  length_ = 0;
+  truncated_ = false;
+  data_[0] = '\0';
+}
+
+TextBuilder& TextBuilder::addBytes(const char* text, size_t size) {
+  if (truncated_) {
+    return *this;
+  }
+  if (size > remaining()) {
+    size = utf8PrefixLength(text, remaining());
+    truncated_ = true;
+  }
+  memcpy(data_ + length_, text, size);
+  length_ += size;
+  data_[length_] = '\0';
+  return *this;
+}
+
+TextBuilder& TextBuilder::add(const char* text) {
+  return addBytes(text, strlen(text));
+}
+
+TextBuilder& TextBuilder::add(char c) {
+  return addBytes(&c, 1);
+}
+
+TextBuilder& TextBuilder::addUInt(unsigned long value) {
+  char digits[20];
+  int count = 0;
+  do {
+    digits[sizeof(digits) - 1 - count++] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+  return addBytes(digits + sizeof(digits) - count, count);
+}
+
+TextBuilder& TextBuilder::addInt(long value) {
+  if (value < 0) {
+    add('-');
+    return addUInt(0UL - (unsigned long)value);
+  }
+  return addUInt((unsigned long)value);
+}
+
+TextBuilder& TextBuilder::addFloat(float value, int decimals) {
+  static const unsigned long scales[] = {1, 10, 100, 1000};
+  if (isnan(value)) {
+    return add("nan");
+  }
+  if (decimals < 0) decimals = 0;
+  if (decimals > 3) decimals = 3;
+  float magnitude = fabsf(value);
+  if (magnitude >= 1e6f) {
+    return addInt((long)value); // Вне диапазона показаний - без дробной части
+  }
+
+  unsigned long scale = scales[decimals];
+  unsigned long scaled = (unsigned long)(magnitude * scale + 0.5f);
+  if (value < 0 && scaled != 0) {
+    add('-');
+  }
+  addUInt(scaled / scale);
+  if (decimals > 0) {
+    char fraction[3];
+    unsigned long rest = scaled % scale;
+    for (int i = decimals - 1; i >= 0; i--) {
+      fraction[i] = '0' + rest % 10;
+      rest /= 10;
+    }
+    add('.');
+    addBytes(fraction, decimals);
+  }
+  return *this;
+}
+
+TextBuilder& TextBuilder::addJsonString(const char* text) {
+  static const char hex[] = "0123456789abcdef";
+  add('"');
+  const char* plain = text;  // Начало участка без экранирования - копируется целиком
+  for (const char* p = text; *p != '\0'; p++) {
+    uint8_t c = (uint8_t)*p;
+    if (c != '"' && c != '\\' && c >= 0x20) {
+      continue;
+    }
+    addBytes(plain, p - plain);
+    if (c == '"' || c == '\\') {
+      char escaped[2] = {'\\', (char)c};
+      addBytes(escaped, 2);
+    } else {
+      char escaped[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0F]};
+      addBytes(escaped, 6);
+    }
+    plain = p + 1;
+  }
+  addBytes(plain, strlen(plain));
+  return add('"');
+}
+
+TextBuilder& TextBuilder::addf(const char* format, ...) {
+  if (truncated_) {
+    return *this;
+  }
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(data_ + length_, capacity_ - length_, format, args);
+  va_end(args);
+
+  if (written < 0) {
+    data_[length_] = '\0';
+    truncated_ = true;
+  } else if ((size_t)written > remaining()) {
+    // vsnprintf обрезал по байтам - убираем неполный последний символ
+    length_ = utf8PrefixLength(data_, capacity_ - 1);
+    data_[length_] = '\0';
+    truncated_ = true;
+  } else {
+    length_ += written;
+  }
+  return *this;
+}
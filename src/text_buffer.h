@@ -0,0 +1,63 @@
+#ifndef TEXT_BUFFER_H
+#define TEXT_BUFFER_H
+
+#include <Arduino.h>
+
+// Сборка исходящих сообщений (Telegram, MQTT) в буфере фиксированного размера без выделений heap.
+// Не поместившийся хвост отбрасывается по границе символа UTF-8 (truncated()), после обрезки
+// дописывание прекращается. Строка всегда завершена нулем.
+// Размеры буферов проверяются при компиляции: TEXT_LITERAL_LEN + static_assert у места использования
+
+// Длина строкового литерала в байтах без нуля
+#define TEXT_LITERAL_LEN(literal) (sizeof(literal) - 1)
+
+// Наибольшая длина префикса text не больше maxBytes, не разрывающая символ UTF-8
+size_t utf8PrefixLength(const char* text, size_t maxBytes);
+
+class TextBuilder {
+ public:
+  TextBuilder(char* data, size_t capacity);
+  TextBuilder(const TextBuilder&) = delete;
+  TextBuilder& operator=(const TextBuilder&) = delete;
+
+  TextBuilder& add(const char* text);
+  TextBuilder& add(const String& text) { return add(text.c_str()); }
+  TextBuilder& add(char c);
+  TextBuilder& addBytes(const char* text, size_t size);
+  TextBuilder& addInt(long value);
+  TextBuilder& addUInt(unsigned long value);
+  // 0..3 знака после запятой, как String(value, decimals). Без printf: %f в newlib
+  // при первом вызове в задаче выделяет память под преобразование
+  TextBuilder& addFloat(float value, int decimals);
+  // Строка JSON в кавычках: экранируются кавычки, обратная косая черта и управляющие символы
+  TextBuilder& addJsonString(const char* text);
+  // Целые и строки; для float - addFloat
+  TextBuilder& addf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+  void clear();
+  const char* c_str() const { return data_; }
+  size_t length() const { return length_; }
+  size_t remaining() const { return capacity_ - 1 - length_; }
+  bool truncated() const { return truncated_; }
+
+ private:
+  char* data_;
+  size_t capacity_;
+  size_t length_;
+  bool truncated_;
+};
+
+// Буфер на N байт (вместе с нулем): на стеке или статический
+template <size_t N>
+class TextBuffer : public TextBuilder {
+  static_assert(N >= 2, "TextBuffer needs room for at least one byte and the terminator");
+
+ public:
+  static const size_t CAPACITY = N;
+  TextBuffer() : TextBuilder(storage_, N) {}
+
+ private:
+  char storage_[N];
+};
+
+#endif
@@ -1,10 +1,10 @@
 #include "tg_bot.h"
 #include <WiFi.h>
 #include <WiFiClientSecure.h>
-#include <UniversalTelegramBot.h>
 #include "config.h"
 #include <ArduinoJson.h>
 #include <Arduino.h>
+#include <time.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
@@ -16,6 +16,13 @@
 #include "display.h"
 #include "buzzer.h"
 #include "sensor_config.h"
+#include "settings_store.h"
+#include "metrics.h"
+#include "telegram_outbox.h"
+#include "text_buffer.h"
+#include "alloc_probe.h"
+#include "net_health.h"
+#include "telegram_api.h"
 
 extern float currentTemp;
 extern unsigned long deviceUptime;
@@ -23,73 +30,268 @@ extern String deviceIP;
 extern int wifiRSSI;
 extern int displayScreen;
 
-WiFiClientSecure secured_client;
-UniversalTelegramBot* bot = nullptr;
+// Длинный опрос (getUpdates?timeout=25): сервер держит запрос, пока не придет сообщение,
+// а TLS-соединение переиспользуется между запросами (keep-alive), рукопожатие - только после обрыва.
+// Опрос блокирует соединение до 25 секунд, поэтому исходящие сообщения идут через второе
+// соединение в своей задаче: ответ на команду уходит сразу, а не после следующего опроса
+#define TELEGRAM_LONG_POLL_SEC 25
+#define TELEGRAM_POLL_RETRY_MS 5000        // Пауза после ошибки опроса или без Wi-Fi
+#define TELEGRAM_SEND_IDLE_CLOSE_MS 60000  // Соединение отправки закрывается после минуты простоя (память TLS)
+
+WiFiClientSecure secured_client;   // Опрос, только из TelegramTask
+WiFiClientSecure send_client;      // Отправка, только из TelegramSend
 String telegramBotToken = "";
 String telegramChatId = "";
-String telegramActiveToken = "";
+static SemaphoreHandle_t telegramConfigMutex = NULL;  // Токен и chat_id меняются из loop(), читаются задачами
 bool telegramInitialized = false;
 bool telegramConfigured = false;
 bool telegramCanSend = false;
 bool telegramLastPollOk = false;
 unsigned long telegramLastPollMs = 0;
 
-// Структура для очереди сообщений Telegram
+// Приоритетная очередь исходящих сообщений на статическом пуле (без new/delete - нет фрагментации heap).
+// Следующим отправляется сообщение с наибольшим приоритетом, внутри приоритета - самое старое.
+// При переполнении вытесняется самое старое из сообщений с наименьшим приоритетом, если он
+// не выше приоритета нового; иначе отбрасывается новое. Новый снимок метрик заменяет еще
+// не отправленный (тот же слот и место в очереди)
+enum TelegramPriority : uint8_t {
+  TG_PRIORITY_TEST = 0,
+  TG_PRIORITY_METRICS,
+  TG_PRIORITY_REPLY,          // Ответы на команды
+  TG_PRIORITY_STABILIZATION,
+  TG_PRIORITY_ALARM
+};
+
+enum TelegramSlotState : uint8_t {
+  TG_SLOT_FREE = 0,
+  TG_SLOT_QUEUED,
+  TG_SLOT_SENDING
+};
+
+// Слоты хранят текст сами: постановка в очередь не выделяет heap. Текст длиннее слота
+// (ответы на команды) ставится несколькими сообщениями по границам строк
+#define TELEGRAM_MESSAGE_SIZE 1536
+#define TELEGRAM_CHAT_ID_SIZE 40      // Числовой id или @имя канала
+
 struct TelegramMessage {
-  String chatId;
-  String message;
-  bool isTestMessage;
-  bool inUse;  // Для статического пула
+  char chatId[TELEGRAM_CHAT_ID_SIZE];
+  char message[TELEGRAM_MESSAGE_SIZE];
+  uint8_t priority;           // TelegramPriority
+  uint8_t state;              // TelegramSlotState
+  unsigned long enqueuedMs;
+  uint32_t sequence;          // Порядок постановки (millis() может совпадать)
+  uint32_t outboxSequence;    // Запись в outbox, из которой повторяется сообщение (0 - новое)
 };
 
-// Статический пул сообщений вместо new/delete (предотвращает фрагментацию heap)
 #define TELEGRAM_POOL_SIZE 5
 static TelegramMessage messagePool[TELEGRAM_POOL_SIZE];
 static SemaphoreHandle_t poolMutex = NULL;
+static SemaphoreHandle_t enqueueMutex = NULL;  // Постановка по одной: буфер вытесненного общий
+static TelegramMessage evictedMessage;         // Под enqueueMutex: вытесненное до сохранения в outbox
+static uint32_t nextMessageSequence = 0;
+static uint32_t telegramQueueEvicted = 0;   // Ожидавшие вытеснены более важными
+static uint32_t telegramQueueRejected = 0;  // Новые не приняты (очередь занята более важными, мьютекс)
+static uint32_t telegramQueueReplaced = 0;
+static LatencyStats telegramQueueWaitStats = {0, 0, 0, 0};
+
+static const char* const telegramPriorityNames[] = {"test", "metrics", "reply", "stabilization", "alarm"};
+
+static void clearMessage(TelegramMessage& msg) {
+  msg.chatId[0] = '\0';
+  msg.message[0] = '\0';
+  msg.state = TG_SLOT_FREE;
+  msg.outboxSequence = 0;
+}
 
-// Функции для работы со статическим пулом сообщений
-static TelegramMessage* allocateMessage() {
-  if (poolMutex == NULL) return nullptr;
-  if (xSemaphoreTake(poolMutex, pdMS_TO_TICKS(50)) == pdTRUE) {
-    for (int i = 0; i < TELEGRAM_POOL_SIZE; i++) {
-      if (!messagePool[i].inUse) {
-        messagePool[i].inUse = true;
-        messagePool[i].chatId = "";
-        messagePool[i].message = "";
-        messagePool[i].isTestMessage = false;
-        xSemaphoreGive(poolMutex);
-        return &messagePool[i];
-      }
+// Оповещения (стабилизация и тревоги) не теряются: неотправленное сохраняется в outbox.
+// Повтор из outbox уже сохранен - запись остается недоставленной и будет повторена позже
+static volatile bool outboxInFlight = false;  // Запись из outbox стоит в очереди или отправляется
+
+static void keepUndelivered(const char* message, uint8_t priority, uint32_t outboxSequence) {
+  if (outboxSequence != 0) {
+    outboxInFlight = false;
+  } else if (priority >= TG_PRIORITY_STABILIZATION) {
+    storeOutboxMessage(message, priority);
+  }
+}
+
+// Слот для нового сообщения (под poolMutex): свободный или вытесненный. nullptr - новое отбрасывается.
+// Текст вытесненного оповещения возвращается в evicted - сохраняется в outbox после освобождения мьютекса
+static TelegramMessage* reserveSlot(uint8_t priority, TelegramMessage& evicted) {
+  TelegramMessage* victim = nullptr;
+  for (int i = 0; i < TELEGRAM_POOL_SIZE; i++) {
+    TelegramMessage& slot = messagePool[i];
+    if (slot.state == TG_SLOT_FREE) {
+      return &slot;
     }
+    if (slot.state == TG_SLOT_QUEUED &&
+        (victim == nullptr || slot.priority < victim->priority ||
+         (slot.priority == victim->priority && (int32_t)(slot.sequence - victim->sequence) < 0))) {
+      victim = &slot;
+    }
+  }
+  if (victim == nullptr || victim->priority > priority) {
+    telegramQueueRejected++;
+    Serial.print(F("Telegram queue full, dropping new "));
+    Serial.println(telegramPriorityNames[priority]);
+    return nullptr;
+  }
+  telegramQueueEvicted++;
+  Serial.print(F("Telegram queue full, evicting "));
+  Serial.println(telegramPriorityNames[victim->priority]);
+  memcpy(&evicted, victim, sizeof(TelegramMessage));
+  clearMessage(*victim);
+  return victim;
+}
+
+// Следующее сообщение к отправке: переводится в состояние "отправляется"
+static TelegramMessage* takeNextMessage() {
+  if (poolMutex == NULL || xSemaphoreTake(poolMutex, pdMS_TO_TICKS(50)) != pdTRUE) {
+    return nullptr;
+  }
+  TelegramMessage* next = nullptr;
+  for (int i = 0; i < TELEGRAM_POOL_SIZE; i++) {
+    TelegramMessage& slot = messagePool[i];
+    if (slot.state != TG_SLOT_QUEUED) continue;
+    if (next == nullptr || slot.priority > next->priority ||
+        (slot.priority == next->priority && (int32_t)(slot.sequence - next->sequence) < 0)) {
+      next = &slot;
+    }
+  }
+  if (next != nullptr) {
+    next->state = TG_SLOT_SENDING;
+  }
+  xSemaphoreGive(poolMutex);
+  return next;
+}
+
+// Вернуть сообщение в очередь на прежнее место (порядок задает sequence)
+static void requeueMessage(TelegramMessage* msg) {
+  if (msg == nullptr || poolMutex == NULL) return;
+  if (xSemaphoreTake(poolMutex, pdMS_TO_TICKS(50)) == pdTRUE) {
+    msg->state = TG_SLOT_QUEUED;
     xSemaphoreGive(poolMutex);
   }
-  return nullptr;  // Пул исчерпан
 }
 
 static void freeMessage(TelegramMessage* msg) {
   if (msg == nullptr || poolMutex == NULL) return;
   if (xSemaphoreTake(poolMutex, pdMS_TO_TICKS(50)) == pdTRUE) {
-    msg->chatId = "";
-    msg->message = "";
-    msg->isTestMessage = false;
-    msg->inUse = false;
+    clearMessage(*msg);
     xSemaphoreGive(poolMutex);
   }
 }
 
-// Очередь для Telegram сообщений
-QueueHandle_t telegramQueue = NULL;
+// Сообщение не будет отправлено (нет связи, пауза после ошибок, ошибка отправки)
+static void dropMessage(TelegramMessage* msg) {
+  if (msg == nullptr) return;
+  keepUndelivered(msg->message, msg->priority, msg->outboxSequence);
+  freeMessage(msg);
+}
+
 bool telegramSendInProgress = false;
 unsigned long lastTelegramSendAttempt = 0;
 unsigned long lastTelegramSendSuccess = 0;
 const unsigned long TELEGRAM_SEND_INTERVAL = 2000; // Минимум 2 секунды между отправками
 const unsigned long TELEGRAM_SEND_TIMEOUT = 5000; // Таймаут отправки 5 секунд
-int telegramConsecutiveFailures = 0;
-const int MAX_TELEGRAM_FAILURES = 3; // После 3 неудач подряд - пауза
+#define TELEGRAM_SEND_REQUEST_TIMEOUT_MS 10000UL  // Ожидание ответа на sendMessage
+// Опрос и отправка обращаются к одному API - общий автомат: после 3 неудач подряд
+// запросов нет от 30 с до 5 минут (пауза растет с каждым размыканием), оповещения ждут в outbox
+static CircuitBreaker telegramBreaker = CIRCUIT_BREAKER("telegram", 3, 30000, 300000);
+static LatencyStats telegramSendStats = {0, 0, 0, 0};
+
+#ifdef TELEGRAM_STANDIN
+// Имитация обрыва Wi-Fi для стенда: до этого момента оповещения идут в outbox, повтора нет
+static volatile unsigned long telegramBenchOfflineUntil = 0;
+#endif
+
+// Есть ли сеть для отправки оповещений (на стенде - с учетом имитации обрыва)
+static bool telegramNetworkUp() {
+#ifdef TELEGRAM_STANDIN
+  if (telegramBenchOfflineUntil != 0 && (long)(millis() - telegramBenchOfflineUntil) < 0) {
+    return false;
+  }
+#endif
+  return WiFi.status() == WL_CONNECTED && WiFi.localIP() != IPAddress(0, 0, 0, 0);
+}
+
+// Рукопожатие TLS (секунды CPU) - только при открытии соединения; дальше запросы идут по нему же.
+// Соединение открывается до запроса, чтобы рукопожатие измерялось отдельно от отправки.
+// Статистику каждого соединения пишет только его задача
+static const char* const telegramConnectionNames[TELEGRAM_CONNECTION_COUNT] = {"poll", "send"};
+static LatencyStats telegramHandshakeStats[TELEGRAM_CONNECTION_COUNT] = {};
+static volatile uint32_t telegramConnectionReuses[TELEGRAM_CONNECTION_COUNT] = {};
+
+// dnsBusy - соединения нет, потому что пробный запрос DNS выполняет другой клиент:
+// это не неудача Telegram, автомат telegramBreaker ее не учитывает
+static bool ensureTelegramConnection(WiFiClientSecure& client, int connection, bool* dnsBusy = NULL) {
+  if (dnsBusy) {
+    *dnsBusy = false;
+  }
+  if (client.connected()) {
+    telegramConnectionReuses[connection]++;
+    return true;
+  }
+  client.stop();  // Освобождаем контекст mbedTLS оборванного соединения
+  // Имя разрешается заранее: при неработающем DNS - отказ сразу, а не после таймаута connect.
+  // connect ниже берет адрес из кеша DNS lwIP и передает имя для SNI
+  IPAddress address;
+  NetResolveResult resolved = netResolve(TELEGRAM_API_HOST, address);
+  if (resolved != NET_RESOLVE_OK) {
+    if (dnsBusy) {
+      *dnsBusy = resolved == NET_RESOLVE_BUSY;
+    }
+    return false;
+  }
+  unsigned long start = millis();
+  bool ok = client.connect(TELEGRAM_API_HOST, TELEGRAM_API_PORT);
+  unsigned long duration = millis() - start;
+  recordLatency(telegramHandshakeStats[connection], duration, ok);
+
+  Serial.print(F("Telegram: TLS handshake ("));
+  Serial.print(telegramConnectionNames[connection]);
+  Serial.print(ok ? F(") ") : F(") failed after "));
+  Serial.print(duration);
+  Serial.println(F(" ms"));
+  return ok;
+}
+
+// Сводка оповещений: оповещения, пришедшие за TELEGRAM_ALERT_WINDOW_MS, отправляются
+// одним сообщением. Окно открывает первое оповещение; повторное по тому же термометру
+// заменяет предыдущее. Заполняется из loop(), отправляется задачей TelegramSend
+#define ALERT_DIGEST_MAX_ITEMS MAX_SENSORS
+#define ALERT_HEADER "⚠️ *Температурное оповещение*\n\n"
+#define ALERT_TEXT_SIZE 384                               // Строки одного оповещения без заголовка
+#define SENSOR_NAME_SIZE sizeof(StoredSensorConfig::name)
+#define FLOAT_TEXT_MAX 12                                 // addFloat: "-2147483648" вне диапазона показаний
+#define UINT_TEXT_MAX 10
+#define OUTBOX_REPLAY_PREFIX "📦 *Отложенное оповещение* ("
+#define OUTBOX_REPLAY_TIME_MAX 40                         // "dd.mm.yyyy HH:MM:SS" или "<uptime>с после запуска"
+
+// Оповещение с заголовком помещается в запись outbox (сводка делится на части того же размера),
+// повтор из outbox с заголовком - в слот очереди
+static_assert(TEXT_LITERAL_LEN(ALERT_HEADER) + ALERT_TEXT_SIZE - 1 <= OUTBOX_TEXT_SIZE,
+              "An alert must fit into an outbox record");
+static_assert(TEXT_LITERAL_LEN(OUTBOX_REPLAY_PREFIX) + OUTBOX_REPLAY_TIME_MAX + TEXT_LITERAL_LEN(")\n\n") +
+              OUTBOX_TEXT_SIZE < TELEGRAM_MESSAGE_SIZE,
+              "A replayed outbox alert must fit into a queue slot");
+
+struct AlertDigestItem {
+  char sensorName[SENSOR_NAME_SIZE];
+  char text[ALERT_TEXT_SIZE];       // Строки оповещения без заголовка
+};
+
+static AlertDigestItem alertDigestItems[ALERT_DIGEST_MAX_ITEMS];
+static int alertDigestCount = 0;
+static unsigned long alertDigestStartMs = 0;
+static uint8_t alertDigestPriority = 0;  // Наибольший приоритет среди оповещений сводки
+static SemaphoreHandle_t alertDigestMutex = NULL;
 
 // FreeRTOS task handle для Telegram polling
 TaskHandle_t telegramTaskHandle = NULL;
+TaskHandle_t telegramSendTaskHandle = NULL;  // Будится уведомлением при постановке сообщения
 volatile bool telegramTaskRunning = false;
+static unsigned long lastTelegramSendActivity = 0;
 
 // ========== ИНТЕРАКТИВНЫЙ РЕЖИМ НАСТРОЙКИ ==========
 
@@ -206,39 +408,89 @@ static void deleteSession(const String& chatId) {
 }
 
 // Forward declaration
-static void sendTelegramMessageToQueue(const String& chatId, const String& message, bool isTest = false);
+static void sendTelegramMessageToQueue(const String& chatId, const String& message,
+                                       TelegramPriority priority = TG_PRIORITY_REPLY);
 
 static void updateTelegramFlags() {
   telegramConfigured = telegramBotToken.length() > 0;
   telegramCanSend = telegramConfigured && telegramChatId.length() > 0;
 }
 
-void ensureTelegramBot() {
+#define TELEGRAM_TOKEN_SIZE sizeof(DeviceSettings::telegramToken)
+
+// Копия токена под telegramConfigMutex, без выделения heap. false - мьютекс занят
+static bool readTelegramToken(char* token, size_t size) {
+  if (telegramConfigMutex != NULL && xSemaphoreTake(telegramConfigMutex, pdMS_TO_TICKS(100)) != pdTRUE) {
+    token[0] = '\0';
+    return false;
+  }
+  strlcpy(token, telegramBotToken.c_str(), size);
+  if (telegramConfigMutex != NULL) {
+    xSemaphoreGive(telegramConfigMutex);
+  }
+  return true;
+}
+
+// Копия chat_id из настроек под telegramConfigMutex, без выделения heap. false - мьютекс занят
+static bool readTelegramChatId(char* chatId, size_t size) {
+  if (telegramConfigMutex != NULL && xSemaphoreTake(telegramConfigMutex, pdMS_TO_TICKS(100)) != pdTRUE) {
+    chatId[0] = '\0';
+    return false;
+  }
+  strlcpy(chatId, telegramChatId.c_str(), size);
+  if (telegramConfigMutex != NULL) {
+    xSemaphoreGive(telegramConfigMutex);
+  }
+  return true;
+}
+
+// Токен опроса (только TelegramTask). Смена токена - другой бот: номера обновлений
+// начинаются заново, соединение со старым токеном закрывается
+static char pollToken[TELEGRAM_TOKEN_SIZE] = "";
+static long lastUpdateId = 0;  // Последнее обработанное обновление; getUpdates просит следующие
+
+// Токен для опроса (вызывается только из TelegramTask). false - бот не настроен
+static bool ensureTelegramBot() {
   updateTelegramFlags();
-  if (!telegramConfigured) {
-    telegramInitialized = false;
-    if (bot) {
-      delete bot;
-      bot = nullptr;
+  char token[TELEGRAM_TOKEN_SIZE];
+  if (!readTelegramToken(token, sizeof(token))) {
+    return pollToken[0] != '\0';  // Мьютекс занят - опрос с прежним токеном
+  }
+  if (token[0] == '\0') {
+    if (pollToken[0] != '\0') {
+      Serial.println(F("Telegram: Bot not configured"));
+      pollToken[0] = '\0';
+      secured_client.stop();
     }
-    telegramActiveToken = "";
-    Serial.println(F("Telegram: Bot not configured"));
-    return;
+    telegramInitialized = false;
+    return false;
   }
-  if (!bot || telegramActiveToken != telegramBotToken) {
-    if (bot) {
-      delete bot;
+  if (strcmp(token, pollToken) != 0) {
+    if (pollToken[0] != '\0') {
+      secured_client.stop();
     }
-    bot = new UniversalTelegramBot(telegramBotToken, secured_client);
-    telegramActiveToken = telegramBotToken;
-    Serial.println(F("Telegram: Bot initialized"));
+    strlcpy(pollToken, token, sizeof(pollToken));
+    lastUpdateId = 0;
+    Serial.println(F("Telegram: Bot initialized (long polling)"));
   }
   telegramInitialized = true;
+  return true;
 }
 
 // Инициализация очереди Telegram сообщений
 void initTelegramQueue() {
-  // Инициализация мьютекса для пула сообщений
+  if (telegramConfigMutex == NULL) {
+    telegramConfigMutex = xSemaphoreCreateMutex();
+  }
+  if (alertDigestMutex == NULL) {
+    alertDigestMutex = xSemaphoreCreateMutex();
+  }
+
+  if (enqueueMutex == NULL) {
+    enqueueMutex = xSemaphoreCreateMutex();
+  }
+
+  // Инициализация мьютекса для пула сообщений (слоты изначально свободны)
   if (poolMutex == NULL) {
     poolMutex = xSemaphoreCreateMutex();
     if (poolMutex == NULL) {
@@ -246,64 +498,170 @@ void initTelegramQueue() {
     }
   }
 
-  // Инициализация пула сообщений
-  for (int i = 0; i < TELEGRAM_POOL_SIZE; i++) {
-    messagePool[i].inUse = false;
-    messagePool[i].chatId = "";
-    messagePool[i].message = "";
-    messagePool[i].isTestMessage = false;
+  // Инициализация интерактивных сессий
+  initInteractiveSessions();
+}
+
+static void setMessageText(TelegramMessage& msg, const char* text, size_t length) {
+  memcpy(msg.message, text, length);
+  msg.message[length] = '\0';
+}
+
+// Одна часть сообщения (length < TELEGRAM_MESSAGE_SIZE), под enqueueMutex
+static bool enqueueTelegramPart(const char* chatId, const char* message, size_t length, uint8_t priority,
+                                uint32_t outboxSequence) {
+  if (xSemaphoreTake(poolMutex, pdMS_TO_TICKS(50)) != pdTRUE) {
+    telegramQueueRejected++;
+    return false;
   }
 
-  if (telegramQueue == NULL) {
-    telegramQueue = xQueueCreate(TELEGRAM_POOL_SIZE, sizeof(TelegramMessage*));
-    if (telegramQueue == NULL) {
-      Serial.println(F("Failed to create Telegram queue"));
+  // Устаревший снимок метрик заменяется новым
+  if (priority == TG_PRIORITY_METRICS) {
+    for (int i = 0; i < TELEGRAM_POOL_SIZE; i++) {
+      TelegramMessage& slot = messagePool[i];
+      if (slot.state == TG_SLOT_QUEUED && slot.priority == TG_PRIORITY_METRICS && strcmp(slot.chatId, chatId) == 0) {
+        setMessageText(slot, message, length);
+        telegramQueueReplaced++;
+        xSemaphoreGive(poolMutex);
+        return true;
+      }
     }
   }
 
-  // Инициализация интерактивных сессий
-  initInteractiveSessions();
+  evictedMessage.state = TG_SLOT_FREE;
+  TelegramMessage* msg = reserveSlot(priority, evictedMessage);
+  if (msg != nullptr) {
+    strlcpy(msg->chatId, chatId, sizeof(msg->chatId));
+    setMessageText(*msg, message, length);
+    msg->priority = priority;
+    msg->state = TG_SLOT_QUEUED;
+    msg->enqueuedMs = millis();
+    msg->sequence = nextMessageSequence++;
+    msg->outboxSequence = outboxSequence;
+  }
+  xSemaphoreGive(poolMutex);
+
+  // Запись во flash - вне мьютекса пула
+  if (evictedMessage.state != TG_SLOT_FREE) {
+    keepUndelivered(evictedMessage.message, evictedMessage.priority, evictedMessage.outboxSequence);
+    clearMessage(evictedMessage);
+  }
+  if (msg != nullptr && telegramSendTaskHandle != NULL) {
+    xTaskNotifyGive(telegramSendTaskHandle);
+  }
+  return msg != nullptr;
 }
 
-// Вспомогательная функция для отправки сообщения через очередь
-static void sendTelegramMessageToQueue(const String& chatId, const String& message, bool isTest) {
-  if (telegramQueue == NULL) {
+// Постановка в очередь. false - сообщение не принято (оповещение при этом сохранено в outbox).
+// chatId NULL - чат из настроек: читается под telegramConfigMutex, его меняет loop()
+static bool enqueueTelegramMessage(const char* chatId, const char* message, uint8_t priority,
+                                   uint32_t outboxSequence) {
+  char configuredChatId[TELEGRAM_CHAT_ID_SIZE];
+  if (chatId == NULL) {
+    if (!readTelegramChatId(configuredChatId, sizeof(configuredChatId))) {
+      telegramQueueRejected++;
+      keepUndelivered(message, priority, outboxSequence);
+      return false;
+    }
+    chatId = configuredChatId;
+  }
+  if (poolMutex == NULL || enqueueMutex == NULL) {
     initTelegramQueue();
-    if (telegramQueue == NULL) {
-      return;
+    if (poolMutex == NULL || enqueueMutex == NULL) {
+      keepUndelivered(message, priority, outboxSequence);
+      return false;
     }
   }
 
-  // Проверяем, не слишком ли много неудач подряд
-  if (telegramConsecutiveFailures >= MAX_TELEGRAM_FAILURES) {
-    unsigned long now = millis();
-    if (now - lastTelegramSendAttempt < 30000) { // 30 секунд паузы
-      return; // Слишком много неудач, не добавляем в очередь
+  // Автомат разомкнут: до пробного запроса сообщения не принимаются
+  if (breakerRetryInMs(telegramBreaker) > 0) {
+    keepUndelivered(message, priority, outboxSequence);
+    return false;
+  }
+
+  if (xSemaphoreTake(enqueueMutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+    telegramQueueRejected++;
+    keepUndelivered(message, priority, outboxSequence);
+    return false;
+  }
+  bool probe = allocProbeBegin();
+  bool queued = true;
+  const char* part = message;
+  const char* undelivered = message;  // Начало части, не принятой в очередь
+  size_t remaining = strlen(message);
+  while (queued && remaining > 0) {
+    size_t length = remaining;
+    if (length > TELEGRAM_MESSAGE_SIZE - 1) {
+      // Разрез после последнего перевода строки, без него - по границе символа
+      length = TELEGRAM_MESSAGE_SIZE - 1;
+      while (length > 0 && part[length - 1] != '\n') {
+        length--;
+      }
+      if (length == 0) {
+        length = utf8PrefixLength(part, TELEGRAM_MESSAGE_SIZE - 1);
+      }
     }
+    undelivered = part;
+    queued = enqueueTelegramPart(chatId, part, length, priority, outboxSequence);
+    part += length;
+    remaining -= length;
   }
+  allocProbeEnd(probe);
+  xSemaphoreGive(enqueueMutex);
 
-  // Используем статический пул вместо new/delete
-  TelegramMessage* msg = allocateMessage();
-  if (msg == nullptr) {
-    // Пул исчерпан - не логируем, чтобы не засорять Serial
-    return;
+  if (!queued) {
+    // Принятые части уйдут сами (или сохранятся в outbox по отдельности) - в outbox только
+    // непринятая часть и все после нее, иначе при повторе начало сообщения пришло бы дважды
+    keepUndelivered(undelivered, priority, outboxSequence);
   }
+  return queued;
+}
 
-  msg->chatId = chatId;
-  msg->message = message;
-  msg->isTestMessage = isTest;
+// Вспомогательная функция для отправки сообщения через очередь
+static void sendTelegramMessageToQueue(const String& chatId, const String& message, TelegramPriority priority) {
+  enqueueTelegramMessage(chatId.c_str(), message.c_str(), priority, 0);
+}
 
-  if (xQueueSend(telegramQueue, &msg, 0) != pdTRUE) {
-    freeMessage(msg); // Очередь переполнена - возвращаем в пул
+// Тело запроса sendMessage и ответ - только задача TelegramSend. Текст в JSON: управляющие
+// символы (переводы строк) экранируются шестью байтами
+static char telegramSendJson[TELEGRAM_MESSAGE_SIZE * 2 + 128];
+static char telegramSendResponse[512];  // Ответ нужен только до поля "ok" - хвост отбрасывается
+static int telegramSendStatus = 0;       // HTTP-статус последнего ответа на sendMessage
+
+// sendMessage по соединению отправки: одна попытка, без повторов библиотеки
+static TelegramApiResult sendTelegramApiMessage(const char* token, const TelegramMessage* msg, bool markdown) {
+  TextBuilder json(telegramSendJson, sizeof(telegramSendJson));
+  json.add("{\"chat_id\":").addJsonString(msg->chatId)
+      .add(",\"text\":").addJsonString(msg->message);
+  if (markdown) {
+    json.add(",\"parse_mode\":\"Markdown\"");
+  }
+  json.add('}');
+  telegramSendStatus = 0;
+  if (json.truncated()) {
+    Serial.println(F("Telegram: message does not fit the request buffer"));
+    return TELEGRAM_API_REJECTED;
+  }
+  TelegramApiResponse response;
+  TelegramApiResult result = telegramApiPost(send_client, token, "sendMessage", json.c_str(), json.length(),
+                                             TELEGRAM_SEND_REQUEST_TIMEOUT_MS, telegramSendResponse,
+                                             sizeof(telegramSendResponse), response);
+  telegramSendStatus = response.httpStatus;
+  if (result == TELEGRAM_API_REJECTED) {
+    Serial.print(F("Telegram: sendMessage HTTP "));
+    Serial.print(response.httpStatus);
+    Serial.print(F(": "));
+    Serial.println(telegramSendResponse);
   }
+  return result;
 }
 
-// Обработка очереди Telegram сообщений (вызывается из loop())
+// Отправка одного сообщения из очереди (вызывается из задачи TelegramSend)
 void processTelegramQueue() {
   // Проверяем, что очередь инициализирована
-  if (telegramQueue == NULL) {
+  if (poolMutex == NULL) {
     initTelegramQueue();
-    if (telegramQueue == NULL) {
+    if (poolMutex == NULL) {
       return;
     }
   }
@@ -312,16 +670,14 @@ void processTelegramQueue() {
     return; // Уже отправляем сообщение
   }
 
-  TelegramMessage* msg = NULL;
-  if (xQueueReceive(telegramQueue, &msg, 0) == pdTRUE) {
-    if (msg == NULL) return;
-
+  TelegramMessage* msg = takeNextMessage();
+  if (msg != nullptr) {
     telegramSendInProgress = true;
 
     // Проверяем подключение WiFi - критически важно перед любыми DNS запросами
     if (WiFi.status() != WL_CONNECTED) {
       Serial.println(F("Telegram queue: WiFi not connected, skipping message"));
-      freeMessage(msg);
+      dropMessage(msg);
       telegramSendInProgress = false;
       return;
     }
@@ -333,28 +689,30 @@ void processTelegramQueue() {
     if (now - lastWiFiCheck > 1000) { // Проверяем не чаще раза в секунду
       if (WiFi.status() != WL_CONNECTED || WiFi.localIP() == IPAddress(0, 0, 0, 0)) {
         Serial.println(F("Telegram queue: WiFi unstable, skipping message"));
-        freeMessage(msg);
+        dropMessage(msg);
         telegramSendInProgress = false;
         return;
       }
       lastWiFiCheck = now;
     }
 
-    ensureTelegramBot();
     updateTelegramFlags(); // Обновляем флаги перед проверкой
     if (!telegramCanSend) {
       Serial.print(F("Telegram queue: Cannot send - configured="));
       Serial.print(telegramConfigured);
       Serial.print(F(", chatId="));
-      Serial.println(telegramChatId.length() > 0 ? telegramChatId : "(empty)");
-      freeMessage(msg);
+      char chatId[TELEGRAM_CHAT_ID_SIZE];
+      readTelegramChatId(chatId, sizeof(chatId));
+      Serial.println(chatId[0] != '\0' ? chatId : "(empty)");
+      dropMessage(msg);
       telegramSendInProgress = false;
       return;
     }
 
-    if (!bot) {
+    char token[TELEGRAM_TOKEN_SIZE];
+    if (!readTelegramToken(token, sizeof(token)) || token[0] == '\0') {
       Serial.println(F("Telegram queue: Bot not initialized"));
-      freeMessage(msg);
+      dropMessage(msg);
       telegramSendInProgress = false;
       return;
     }
@@ -363,68 +721,71 @@ void processTelegramQueue() {
     now = millis(); // Используем уже объявленную переменную
     if (now - lastTelegramSendAttempt < TELEGRAM_SEND_INTERVAL) {
       // Слишком рано, возвращаем сообщение в очередь
-      xQueueSendToFront(telegramQueue, &msg, 0);
+      requeueMessage(msg);
       telegramSendInProgress = false;
       return;
     }
 
-    // Проверяем, не слишком ли много неудач подряд
-    if (telegramConsecutiveFailures >= MAX_TELEGRAM_FAILURES) {
-      // Слишком много неудач, делаем паузу
-      if (now - lastTelegramSendAttempt < 30000) { // 30 секунд паузы
-        freeMessage(msg);
-        telegramSendInProgress = false;
-        Serial.println(F("Telegram: Too many failures, pausing"));
-        return;
+    // Автомат разомкнут - сообщение отбрасывается (оповещение остается в outbox);
+    // пробный запрос уже выполняет опрос - сообщение ждет его исхода в очереди
+    bool probeBusy = false;
+    if (!breakerAllow(telegramBreaker, &probeBusy)) {
+      if (probeBusy) {
+        lastTelegramSendAttempt = now;  // Следующая проверка - через TELEGRAM_SEND_INTERVAL
+        requeueMessage(msg);
       } else {
-        // Пауза прошла, сбрасываем счетчик
-        telegramConsecutiveFailures = 0;
+        Serial.println(F("Telegram: circuit open, message dropped"));
+        dropMessage(msg);
       }
+      telegramSendInProgress = false;
+      return;
     }
 
     lastTelegramSendAttempt = now;
 
-    // Дополнительная проверка WiFi перед отправкой
-    if (WiFi.status() != WL_CONNECTED || WiFi.localIP() == IPAddress(0, 0, 0, 0)) {
-      Serial.println(F("Telegram: WiFi unstable before send, skipping"));
-      freeMessage(msg);
-      telegramSendInProgress = false;
-      telegramConsecutiveFailures++;
-      return;
-    }
+    recordLatency(telegramQueueWaitStats, now - msg->enqueuedMs, true);
 
-    Serial.print(F("Telegram: Sending to chat "));
+    Serial.print(F("Telegram: Sending "));
+    Serial.print(telegramPriorityNames[msg->priority]);
+    Serial.print(F(" to chat "));
     Serial.print(msg->chatId);
     Serial.print(F(", len: "));
-    Serial.println(msg->message.length());
+    Serial.println(strlen(msg->message));
 
-    // Используем Markdown для форматирования сообщений
-    String parseMode = "Markdown";
     unsigned long sendStart = millis();
 
     // Добавляем watchdog feed перед длительной операцией
     yield(); // Даем время другим задачам
 
-    // Проверяем WiFi еще раз перед отправкой (DNS lookup может быть проблемным)
-    if (WiFi.status() != WL_CONNECTED) {
+    // Проверяем WiFi еще раз перед отправкой (DNS lookup может быть проблемным).
+    // Обрыв Wi-Fi - не отказ API Telegram: запроса не было, автомат не меняется
+    if (WiFi.status() != WL_CONNECTED || WiFi.localIP() == IPAddress(0, 0, 0, 0)) {
       Serial.println(F("Telegram: WiFi disconnected before send, skipping"));
-      freeMessage(msg);
+      breakerRelease(telegramBreaker);
+      dropMessage(msg);
       telegramSendInProgress = false;
-      telegramConsecutiveFailures++;
       return;
     }
 
-    // Пытаемся отправить с обработкой ошибок DNS
-    // Проверяем WiFi еще раз перед отправкой
-    if (WiFi.status() != WL_CONNECTED) {
-      Serial.println(F("Telegram: WiFi disconnected before send, skipping"));
-      freeMessage(msg);
+    bool dnsBusy = false;
+    if (!ensureTelegramConnection(send_client, TELEGRAM_CONNECTION_SEND, &dnsBusy)) {
+      if (dnsBusy) {
+        // Запроса не было: сообщение ждет в очереди, автомат не меняется
+        breakerRelease(telegramBreaker);
+        requeueMessage(msg);
+        telegramSendInProgress = false;
+        return;
+      }
+      dropMessage(msg);
       telegramSendInProgress = false;
-      telegramConsecutiveFailures++;
+      breakerFailure(telegramBreaker);
       return;
     }
+    sendStart = millis(); // Без рукопожатия: время самого запроса
 
-    bool success = bot->sendMessage(msg->chatId, msg->message, parseMode);
+    // Используем Markdown для форматирования сообщений
+    TelegramApiResult result = sendTelegramApiMessage(token, msg, true);
+    bool success = result == TELEGRAM_API_OK;
 
     // Проверяем, не отключился ли WiFi после отправки
     if (WiFi.status() != WL_CONNECTED) {
@@ -433,6 +794,7 @@ void processTelegramQueue() {
     }
 
     unsigned long sendDuration = millis() - sendStart;
+    recordLatency(telegramSendStats, sendDuration, success);
 
     // Проверяем таймаут и прерываем, если слишком долго
     if (sendDuration > TELEGRAM_SEND_TIMEOUT) {
@@ -446,97 +808,297 @@ void processTelegramQueue() {
       }
     }
 
+    lastTelegramSendActivity = millis();
     yield(); // Даем время после отправки
 
-    if (msg->isTestMessage) {
-      if (success) {
-        Serial.println(F("Telegram test: OK"));
-        telegramConsecutiveFailures = 0;
-        lastTelegramSendSuccess = now;
-      } else {
-        Serial.println(F("Telegram test: FAILED"));
-        telegramConsecutiveFailures++;
-        // Попробуем отправить без форматирования только один раз
-        if (telegramConsecutiveFailures == 1) {
-          sendStart = millis();
-          success = bot->sendMessage(msg->chatId, msg->message, "");
-          sendDuration = millis() - sendStart;
-          if (success) {
-            Serial.println(F("Telegram test: OK (no format)"));
-            telegramConsecutiveFailures = 0;
-            lastTelegramSendSuccess = now;
-          } else {
-            Serial.println(F("Telegram test: Still failed"));
-            telegramConsecutiveFailures++;
-          }
-        }
-      }
+    bool isTest = msg->priority == TG_PRIORITY_TEST;
+    if (success) {
+      Serial.println(isTest ? F("Telegram test: OK") : F("Telegram: Sent"));
     } else {
-      if (success) {
-        Serial.println(F("Telegram: Sent"));
-        telegramConsecutiveFailures = 0;
-        lastTelegramSendSuccess = now;
-      } else {
-        Serial.println(F("Telegram: Failed"));
-        telegramConsecutiveFailures++;
-        // Попробуем отправить без форматирования только один раз
-        if (telegramConsecutiveFailures == 1) {
-          sendStart = millis();
-          success = bot->sendMessage(msg->chatId, msg->message, "");
-          sendDuration = millis() - sendStart;
-          if (success) {
-            Serial.println(F("Telegram: Sent (no format)"));
-            telegramConsecutiveFailures = 0;
-            lastTelegramSendSuccess = now;
-          } else {
-            Serial.println(F("Telegram: Still failed"));
-            telegramConsecutiveFailures++;
-          }
+      Serial.println(isTest ? F("Telegram test: FAILED") : F("Telegram: Failed"));
+      // Отказ API (400) при первой неудаче подряд может быть ошибкой разметки: один повтор
+      // без форматирования. После обрыва не повторяем - сообщение могло быть доставлено
+      BreakerStatus breaker;
+      getBreakerStatus(telegramBreaker, breaker);
+      if (result == TELEGRAM_API_REJECTED && telegramSendStatus == 400 &&
+          breaker.consecutiveFailures == 0 && ensureTelegramConnection(send_client, TELEGRAM_CONNECTION_SEND)) {
+        sendStart = millis();
+        success = sendTelegramApiMessage(token, msg, false) == TELEGRAM_API_OK;
+        sendDuration = millis() - sendStart;
+        recordLatency(telegramSendStats, sendDuration, success);
+        if (success) {
+          Serial.println(isTest ? F("Telegram test: OK (no format)") : F("Telegram: Sent (no format)"));
+        } else {
+          Serial.println(isTest ? F("Telegram test: Still failed") : F("Telegram: Still failed"));
         }
       }
     }
+    if (success) {
+      breakerSuccess(telegramBreaker);
+      lastTelegramSendSuccess = now;
+    } else {
+      breakerFailure(telegramBreaker);
+    }
 
-    freeMessage(msg);
+    if (success) {
+      if (msg->outboxSequence != 0) {
+        markOutboxDelivered(msg->outboxSequence);
+        outboxInFlight = false;
+      }
+      freeMessage(msg);
+    } else {
+      dropMessage(msg);
+    }
     telegramSendInProgress = false;
   }
 }
 
-// FreeRTOS задача для обработки Telegram сообщений
-// Работает в фоне, не блокирует основной loop()
+int getTelegramQueueDepth() {
+  TelegramQueueStats stats;
+  getTelegramQueueStats(stats);
+  return stats.depth;
+}
+
+void getTelegramQueueStats(TelegramQueueStats& stats) {
+  stats.depth = 0;
+  stats.oldestAgeMs = 0;
+  stats.evicted = telegramQueueEvicted;
+  stats.rejected = telegramQueueRejected;
+  stats.replaced = telegramQueueReplaced;
+  if (poolMutex == NULL || xSemaphoreTake(poolMutex, pdMS_TO_TICKS(50)) != pdTRUE) {
+    return;
+  }
+  unsigned long now = millis();
+  for (int i = 0; i < TELEGRAM_POOL_SIZE; i++) {
+    if (messagePool[i].state != TG_SLOT_QUEUED) continue;
+    stats.depth++;
+    unsigned long age = now - messagePool[i].enqueuedMs;
+    if (age > stats.oldestAgeMs) {
+      stats.oldestAgeMs = age;
+    }
+  }
+  xSemaphoreGive(poolMutex);
+}
+
+const LatencyStats& getTelegramQueueWaitStats() {
+  return telegramQueueWaitStats;
+}
+
+const LatencyStats& getTelegramSendStats() {
+  return telegramSendStats;
+}
+
+const char* getTelegramConnectionName(int connection) {
+  return telegramConnectionNames[connection];
+}
+
+const LatencyStats& getTelegramHandshakeStats(int connection) {
+  return telegramHandshakeStats[connection];
+}
+
+CircuitBreaker& getTelegramBreaker() {
+  return telegramBreaker;
+}
+
+uint32_t getTelegramConnectionReuses(int connection) {
+  return telegramConnectionReuses[connection];
+}
+
+// FreeRTOS задача опроса Telegram: длинный опрос без пауз, команда обрабатывается,
+// как только сервер ее вернул. Не блокирует основной loop()
 void telegramTask(void* parameter) {
   Serial.println(F("Telegram task started"));
   telegramTaskRunning = true;
 
   while (true) {
-    // Ждём 5 секунд между проверками
-    vTaskDelay(pdMS_TO_TICKS(5000));
-
-    // Проверяем, что WiFi подключен
-    if (WiFi.status() != WL_CONNECTED) {
+    // Без Wi-Fi или настроек - ждем, не нагружая ядро
+    if (WiFi.status() != WL_CONNECTED || WiFi.localIP() == IPAddress(0, 0, 0, 0)) {
       telegramLastPollOk = false;
+      vTaskDelay(pdMS_TO_TICKS(TELEGRAM_POLL_RETRY_MS));
       continue;
     }
-
-    // Дополнительная проверка стабильности WiFi
-    if (WiFi.localIP() == IPAddress(0, 0, 0, 0)) {
-      telegramLastPollOk = false;
+    if (!isTelegramConfigured()) {
+      ensureTelegramBot(); // Токен удален - освобождаем бота и соединение
+      vTaskDelay(pdMS_TO_TICKS(TELEGRAM_POLL_RETRY_MS));
       continue;
     }
 
-    // Обрабатываем входящие сообщения
+    // Возвращается по приходу сообщения или через TELEGRAM_LONG_POLL_SEC секунд
     handleTelegramMessages();
 
-    // Сбрасываем WDT для этой задачи
-    vTaskDelay(pdMS_TO_TICKS(10)); // Короткая пауза для yield
-
-    // Обрабатываем очередь исходящих сообщений
-    processTelegramQueue();
+    if (!telegramLastPollOk) {
+      // Ошибка (обрыв соединения, DNS) - пауза перед повторной попыткой, при разомкнутом
+      // автомате - до пробного запроса. Смена настроек будит задачу уведомлением
+      unsigned long pause = breakerRetryInMs(telegramBreaker);
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(pause > TELEGRAM_POLL_RETRY_MS ? pause : TELEGRAM_POLL_RETRY_MS));
+    } else {
+      vTaskDelay(pdMS_TO_TICKS(10)); // Короткая пауза для yield
+    }
   }
 
   telegramTaskRunning = false;
   vTaskDelete(NULL);
 }
 
+// Отправка накопленной сводки: по истечении окна или сразу (force).
+// Сводка длиннее записи outbox уходит несколькими сообщениями
+static void flushAlertDigest(bool force) {
+  if (alertDigestMutex == NULL || xSemaphoreTake(alertDigestMutex, pdMS_TO_TICKS(50)) != pdTRUE) {
+    return;
+  }
+  if (alertDigestCount == 0 || (!force && millis() - alertDigestStartMs < TELEGRAM_ALERT_WINDOW_MS)) {
+    xSemaphoreGive(alertDigestMutex);
+    return;
+  }
+
+  // Под alertDigestMutex: сводку отправляют и TelegramSend, и loop() (критичное оповещение)
+  static TextBuffer<OUTBOX_TEXT_SIZE + 1> message;
+  bool probe = allocProbeBegin();
+  int count = alertDigestCount;
+  TelegramPriority priority = (TelegramPriority)alertDigestPriority;
+  message.clear();
+  if (count == 1) {
+    message.add(ALERT_HEADER).add(alertDigestItems[0].text);
+  } else {
+    message.add("⚠️ *Температурные оповещения: ").addInt(count).add('*');
+    for (int i = 0; i < count; i++) {
+      if (strlen(alertDigestItems[i].text) + 2 > message.remaining()) {
+        enqueueTelegramMessage(NULL, message.c_str(), priority, 0);
+        message.clear();
+        message.add("⚠️ *Температурные оповещения (продолжение)*");
+      }
+      message.add("\n\n").add(alertDigestItems[i].text);
+    }
+  }
+  enqueueTelegramMessage(NULL, message.c_str(), priority, 0);
+  allocProbeEnd(probe);
+  alertDigestCount = 0;
+  xSemaphoreGive(alertDigestMutex);
+
+  if (count > 1) {
+    Serial.print(F("Telegram: alert digest of "));
+    Serial.print(count);
+    Serial.println(F(" alerts"));
+  }
+}
+
+// Добавление оповещения в сводку. false - сводка недоступна, отправить отдельным сообщением
+static bool addToAlertDigest(const char* sensorName, const char* text, TelegramPriority priority) {
+  if (TELEGRAM_ALERT_WINDOW_MS == 0 || alertDigestMutex == NULL) {
+    return false;
+  }
+  if (xSemaphoreTake(alertDigestMutex, pdMS_TO_TICKS(50)) != pdTRUE) {
+    return false;
+  }
+  int index = -1;
+  if (sensorName[0] != '\0') {
+    for (int i = 0; i < alertDigestCount; i++) {
+      if (strcmp(alertDigestItems[i].sensorName, sensorName) == 0) {
+        index = i;
+        break;
+      }
+    }
+  }
+  if (index < 0) {
+    if (alertDigestCount >= ALERT_DIGEST_MAX_ITEMS) {
+      xSemaphoreGive(alertDigestMutex);
+      return false;
+    }
+    if (alertDigestCount == 0) {
+      alertDigestStartMs = millis();
+      alertDigestPriority = priority;
+    }
+    index = alertDigestCount++;
+  }
+  if (priority > alertDigestPriority) {
+    alertDigestPriority = priority;
+  }
+  strlcpy(alertDigestItems[index].sensorName, sensorName, sizeof(alertDigestItems[index].sensorName));
+  strlcpy(alertDigestItems[index].text, text, sizeof(alertDigestItems[index].text));
+  xSemaphoreGive(alertDigestMutex);
+  return true;
+}
+
+// Повтор самого старого оповещения из outbox, когда очередь пуста и связь есть.
+// Оповещения уходят по одному и по порядку: следующее - после подтверждения предыдущего
+static bool replayOutbox() {
+  if (outboxInFlight || !telegramCanSend || !telegramNetworkUp()) {
+    return false;
+  }
+  if (breakerRetryInMs(telegramBreaker) > 0) {
+    return false;
+  }
+
+  static OutboxEntry entry;  // 1 КБ - не на стеке задачи
+  if (!peekOutboxMessage(entry)) {
+    return false;
+  }
+
+  char when[OUTBOX_REPLAY_TIME_MAX + 1];
+  if (entry.unixTime != 0) {
+    time_t eventTime = entry.unixTime;
+    struct tm timeinfo;
+    localtime_r(&eventTime, &timeinfo);
+    strftime(when, sizeof(when), "%d.%m.%Y %H:%M:%S", &timeinfo);
+  } else {
+    snprintf(when, sizeof(when), "%luс после запуска", (unsigned long)entry.uptimeSec);
+  }
+
+  static TextBuffer<TELEGRAM_MESSAGE_SIZE> message;  // Только задача TelegramSend
+  bool probe = allocProbeBegin();
+  message.clear();
+  message.add(OUTBOX_REPLAY_PREFIX).add(when).add(")\n\n").add(entry.text);
+  outboxInFlight = true;
+  bool queued = enqueueTelegramMessage(NULL, message.c_str(), entry.priority, entry.sequence);
+  allocProbeEnd(probe);
+
+  Serial.print(F("Telegram: replaying outbox alert #"));
+  Serial.println(entry.sequence);
+  return queued;
+}
+
+// FreeRTOS задача отправки: ждет сообщения в очереди и отправляет сразу,
+// с интервалом TELEGRAM_SEND_INTERVAL между отправками
+void telegramSendTask(void* parameter) {
+  Serial.println(F("Telegram send task started"));
+
+  while (true) {
+    flushAlertDigest(false);
+
+    // Ожидание короче окна сводки, чтобы она уходила без заметной задержки
+    if (getTelegramQueueDepth() == 0 && !replayOutbox()) {
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(250));
+      // Простой: соединение отправки не держим, чтобы не занимать память TLS
+      if (send_client.connected() && millis() - lastTelegramSendActivity > TELEGRAM_SEND_IDLE_CLOSE_MS) {
+        send_client.stop();
+        Serial.println(F("Telegram: send connection closed (idle)"));
+      }
+      continue;
+    }
+
+    unsigned long sinceLast = millis() - lastTelegramSendAttempt;
+    if (sinceLast < TELEGRAM_SEND_INTERVAL) {
+      vTaskDelay(pdMS_TO_TICKS(TELEGRAM_SEND_INTERVAL - sinceLast));
+    }
+    processTelegramQueue();
+    vTaskDelay(pdMS_TO_TICKS(10)); // Короткая пауза для yield
+  }
+}
+
+// Применение измененных настроек Telegram (вызывается из main loop)
+static void onTelegramSettingsChanged(uint32_t changedSections) {
+  (void)changedSections;
+  if (!lockSettings(pdMS_TO_TICKS(1000))) {
+    return;
+  }
+  String token = settingsRef().telegramToken;
+  String chatId = settingsRef().telegramChatId;
+  unlockSettings();
+
+  // Без условия: очищенные токен и chat_id тоже применяются - бот перестает опрашивать и отправлять
+  setTelegramConfig(token, chatId);
+}
+
 void startTelegramBot() {
   // Настройка SSL для Telegram
   // Для ESP32 можно использовать setInsecure() для тестирования
@@ -544,8 +1106,12 @@ void startTelegramBot() {
   secured_client.setInsecure(); // Используется для тестирования
   // Устанавливаем таймауты для предотвращения зависаний (в миллисекундах!)
   secured_client.setTimeout(10000); // 10 секунд таймаут для подключения
-  ensureTelegramBot();
+  send_client.setInsecure();
+  send_client.setTimeout(10000);
+  updateTelegramFlags();
   initTelegramQueue(); // Инициализируем очередь
+  initTelegramOutbox(); // Неотправленные до перезагрузки оповещения уйдут после подключения
+  subscribeSettings(SETTINGS_SECTION_TELEGRAM, onTelegramSettingsChanged);
 
   // Создаём FreeRTOS задачу для Telegram polling
   // Запускаем на ядре 0 (Protocol CPU), чтобы не блокировать основной loop на ядре 1
@@ -561,6 +1127,17 @@ void startTelegramBot() {
     );
     Serial.println(F("Telegram task created on core 0"));
   }
+  if (telegramSendTaskHandle == NULL) {
+    xTaskCreatePinnedToCore(
+      telegramSendTask,
+      "TelegramSend",
+      8192,                 // SSL/HTTPS
+      NULL,
+      1,
+      &telegramSendTaskHandle,
+      0
+    );
+  }
 
   if (telegramConfigured) {
     Serial.println(F("Telegram bot initialized"));
@@ -571,62 +1148,44 @@ void startTelegramBot() {
 
 // Функция сохранения настроек термометра
 static bool saveSensorSettings(InteractiveSession* session) {
-  // Загружаем текущие настройки
-  String settingsJson = getSettings();
-  StaticJsonDocument<8192> doc;
-  DeserializationError error = deserializeJson(doc, settingsJson);
-  if (error) {
-    Serial.println(F("TG: Failed to parse settings for sensor update"));
+  if (!lockSettings(pdMS_TO_TICKS(1000))) {
+    Serial.println(F("TG: Settings store busy"));
     return false;
   }
 
   // Ищем датчик по адресу и обновляем его настройки
-  JsonArray sensors = doc["sensors"].as<JsonArray>();
-  bool found = false;
-
-  for (JsonObject sensor : sensors) {
-    if (sensor["address"].as<String>() == session->selectedSensorAddress) {
-      // Обновляем имя если было изменено
-      if (session->sensorName.length() > 0) {
-        sensor["name"] = session->sensorName;
-      }
-      // Обновляем режим
-      sensor["mode"] = session->selectedModeStr;
-
-      // Обновляем настройки в зависимости от режима
-      if (session->selectedModeStr == "alert") {
-        JsonObject alertSettings = sensor["alertSettings"].to<JsonObject>();
-        alertSettings["minTemp"] = session->alertMinTemp;
-        alertSettings["maxTemp"] = session->alertMaxTemp;
-        alertSettings["buzzerEnabled"] = session->alertBuzzer;
-      } else if (session->selectedModeStr == "stabilization") {
-        JsonObject stabSettings = sensor["stabilizationSettings"].to<JsonObject>();
-        stabSettings["tolerance"] = session->stabTolerance;
-        stabSettings["alertThreshold"] = session->stabAlertThreshold;
-        stabSettings["duration"] = session->stabDuration;
-        stabSettings["buzzerEnabled"] = true;
-      }
-
-      found = true;
-      break;
-    }
-  }
-
-  if (!found) {
+  DeviceSettings& settings = settingsRef();
+  int idx = findStoredSensor(settings, session->selectedSensorAddress.c_str());
+  if (idx < 0) {
+    unlockSettings();
     Serial.println(F("TG: Sensor not found for update"));
     return false;
   }
 
-  // Сохраняем настройки
-  String output;
-  serializeJson(doc, output);
-  if (saveSettings(output)) {
-    // Устанавливаем флаг для перезагрузки настроек
-    extern bool forceReloadSettings;
-    forceReloadSettings = true;
-    return true;
+  StoredSensorConfig& sensor = settings.sensors[idx];
+  // Обновляем имя если было изменено
+  if (session->sensorName.length() > 0) {
+    strlcpy(sensor.name, session->sensorName.c_str(), sizeof(sensor.name));
+  }
+  // Обновляем режим
+  sensor.mode = sensorModeFromName(session->selectedModeStr.c_str());
+
+  // Обновляем настройки в зависимости от режима
+  if (sensor.mode == SENSOR_MODE_ALERT) {
+    sensor.alertMinTemp = constrain(session->alertMinTemp, -55.0f, 125.0f);
+    sensor.alertMaxTemp = constrain(session->alertMaxTemp, -55.0f, 125.0f);
+    sensor.alertBuzzerEnabled = session->alertBuzzer ? 1 : 0;
+  } else if (sensor.mode == SENSOR_MODE_STABILIZATION) {
+    sensor.stabTolerance = constrain(session->stabTolerance, 0.01f, 5.0f);
+    sensor.stabAlertThreshold = constrain(session->stabAlertThreshold, 0.05f, 10.0f);
+    sensor.stabDurationMin = constrain((int)session->stabDuration, 1, 60);
+    sensor.stabBuzzerEnabled = 1;
   }
-  return false;
+  unlockSettings();
+
+  // Запись в NVS и перезагрузка конфигураций - отложенно из main loop
+  scheduleSettingsCommit(SETTINGS_SECTION_SENSORS);
+  return true;
 }
 
 // Обработка интерактивного ввода
@@ -864,6 +1423,92 @@ static bool handleInteractiveInput(const String& chatId, const String& text) {
   }
 }
 
+// Входящие сообщения одного ответа getUpdates (только TelegramTask). Одно обновление за запрос:
+// следующее сервер отдает сразу, а ответ с длинным текстом не превышает буфер
+#define TELEGRAM_POLL_LIMIT 1
+#define TELEGRAM_POLL_RESPONSE_SIZE 4096
+#define TELEGRAM_POLL_REQUEST_TIMEOUT_MS ((TELEGRAM_LONG_POLL_SEC + 10) * 1000UL)
+
+struct TelegramIncoming {
+  String chatId;
+  String text;
+};
+static TelegramIncoming pollMessages[TELEGRAM_POLL_LIMIT];
+static char telegramPollResponse[TELEGRAM_POLL_RESPONSE_SIZE];
+
+// Длинный опрос по соединению опроса. TELEGRAM_API_OK - ответ "ok":true разобран, count - число
+// принятых сообщений (0 - за время опроса ничего не пришло). Отказ API (неверный токен - 401,
+// второй опрос с тем же токеном - 409, 5xx) и неразборчивый ответ - TELEGRAM_API_REJECTED
+static TelegramApiResult pollTelegramUpdates(int& count) {
+  count = 0;
+  char request[64];
+  snprintf(request, sizeof(request), "{\"offset\":%ld,\"limit\":%d,\"timeout\":%d}",
+           lastUpdateId + 1, TELEGRAM_POLL_LIMIT, TELEGRAM_LONG_POLL_SEC);
+  TelegramApiResponse response;
+  TelegramApiResult result = telegramApiPost(secured_client, pollToken, "getUpdates", request, strlen(request),
+                                             TELEGRAM_POLL_REQUEST_TIMEOUT_MS, telegramPollResponse,
+                                             sizeof(telegramPollResponse), response);
+  if (result == TELEGRAM_API_REJECTED) {
+    Serial.print(F("Telegram: getUpdates HTTP "));
+    Serial.print(response.httpStatus);
+    Serial.print(F(": "));
+    Serial.println(telegramPollResponse);
+  }
+  if (result != TELEGRAM_API_OK) {
+    return result;
+  }
+
+  if (response.bodyTruncated) {
+    // Обновление не поместилось в буфер: пропускаем его, иначе опрос будет получать его снова
+    const char* id = strstr(telegramPollResponse, "\"update_id\"");
+    if (id == NULL) {
+      return TELEGRAM_API_REJECTED;
+    }
+    id += 11;
+    while (*id == ' ' || *id == ':') id++;
+    lastUpdateId = atol(id);
+    Serial.print(F("Telegram: update "));
+    Serial.print(lastUpdateId);
+    Serial.println(F(" too long, skipped"));
+    return TELEGRAM_API_OK;
+  }
+
+  StaticJsonDocument<256> filter;
+  filter["result"][0]["update_id"] = true;
+  filter["result"][0]["message"]["chat"]["id"] = true;
+  filter["result"][0]["message"]["text"] = true;
+  filter["result"][0]["channel_post"]["chat"]["id"] = true;
+  filter["result"][0]["channel_post"]["text"] = true;
+  DynamicJsonDocument doc(1024);
+  DeserializationError error = deserializeJson(doc, telegramPollResponse, response.bodyLength,
+                                               DeserializationOption::Filter(filter));
+  if (error) {
+    Serial.print(F("Telegram: getUpdates JSON error: "));
+    Serial.println(error.c_str());
+    return TELEGRAM_API_REJECTED;
+  }
+
+  JsonArray updates = doc["result"].as<JsonArray>();
+  for (JsonObject update : updates) {
+    long updateId = update["update_id"] | 0L;
+    if (updateId > lastUpdateId) {
+      lastUpdateId = updateId;
+    }
+    JsonObject message = update.containsKey("message") ? update["message"].as<JsonObject>()
+                                                       : update["channel_post"].as<JsonObject>();
+    const char* text = message["text"];
+    if (text == NULL || count >= TELEGRAM_POLL_LIMIT) {
+      continue;  // Не текст (фото, вступление в чат) - подтверждается и пропускается
+    }
+    char chatId[24];
+    snprintf(chatId, sizeof(chatId), "%lld", (long long)message["chat"]["id"].as<int64_t>());
+    pollMessages[count].chatId = chatId;
+    pollMessages[count].text = text;
+    count++;
+  }
+  return TELEGRAM_API_OK;
+}
+
 void handleTelegramMessages() {
   // Проверяем WiFi перед любыми операциями с Telegram
   if (WiFi.status() != WL_CONNECTED) {
@@ -877,8 +1522,7 @@ void handleTelegramMessages() {
     return;
   }
 
-  ensureTelegramBot();
-  if (!bot || !telegramConfigured) {
+  if (!ensureTelegramBot() || !telegramConfigured) {
     return;
   }
 
@@ -889,12 +1533,33 @@ void handleTelegramMessages() {
   }
 
   // Используем offset для получения только новых сообщений
-  // last_message_received содержит ID последнего обработанного сообщения
-  // Передаем last_message_received + 1, чтобы получить только новые сообщения
+  // lastUpdateId содержит ID последнего обработанного обновления
+  // Передаем lastUpdateId + 1, чтобы получить только новые сообщения
   int numNewMessages = -1;
   // Проверяем WiFi еще раз перед getUpdates
   if (WiFi.status() == WL_CONNECTED && WiFi.localIP() != IPAddress(0, 0, 0, 0)) {
-    numNewMessages = bot->getUpdates(bot->last_message_received + 1);
+    if (!breakerAllow(telegramBreaker)) {
+      telegramLastPollOk = false; // Автомат разомкнут - задача опроса ждет до пробного запроса
+      return;
+    }
+    bool dnsBusy = false;
+    if (!ensureTelegramConnection(secured_client, TELEGRAM_CONNECTION_POLL, &dnsBusy)) {
+      if (dnsBusy) {
+        breakerRelease(telegramBreaker); // Опрос не выполнялся - автомат не меняется
+      } else {
+        breakerFailure(telegramBreaker);
+      }
+      telegramLastPollOk = false;
+      return;
+    }
+    // Ошибка - только по ответу API или обрыву: пустой опрос (0 сообщений) - успех
+    int received = 0;
+    if (pollTelegramUpdates(received) == TELEGRAM_API_OK) {
+      numNewMessages = received;
+      breakerSuccess(telegramBreaker);
+    } else {
+      breakerFailure(telegramBreaker);
+    }
   } else {
     Serial.println(F("Telegram: WiFi unstable, skipping getUpdates"));
     numNewMessages = -1;
@@ -923,11 +1588,11 @@ void handleTelegramMessages() {
   Serial.print(F("Telegram: received "));
   Serial.print(numNewMessages);
   Serial.print(F(" new message(s), last_update_id: "));
-  Serial.println(bot->last_message_received);
+  Serial.println(lastUpdateId);
 
   for (int i = 0; i < numNewMessages; i++) {
-    String originalText = bot->messages[i].text;
-    String chat_id = String(bot->messages[i].chat_id);
+    String originalText = pollMessages[i].text;
+    String chat_id = pollMessages[i].chatId;
     
     // Отладочный вывод
     Serial.print(F("Telegram message received: "));
@@ -1059,74 +1724,40 @@ void handleTelegramMessages() {
       int sensorCount = getSensorCount();
       message += "🌡️ *Термометры:* " + String(sensorCount) + "\n\n";
       
-      // Загружаем настройки термометров для получения имен и режимов
-      String settingsJson = getSettings();
-      StaticJsonDocument<4096> doc;
-      DeserializationError error = deserializeJson(doc, settingsJson);
-      
-      if (!error && doc["sensors"].is<JsonArray>()) {
-        JsonArray sensors = doc["sensors"].as<JsonArray>();
-        
-        // Создаем карту настроек по адресу
-        StaticJsonDocument<2048> sensorsMapDoc;
-        JsonObject sensorsMap = sensorsMapDoc.to<JsonObject>();
-        for (JsonObject sensor : sensors) {
-          String addr = sensor["address"].as<String>();
-          if (addr.length() > 0) {
-            sensorsMap[addr] = sensor;
-          }
-        }
-        
-        // Выводим информацию о каждом термометре
-        for (int i = 0; i < sensorCount; i++) {
-          String addressStr = getSensorAddressString(i);
-          float temp = getSensorTemperature(i);
-          
-          message += "🌡️ *Термометр " + String(i + 1) + "*\n";
-          
-          // Ищем настройки по адресу
-          if (sensorsMap[addressStr].is<JsonObject>()) {
-            JsonObject sensorSettings = sensorsMap[addressStr];
-            String name = sensorSettings["name"].as<String>();
-            if (name.length() == 0) {
-              name = "Термометр " + String(i + 1);
-            }
-            String mode = sensorSettings["mode"].as<String>();
-            if (mode.length() == 0) {
-              mode = "monitoring";
-            }
-            bool enabled = sensorSettings["enabled"] | true;
-            
-            message += "   📝 *Имя:* " + name + "\n";
-            message += "   ⚙️ *Режим:* ";
-            if (mode == "monitoring") {
-              message += "Мониторинг\n";
-            } else if (mode == "alert") {
-              message += "Оповещение\n";
-            } else if (mode == "stabilization") {
-              message += "Стабилизация\n";
-            } else {
-              message += mode + "\n";
+      // Выводим информацию о каждом термометре (имена и режимы - из настроек в RAM)
+      for (int i = 0; i < sensorCount; i++) {
+        String addressStr = getSensorAddressString(i);
+        float temp = getSensorTemperature(i);
+
+        String name = "Термометр " + String(i + 1);
+        uint8_t mode = SENSOR_MODE_MONITORING;
+        bool enabled = true;
+        if (lockSettings(pdMS_TO_TICKS(100))) {
+          const DeviceSettings& settings = settingsRef();
+          int idx = findStoredSensor(settings, addressStr.c_str());
+          if (idx >= 0) {
+            if (settings.sensors[idx].name[0] != '\0') {
+              name = settings.sensors[idx].name;
             }
-            message += "   ✅ *Статус:* " + String(enabled ? "Включен" : "Выключен") + "\n";
-          } else {
-            message += "   📝 *Имя:* Термометр " + String(i + 1) + "\n";
-            message += "   ⚙️ *Режим:* Мониторинг\n";
-            message += "   ✅ *Статус:* Включен\n";
+            mode = settings.sensors[idx].mode;
+            enabled = settings.sensors[idx].enabled != 0;
           }
-          
-          message += "   🌡️ *Температура:* " + String(temp != -127.0 ? String(temp, 1) : "Ошибка") + "°C\n";
-          message += "   🔗 *Адрес:* `" + addressStr + "`\n\n";
+          unlockSettings();
         }
-      } else {
-        // Если не удалось загрузить настройки, показываем базовую информацию
-        for (int i = 0; i < sensorCount; i++) {
-          String addressStr = getSensorAddressString(i);
-          float temp = getSensorTemperature(i);
-          message += "🌡️ *Термометр " + String(i + 1) + "*\n";
-          message += "   🌡️ *Температура:* " + String(temp != -127.0 ? String(temp, 1) : "Ошибка") + "°C\n";
-          message += "   🔗 *Адрес:* `" + addressStr + "`\n\n";
+
+        message += "🌡️ *Термометр " + String(i + 1) + "*\n";
+        message += "   📝 *Имя:* " + name + "\n";
+        message += "   ⚙️ *Режим:* ";
+        if (mode == SENSOR_MODE_ALERT) {
+          message += "Оповещение\n";
+        } else if (mode == SENSOR_MODE_STABILIZATION) {
+          message += "Стабилизация\n";
+        } else {
+          message += "Мониторинг\n";
         }
+        message += "   ✅ *Статус:* " + String(enabled ? "Включен" : "Выключен") + "\n";
+        message += "   🌡️ *Температура:* " + String(temp != -127.0 ? String(temp, 1) : "Ошибка") + "°C\n";
+        message += "   🔗 *Адрес:* `" + addressStr + "`\n\n";
       }
       
       sendTelegramMessageToQueue(chat_id, message);
@@ -1440,29 +2071,36 @@ void sendMetricsToTelegram(const String& sensorName, float temperature) {
     return; // WiFi не подключен
   }
   
-  ensureTelegramBot();
   updateTelegramFlags();
   
   if (!telegramCanSend) {
     return; // Telegram не настроен
   }
   
-  // Проверяем, не слишком ли много неудач подряд
-  if (telegramConsecutiveFailures >= MAX_TELEGRAM_FAILURES) {
-    unsigned long now = millis();
-    if (now - lastTelegramSendAttempt < 30000) { // 30 секунд паузы
-      return; // Слишком много неудач, пропускаем
-    }
+  // Автомат разомкнут - снимок метрик пропускаем
+  if (breakerRetryInMs(telegramBreaker) > 0) {
+    return;
   }
-  
+
+  // Все термометры с самыми длинными именами и подвал помещаются в одно сообщение
+  static_assert(TEXT_LITERAL_LEN("📊 *Метрики устройства*\n\n") +
+                MAX_SENSORS * (TEXT_LITERAL_LEN("🌡️ ") + SENSOR_NAME_SIZE - 1 + TEXT_LITERAL_LEN(": ") +
+                               FLOAT_TEXT_MAX + TEXT_LITERAL_LEN("°C\n")) +
+                TEXT_LITERAL_LEN("\n🌐 IP: ") + 15 + TEXT_LITERAL_LEN("\n⏱️ Время работы: ") + 2 * UINT_TEXT_MAX +
+                TEXT_LITERAL_LEN("ч м\n📶 Wi-Fi RSSI:  dBm") + UINT_TEXT_MAX < TELEGRAM_MESSAGE_SIZE,
+                "Telegram metrics message does not fit into a queue slot");
+
+  static TextBuffer<TELEGRAM_MESSAGE_SIZE> message;  // Вызывается только из loop()
+  bool probe = allocProbeBegin();
   unsigned long hours = deviceUptime / 3600;
   unsigned long minutes = (deviceUptime % 3600) / 60;
   
-  String message = "📊 *Метрики устройства*\n\n";
+  message.clear();
+  message.add("📊 *Метрики устройства*\n\n");
   
   // Если указано имя термометра, отправляем только его
   if (sensorName.length() > 0) {
-    message += "🌡️ " + sensorName + ": " + String(temperature, 1) + "°C\n";
+    message.add("🌡️ ").add(sensorName).add(": ").addFloat(temperature, 1).add("°C\n");
   } else {
     // Если имя не указано, собираем все термометры
     // Используем кеш настроек из main.cpp вместо загрузки из файла каждый раз
@@ -1470,21 +2108,21 @@ void sendMetricsToTelegram(const String& sensorName, float temperature) {
     if (sensorCount > 0) {
       // Добавляем информацию о каждом термометре из кеша
       for (int i = 0; i < sensorCount; i++) {
-        String addressStr = getSensorAddressString(i);
+        char address[24];
         float temp = getSensorTemperature(i);
         
-        if (temp == -127.0) {
+        if (temp == -127.0 || !formatSensorAddress(i, address, sizeof(address))) {
           continue; // Пропускаем невалидные температуры
         }
         
         // Ищем настройки в кеше
-        String name = "Термометр " + String(i + 1);
+        const char* name = nullptr;
         float correction = 0.0;
         bool enabled = true;
         
         for (int j = 0; j < sensorConfigCount && j < MAX_SENSORS; j++) {
-          if (sensorConfigs[j].valid && sensorConfigs[j].address == addressStr) {
-            name = sensorConfigs[j].name;
+          if (sensorConfigs[j].valid && sensorConfigs[j].address == address) {
+            name = sensorConfigs[j].name.c_str();
             correction = sensorConfigs[j].correction;
             enabled = sensorConfigs[j].enabled;
             break;
@@ -1497,74 +2135,93 @@ void sendMetricsToTelegram(const String& sensorName, float temperature) {
         
         // Применяем коррекцию
         float correctedTemp = temp + correction;
-        message += "🌡️ " + name + ": " + String(correctedTemp, 1) + "°C\n";
+        message.add("🌡️ ");
+        if (name != nullptr) {
+          message.add(name);
+        } else {
+          message.add("Термометр ").addInt(i + 1);
+        }
+        message.add(": ").addFloat(correctedTemp, 1).add("°C\n");
         
         yield(); // Даем время другим задачам
       }
     } else {
       // Если термометров нет, используем старую логику
-      message += "🌡️ Температура: " + String(temperature, 1) + "°C\n";
+      message.add("🌡️ Температура: ").addFloat(temperature, 1).add("°C\n");
     }
   }
   
-  message += "\n🌐 IP: " + deviceIP + "\n";
-  message += "⏱️ Время работы: " + String(hours) + "ч " + String(minutes) + "м\n";
-  message += "📶 Wi-Fi RSSI: " + String(wifiRSSI) + " dBm";
+  message.add("\n🌐 IP: ").add(deviceIP);
+  message.add("\n⏱️ Время работы: ").addUInt(hours).add("ч ").addUInt(minutes).add("м\n");
+  message.add("📶 Wi-Fi RSSI: ").addInt(wifiRSSI).add(" dBm");
   
-  // Используем очередь для отправки метрик
-  sendTelegramMessageToQueue(telegramChatId, message);
+  // Используем очередь для отправки метрик (новый снимок заменяет неотправленный)
+  enqueueTelegramMessage(NULL, message.c_str(), TG_PRIORITY_METRICS, 0);
+  allocProbeEnd(probe);
 }
 
 void sendTemperatureAlert(float temperature) {
   sendTemperatureAlert("", temperature, "");
 }
 
-void sendTemperatureAlert(const String& sensorName, float temperature, const String& alertType) {
-  if (WiFi.status() != WL_CONNECTED) {
-    return; // WiFi не подключен
-  }
-  
-  ensureTelegramBot();
+void sendTemperatureAlert(const char* sensorName, float temperature, const char* alertType, bool critical) {
   updateTelegramFlags();
   
   if (!telegramCanSend) {
     return; // Telegram не настроен
   }
-  
-  // Проверяем, не слишком ли много неудач подряд
-  if (telegramConsecutiveFailures >= MAX_TELEGRAM_FAILURES) {
-    unsigned long now = millis();
-    if (now - lastTelegramSendAttempt < 30000) { // 30 секунд паузы
-      return; // Слишком много неудач, пропускаем
-    }
-  }
-  
-  String alert = "⚠️ *Температурное оповещение*\n\n";
-  if (sensorName.length() > 0) {
-    alert += "🌡️ " + sensorName + "\n";
+
+  static_assert(TEXT_LITERAL_LEN("🌡️ ") + SENSOR_NAME_SIZE - 1 + TEXT_LITERAL_LEN("\n") +
+                TELEGRAM_ALERT_TYPE_SIZE - 1 + TEXT_LITERAL_LEN("\n") +
+                TEXT_LITERAL_LEN("🌡️ Температура: ") + FLOAT_TEXT_MAX + TEXT_LITERAL_LEN("°C\n") +
+                TEXT_LITERAL_LEN("⏰ Время: ") + UINT_TEXT_MAX + TEXT_LITERAL_LEN("с") < ALERT_TEXT_SIZE,
+                "ALERT_TEXT_SIZE is too small for the longest alert");
+
+  // Заголовок и текст в одном буфере: текст без заголовка идет в сводку
+  TextBuffer<TEXT_LITERAL_LEN(ALERT_HEADER) + ALERT_TEXT_SIZE> message;
+  bool probe = allocProbeBegin();
+  message.add(ALERT_HEADER);
+  const char* alert = message.c_str() + message.length();
+
+  if (sensorName[0] != '\0') {
+    message.add("🌡️ ").add(sensorName).add('\n');
   }
   
-  if (alertType.length() > 0) {
-    if (alertType == "high") {
-      alert += "🔥 *Высокая температура!*\n";
-    } else if (alertType == "low") {
-      alert += "❄️ *Низкая температура!*\n";
+  bool isHigh = strcmp(alertType, "high") == 0;
+  bool isLow = strcmp(alertType, "low") == 0;
+  if (alertType[0] != '\0') {
+    if (isHigh) {
+      message.add("🔥 *Высокая температура!*\n");
+    } else if (isLow) {
+      message.add("❄️ *Низкая температура!*\n");
     } else {
-      alert += alertType + "\n";
+      message.addBytes(alertType, strnlen(alertType, TELEGRAM_ALERT_TYPE_SIZE - 1)).add('\n');
     }
   } else {
     // Старая логика для обратной совместимости
     if (temperature >= HIGH_TEMP_THRESHOLD) {
-      alert += "🔥 *Высокая температура!*\n";
+      message.add("🔥 *Высокая температура!*\n");
     } else if (temperature <= LOW_TEMP_THRESHOLD) {
-      alert += "❄️ *Низкая температура!*\n";
+      message.add("❄️ *Низкая температура!*\n");
     }
   }
   
-  alert += "🌡️ Температура: " + String(temperature, 1) + "°C\n";
-  alert += "⏰ Время: " + String(millis() / 1000) + "с";
+  message.add("🌡️ Температура: ").addFloat(temperature, 1).add("°C\n");
+  message.add("⏰ Время: ").addUInt(millis() / 1000).add("с");
   
-  sendTelegramMessageToQueue(telegramChatId, alert);
+  // Выход за пороги и скачки - тревоги; остальное (например, достигнутая стабилизация) - ниже
+  bool isAlarm = critical || alertType[0] == '\0' || isHigh || isLow;
+  TelegramPriority priority = isAlarm ? TG_PRIORITY_ALARM : TG_PRIORITY_STABILIZATION;
+
+  // Без Wi-Fi или при разомкнутом автомате - сразу в outbox, отправится после восстановления
+  if (!telegramNetworkUp() || breakerRetryInMs(telegramBreaker) > 0) {
+    storeOutboxMessage(message.c_str(), priority);
+  } else if (critical || !addToAlertDigest(sensorName, alert, priority)) {
+    // Критичное оповещение (или сводка заполнена): накопленное уходит первым, затем это
+    flushAlertDigest(true);
+    enqueueTelegramMessage(NULL, message.c_str(), priority, 0);
+  }
+  allocProbeEnd(probe);
 }
 
 bool sendTelegramTestMessage() {
@@ -1574,28 +2231,60 @@ bool sendTelegramTestMessage() {
     return false;
   }
   
-  ensureTelegramBot();
+  updateTelegramFlags();
   if (!telegramCanSend) {
     Serial.println(F("Telegram not configured"));
     return false;
   }
   
-  String message = "✅ *Тестовое сообщение*\n\n";
-  message += "Если вы получили это сообщение, значит Telegram-бот настроен правильно!\n\n";
-  message += "🌡️ Температура: " + String(currentTemp, 1) + "°C\n";
-  message += "🌐 IP: " + deviceIP;
-  
-  sendTelegramMessageToQueue(telegramChatId, message, true);
+  TextBuffer<256> message;
+  bool probe = allocProbeBegin();
+  message.add("✅ *Тестовое сообщение*\n\n");
+  message.add("Если вы получили это сообщение, значит Telegram-бот настроен правильно!\n\n");
+  message.add("🌡️ Температура: ").addFloat(currentTemp, 1).add("°C\n");
+  message.add("🌐 IP: ").add(deviceIP);
+  enqueueTelegramMessage(NULL, message.c_str(), TG_PRIORITY_TEST, 0);
+  allocProbeEnd(probe);
   
   Serial.println(F("Telegram test message queued"));
   return true; // Сообщение добавлено в очередь, будет отправлено в loop()
 }
 
+#ifdef TELEGRAM_STANDIN
+void queueTelegramBenchAlerts(int count, bool critical, unsigned long offlineMs) {
+  // Обрыв начинается до оповещений: все они должны попасть в outbox
+  telegramBenchOfflineUntil = offlineMs > 0 ? (millis() + offlineMs) | 1 : 0;
+  char sensorName[16];
+  for (int i = 0; i < count; i++) {
+    snprintf(sensorName, sizeof(sensorName), "bench-%03d", i);
+    sendTemperatureAlert(sensorName, 99.0f, "high", critical);
+  }
+  Serial.print(F("Telegram bench: queued "));
+  Serial.print(count);
+  Serial.print(critical ? F(" critical alerts") : F(" alerts"));
+  if (offlineMs > 0) {
+    Serial.print(F(", simulated Wi-Fi outage "));
+    Serial.print(offlineMs);
+    Serial.print(F(" ms"));
+  }
+  Serial.println();
+}
+#endif
+
 void setTelegramConfig(const String& token, const String& chatId) {
+  // Экземпляры ботов пересоздаются задачами опроса и отправки при следующем обращении
+  bool locked = telegramConfigMutex != NULL && xSemaphoreTake(telegramConfigMutex, pdMS_TO_TICKS(1000)) == pdTRUE;
   telegramBotToken = token;
   telegramChatId = chatId;
+  if (locked) {
+    xSemaphoreGive(telegramConfigMutex);
+  }
   updateTelegramFlags();
-  ensureTelegramBot();
+  // Новые токен или чат - пробуем сразу, не дожидаясь паузы после прежних ошибок
+  breakerReset(telegramBreaker);
+  if (telegramTaskHandle != NULL) {
+    xTaskNotifyGive(telegramTaskHandle);
+  }
   
   Serial.print(F("Telegram config set: token="));
   Serial.print(telegramBotToken.length() > 0 ? "***" : "(empty)");
@@ -1623,3 +2312,18 @@ bool isTelegramPollOk() {
 unsigned long getTelegramLastPollMs() {
   return telegramLastPollMs;
 }
+
+const char* getTelegramStatus() {
+  if (!isTelegramConfigured()) {
+    return "not_configured";
+  }
+  // Успешный длинный опрос завершается не реже раза в TELEGRAM_LONG_POLL_SEC секунд
+  if (telegramLastPollOk && telegramLastPollMs > 0 &&
+      (millis() - telegramLastPollMs) < (TELEGRAM_LONG_POLL_SEC + 15) * 1000UL) {
+    return "connected";
+  }
+  if (telegramInitialized) {
+    return "connecting";
+  }
+  return "not_initialized";
+}
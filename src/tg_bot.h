@@ -1,7 +1,10 @@
 #ifndef TG_BOT_H
 #define TG_BOT_H
 
-#include <UniversalTelegramBot.h>
+#include <Arduino.h>
+
+struct LatencyStats;
+struct CircuitBreaker;
 
 void startTelegramBot();
 void handleTelegramMessages();
@@ -12,9 +15,58 @@ bool isTelegramConfigured();
 bool isTelegramInitialized();
 bool isTelegramPollOk();
 unsigned long getTelegramLastPollMs();
+const char* getTelegramStatus();
 void sendTemperatureAlert(float temperature);
-void sendTemperatureAlert(const String& sensorName, float temperature, const String& alertType);
+// Оповещение в Telegram. Обычные объединяются в сводку за TELEGRAM_ALERT_WINDOW_MS,
+// critical отправляется сразу. alertType - "high", "low" или строка события
+// не длиннее TELEGRAM_ALERT_TYPE_SIZE - 1 байт (длиннее - обрезается)
+#define TELEGRAM_ALERT_TYPE_SIZE 224
+void sendTemperatureAlert(const char* sensorName, float temperature, const char* alertType, bool critical = false);
 bool sendTelegramTestMessage();
 void processTelegramQueue(); // Обработка очереди сообщений (вызывать из loop())
+int getTelegramQueueDepth(); // Сообщений в очереди на отправку
+
+// Состояние приоритетной очереди исходящих сообщений
+struct TelegramQueueStats {
+  int depth;                  // Ожидают отправки
+  unsigned long oldestAgeMs;  // Возраст самого старого ожидающего
+  uint32_t evicted;           // Ожидавшие, вытесненные более важными (оповещения - в outbox)
+  uint32_t rejected;          // Новые, не принятые: очередь занята более важными или недоступна
+  uint32_t replaced;          // Неотправленные снимки метрик, замененные новыми
+};
+void getTelegramQueueStats(TelegramQueueStats& stats);
+const LatencyStats& getTelegramQueueWaitStats(); // Время от постановки в очередь до отправки
+const LatencyStats& getTelegramSendStats(); // Длительность и исход вызовов sendMessage
+
+// Адрес API Telegram. Для стенда (scripts/telegram_standin.py) переопределяется флагами сборки,
+// см. env:esp32dev_standin в platformio.ini. Соединение открывает прошивка, запросы
+// (getUpdates, sendMessage) идут по нему через telegram_api.h
+#ifndef TELEGRAM_API_HOST
+#define TELEGRAM_API_HOST "api.telegram.org"
+#endif
+#ifndef TELEGRAM_API_PORT
+#define TELEGRAM_API_PORT 443
+#endif
+
+#ifdef TELEGRAM_STANDIN
+// Шторм из count оповещений "bench-NNN" для замеров на стенде (scripts/telegram_bench.py).
+// critical - мимо сводки, каждое оповещение отдельным сообщением.
+// offlineMs > 0 - оповещения отправляются во время имитации обрыва Wi-Fi такой длины:
+// все они должны попасть в outbox и уйти после его окончания
+#define TELEGRAM_BENCH_MAX_ALERTS 100
+#define TELEGRAM_BENCH_MAX_OFFLINE_MS 120000UL
+void queueTelegramBenchAlerts(int count, bool critical, unsigned long offlineMs);
+#endif
+
+// TLS-соединения с API Telegram: у опроса и отправки свое соединение
+enum TelegramConnection {
+  TELEGRAM_CONNECTION_POLL = 0,  // Длинный опрос (TelegramTask)
+  TELEGRAM_CONNECTION_SEND,      // Отправка (TelegramSend)
+  TELEGRAM_CONNECTION_COUNT
+};
+const char* getTelegramConnectionName(int connection);
+const LatencyStats& getTelegramHandshakeStats(int connection); // Рукопожатия TLS: длительность и исход
+uint32_t getTelegramConnectionReuses(int connection); // Запросы по уже открытому соединению
+CircuitBreaker& getTelegramBreaker(); // Общий автомат опроса и отправки (net_health.h)
 
 #endif
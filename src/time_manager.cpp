@@ -3,6 +3,7 @@
 #include <WiFi.h>
 #include <time.h>
 #include "config.h"
+#include "settings_store.h"
 
 // Переменные для времени
 int timezoneOffset = 3; // По умолчанию UTC+3 (Москва)
@@ -22,6 +23,20 @@ int getTimezone() {
   return timezoneOffset;
 }
 
+// Применение измененного часового пояса (вызывается из main loop)
+static void onTimezoneSettingsChanged(uint32_t changedSections) {
+  (void)changedSections;
+  if (lockSettings(pdMS_TO_TICKS(1000))) {
+    int offset = settingsRef().timezoneOffset;
+    unlockSettings();
+    setTimezone(offset);
+  }
+}
+
+void subscribeTimezoneSettings() {
+  subscribeSettings(SETTINGS_SECTION_TIMEZONE, onTimezoneSettingsChanged);
+}
+
 void initTimeManager() {
   if (WiFi.status() == WL_CONNECTED) {
     configTime(timezoneOffset * 3600, daylightOffset_sec, ntpServer);
@@ -10,6 +10,7 @@ String getCurrentTime();
 String getCurrentDate();
 unsigned long getUnixTime();
 void setTimezone(int offset);
+void subscribeTimezoneSettings(); // Подписка на изменения часового пояса в настройках
 int getTimezone();
 
 #endif
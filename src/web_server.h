@@ -2,12 +2,15 @@
 #define WEB_SERVER_H
 
 #include <ESPAsyncWebServer.h>
+#include <ArduinoJson.h>
 
 extern AsyncWebServer server;
 
 void startWebServer();
-String getSettings();
-bool saveSettings(String json);
-void processPendingNvsSave();
+// Настройки в JSON. false - хранилище настроек занято, json не заполнен
+bool getSettings(String& json);
+// JSON термометра (настройки + текущая температура) для /api/data и /api/sensors.
+// false - хранилище настроек занято: записаны настройки по умолчанию, кешировать ответ нельзя
+bool fillSensorJson(JsonObject sensor, int index);
 
 #endif